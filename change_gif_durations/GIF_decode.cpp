@@ -0,0 +1,517 @@
+#include "GIF_decode.h"
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include "ToolStats.h"
+#include "ToolTrace.h"
+
+/**
+* Function decompresses GIF Table Based Image Data (LZW Minimum Code Size byte followed by data sub-blocks)
+* into palette indices. Rows are stored in the order they appear in the data, interlaced or not.
+* If the data ends early, the rest of the pixels are set to 0, same as most viewers do.
+* Returns 0 on success, 1 if the data ended early, -1 if the data is corrupt.
+* @param data Points to the LZW Minimum Code Size byte
+* @param size Size of data, up to and including the block terminator
+*/
+int decodeGIFImageData(const unsigned char* data, size_t size, unsigned char* indices, size_t pixelCount)
+{
+	if (size < 1) return -1;
+	const int minCodeSize = data[0];
+	if (minCodeSize < 1 || minCodeSize > 11) return -1;
+	const int clearCode = 1 << minCodeSize;
+	const int endCode = clearCode + 1;
+
+	// a string is stored as its last index plus the code of the string without it, so it gets written back to front
+	unsigned short prefix[4096];
+	unsigned char suffix[4096];
+	unsigned char first[4096];
+	unsigned short length[4096];
+	for (int i = 0; i < clearCode; ++i) {
+		suffix[i] = (unsigned char)i;
+		first[i] = (unsigned char)i;
+		length[i] = 1;
+	}
+
+	int codeSize = minCodeSize + 1;
+	int nextCode = clearCode + 2;
+	int previousCode = -1;
+	size_t outPos = 0;
+	size_t pos = 1;
+	size_t blockRemaining = 0;
+	unsigned int bitBuf = 0;
+	int bitCount = 0;
+	while (outPos < pixelCount) {
+		while (bitCount < codeSize) {
+			if (blockRemaining == 0) {
+				if (pos >= size || data[pos] == 0) {
+					goto endOfData;
+				}
+				blockRemaining = data[pos++];
+			}
+			if (pos >= size) {
+				goto endOfData;
+			}
+			bitBuf |= (unsigned int)data[pos++] << bitCount;
+			bitCount += 8;
+			--blockRemaining;
+		}
+		int code = (int)(bitBuf & ((1U << codeSize) - 1));
+		bitBuf >>= codeSize;
+		bitCount -= codeSize;
+
+		if (code == clearCode) {
+			codeSize = minCodeSize + 1;
+			nextCode = clearCode + 2;
+			previousCode = -1;
+			continue;
+		}
+		if (code == endCode) {
+			break;
+		}
+		if (previousCode == -1) {
+			if (code >= clearCode) return -1;
+		}
+		else {
+			if (code > nextCode || (code == nextCode && nextCode == 4096)) return -1;
+			if (nextCode < 4096) {
+				prefix[nextCode] = (unsigned short)previousCode;
+				suffix[nextCode] = code == nextCode ? first[previousCode] : first[code];
+				first[nextCode] = first[previousCode];
+				length[nextCode] = length[previousCode] + 1;
+				++nextCode;
+				if (nextCode == (1 << codeSize) && codeSize < 12) {
+					++codeSize;
+				}
+			}
+		}
+		previousCode = code;
+
+		size_t len = length[code];
+		size_t writePos = outPos + len;
+		outPos = writePos;
+		while (true) {
+			--writePos;
+			if (writePos < pixelCount) indices[writePos] = suffix[code];
+			if (len-- == 1) break;
+			code = prefix[code];
+		}
+	}
+endOfData:
+	if (outPos < pixelCount) {
+		memset(indices + outPos, 0, pixelCount - outPos);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+* Function reorders rows from interlaced order (every 8th row from 0, every 8th from 4, every 4th from 2, every 2nd from 1)
+* into display order.
+*/
+void deinterlaceGIFRows(const unsigned char* source, unsigned char* destination, int width, int height)
+{
+	static const int passStart[4] = { 0, 4, 2, 1 };
+	static const int passStep[4] = { 8, 8, 4, 2 };
+	for (int pass = 0; pass < 4; ++pass) {
+		for (int y = passStart[pass]; y < height; y += passStep[pass]) {
+			memcpy(destination + (size_t)y * width, source, width);
+			source += width;
+		}
+	}
+}
+
+/**
+* Function reads a frame's Table Based Image Data, as recorded by buildGIFIndex, into data.
+* Returns 0 on success, -1 on read error.
+*/
+int readGIFFrameData(FILE* file, const GIFFrameInfo& frame, std::vector<unsigned char>& data)
+{
+	data.resize((size_t)(frame.end - frame.dataOffset));
+	toolStatsSeek(file, frame.dataOffset, SEEK_SET);
+	if (fread(data.data(), 1, data.size(), file) != data.size()) {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+* Function reads and decompresses one frame recorded by buildGIFIndex along with its color table.
+* Returns 0 on success, -1 on read error or corrupt data.
+*/
+int decodeGIFFrame(FILE* file, const GIFIndex& index, const GIFFrameInfo& frame, GIFDecodedFrame& decoded)
+{
+	ToolTraceSpan span("decode frame", "gif", (long long)(&frame - index.frames.data()));
+	if (frame.localColorTableBits) {
+		size_t size = (size_t)(1 << frame.localColorTableBits) * 3;
+		toolStatsSeek(file, frame.dataOffset - size, SEEK_SET);
+		if (fread(decoded.colorTable, 1, size, file) != size) {
+			return -1;
+		}
+		decoded.colorTableBits = frame.localColorTableBits;
+	}
+	else {
+		memcpy(decoded.colorTable, index.globalColorTable, (size_t)(1 << index.globalColorTableBits) * 3);
+		decoded.colorTableBits = index.globalColorTableBits;
+	}
+	if (readGIFFrameData(file, frame, decoded.data) != 0) {
+		return -1;
+	}
+	size_t pixelCount = (size_t)frame.width * frame.height;
+	std::vector<unsigned char>& target = frame.interlaced ? decoded.interlaced : decoded.indices;
+	target.resize(pixelCount);
+	if (decodeGIFImageData(decoded.data.data(), decoded.data.size(), target.data(), pixelCount) < 0) {
+		return -1;
+	}
+	if (frame.interlaced) {
+		decoded.indices.resize(pixelCount);
+		deinterlaceGIFRows(decoded.interlaced.data(), decoded.indices.data(), frame.width, frame.height);
+	}
+	return 0;
+}
+
+void GIFCanvas::reset(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	pixels.assign((size_t)width * height, 0);
+	saved.clear();
+	hasPrevious = false;
+}
+
+// Clips a frame's rectangle to the canvas. Returns false if nothing is left.
+static bool GIFCanvas_clip(const GIFCanvas& canvas, const GIFFrameInfo& frame, int& x0, int& y0, int& x1, int& y1)
+{
+	x0 = frame.left;
+	y0 = frame.top;
+	x1 = frame.left + frame.width;
+	y1 = frame.top + frame.height;
+	if (x1 > canvas.width) x1 = canvas.width;
+	if (y1 > canvas.height) y1 = canvas.height;
+	return x0 < x1 && y0 < y1;
+}
+
+/**
+* Applies the disposal method of the last drawn frame. Called by drawFrame, call it directly only to see
+* what the canvas looks like after the last frame.
+*/
+void GIFCanvas::applyDisposal()
+{
+	if (!hasPrevious) return;
+	hasPrevious = false;
+	int x0, y0, x1, y1;
+	if (!GIFCanvas_clip(*this, previous, x0, y0, x1, y1)) return;
+	if (previous.disposal == 2) {
+		for (int y = y0; y < y1; ++y) {
+			memset(pixels.data() + (size_t)y * width + x0, 0, (x1 - x0) * sizeof(unsigned int));
+		}
+	}
+	else if (previous.disposal == 3 && !saved.empty()) {
+		for (int y = y0; y < y1; ++y) {
+			memcpy(pixels.data() + (size_t)y * width + x0, saved.data() + (size_t)(y - y0) * (x1 - x0), (x1 - x0) * sizeof(unsigned int));
+		}
+	}
+}
+
+void GIFCanvas::drawFrame(const GIFFrameInfo& frame, const GIFDecodedFrame& decoded)
+{
+	applyDisposal();
+	previous = frame;
+	hasPrevious = true;
+	int x0, y0, x1, y1;
+	if (!GIFCanvas_clip(*this, frame, x0, y0, x1, y1)) return;
+	if (frame.disposal == 3) {
+		saved.resize((size_t)(x1 - x0) * (y1 - y0));
+		for (int y = y0; y < y1; ++y) {
+			memcpy(saved.data() + (size_t)(y - y0) * (x1 - x0), pixels.data() + (size_t)y * width + x0, (x1 - x0) * sizeof(unsigned int));
+		}
+	}
+
+	unsigned int colors[256];
+	int colorCount = decoded.colorTableBits ? 1 << decoded.colorTableBits : 0;
+	for (int i = 0; i < 256; ++i) {
+		colors[i] = i < colorCount ? packGIFColor(decoded.colorTable + i * 3) : 0xFF000000U;
+	}
+	const int transparentIndex = frame.transparentIndex;
+	for (int y = y0; y < y1; ++y) {
+		const unsigned char* row = decoded.indices.data() + (size_t)(y - frame.top) * frame.width;
+		unsigned int* out = pixels.data() + (size_t)y * width + x0;
+		for (int x = 0; x < x1 - x0; ++x) {
+			if (row[x] != transparentIndex) {
+				out[x] = colors[row[x]];
+			}
+		}
+	}
+}
+
+/**
+* Decompresses a frame's Table Based Image Data one row at a time, reading it from the file in small chunks,
+* so that neither the compressed data nor the pixels of the whole frame are ever in memory.
+* Same decoding rules as decodeGIFImageData.
+*/
+struct GIFRowDecoder {
+	FILE* file;
+	long long fileOffset; // where the next chunk gets read from
+	long long fileEnd;
+	unsigned char buffer[65536];
+	size_t bufferPos;
+	size_t bufferSize;
+	size_t blockRemaining;
+	bool ended; // the data ended, every pixel from here on is 0
+	unsigned int bitBuf;
+	int bitCount;
+	int minCodeSize;
+	int clearCode;
+	int codeSize;
+	int nextCode;
+	int previousCode;
+	unsigned short prefix[4096];
+	unsigned char suffix[4096];
+	unsigned char first[4096];
+	unsigned short length[4096];
+	unsigned char pending[4096]; // the decoded string that's being copied out, it may go on into the next rows
+	int pendingPos;
+	int pendingSize;
+
+	int begin(FILE* file, const GIFFrameInfo& frame);
+	int nextByte();
+	int readRow(unsigned char* row, int width);
+};
+
+// Returns -1 at the end of the frame's data or on read error.
+int GIFRowDecoder::nextByte()
+{
+	if (bufferPos == bufferSize) {
+		if (fileOffset >= fileEnd) return -1;
+		size_t want = fileEnd - fileOffset < (long long)sizeof(buffer) ? (size_t)(fileEnd - fileOffset) : sizeof(buffer);
+		bufferSize = fread(buffer, 1, want, file);
+		bufferPos = 0;
+		if (bufferSize == 0) return -1;
+		fileOffset += bufferSize;
+	}
+	return buffer[bufferPos++];
+}
+
+// Returns 0 on success, -1 on read error or an invalid LZW Minimum Code Size.
+int GIFRowDecoder::begin(FILE* file, const GIFFrameInfo& frame)
+{
+	this->file = file;
+	fileOffset = frame.dataOffset;
+	fileEnd = frame.end;
+	bufferPos = 0;
+	bufferSize = 0;
+	toolStatsSeek(file, frame.dataOffset, SEEK_SET);
+	minCodeSize = nextByte();
+	if (minCodeSize < 1 || minCodeSize > 11) return -1;
+	clearCode = 1 << minCodeSize;
+	for (int i = 0; i < clearCode; ++i) {
+		suffix[i] = (unsigned char)i;
+		first[i] = (unsigned char)i;
+		length[i] = 1;
+	}
+	codeSize = minCodeSize + 1;
+	nextCode = clearCode + 2;
+	previousCode = -1;
+	blockRemaining = 0;
+	ended = false;
+	bitBuf = 0;
+	bitCount = 0;
+	pendingPos = 0;
+	pendingSize = 0;
+	return 0;
+}
+
+/**
+* Function decodes the next width pixels. Rows come in the order they are stored, interlaced or not.
+* Returns 0 on success, 1 if the data ended before the row was complete (the rest of it is 0), -1 if the data is corrupt.
+*/
+int GIFRowDecoder::readRow(unsigned char* row, int width)
+{
+	int x = 0;
+	while (x < width) {
+		if (pendingPos < pendingSize) {
+			int count = pendingSize - pendingPos < width - x ? pendingSize - pendingPos : width - x;
+			memcpy(row + x, pending + pendingPos, count);
+			pendingPos += count;
+			x += count;
+			continue;
+		}
+		if (ended) {
+			memset(row + x, 0, width - x);
+			return 1;
+		}
+		while (bitCount < codeSize) {
+			if (blockRemaining == 0) {
+				int size = nextByte();
+				if (size <= 0) break;
+				blockRemaining = size;
+			}
+			int byte = nextByte();
+			if (byte < 0) break;
+			bitBuf |= (unsigned int)byte << bitCount;
+			bitCount += 8;
+			--blockRemaining;
+		}
+		if (bitCount < codeSize) {
+			ended = true;
+			continue;
+		}
+		int code = (int)(bitBuf & ((1U << codeSize) - 1));
+		bitBuf >>= codeSize;
+		bitCount -= codeSize;
+
+		if (code == clearCode) {
+			codeSize = minCodeSize + 1;
+			nextCode = clearCode + 2;
+			previousCode = -1;
+			continue;
+		}
+		if (code == clearCode + 1) {
+			ended = true;
+			continue;
+		}
+		if (previousCode == -1) {
+			if (code >= clearCode) return -1;
+		}
+		else {
+			if (code > nextCode || (code == nextCode && nextCode == 4096)) return -1;
+			if (nextCode < 4096) {
+				prefix[nextCode] = (unsigned short)previousCode;
+				suffix[nextCode] = code == nextCode ? first[previousCode] : first[code];
+				first[nextCode] = first[previousCode];
+				length[nextCode] = length[previousCode] + 1;
+				++nextCode;
+				if (nextCode == (1 << codeSize) && codeSize < 12) {
+					++codeSize;
+				}
+			}
+		}
+		previousCode = code;
+		pendingSize = length[code];
+		pendingPos = 0;
+		for (int i = pendingSize - 1; i >= 0; --i) {
+			pending[i] = suffix[code];
+			code = prefix[code];
+		}
+	}
+	return 0;
+}
+
+// Display row of the row stored at position stored in an interlaced frame.
+static int interlacedGIFRow(int stored, int height)
+{
+	const int pass1 = (height + 7) / 8;
+	const int pass2 = (height + 3) / 8;
+	const int pass3 = (height + 1) / 4;
+	if (stored < pass1) return stored * 8;
+	stored -= pass1;
+	if (stored < pass2) return 4 + stored * 8;
+	stored -= pass2;
+	if (stored < pass3) return 2 + stored * 4;
+	return 1 + (stored - pass3) * 2;
+}
+
+/**
+* Function renders what a viewer shows after the given frame, one band of rows at a time, the same way GIFCanvas does.
+* Only one band of the canvas is in memory: for each band, every frame up to the requested one whose Image Descriptor says
+* it covers some of the band's rows gets decoded up to the last of those rows, and the others are skipped without reading them.
+* Interlaced frames are decoded in stored order and their rows remapped to the band. Memory use depends on the band size,
+* not on the canvas size or the number of frames; the price is that frames taller than a band are decoded again for each band.
+* @param frameNumber Frame after which the canvas is rendered
+* @param bandHeight Rows per band
+* @param emit Called for each band from top to bottom with the band's first row, its number of rows and its pixels
+*             packed like GIFCanvas pixels. Rendering stops if it returns false
+* Returns 0 on success, -1 on read error or corrupt data, -2 if emit returned false.
+*/
+int renderGIFBands(FILE* file, const GIFIndex& index, int frameNumber, int bandHeight,
+	const std::function<bool(int firstRow, int rowCount, const unsigned int* pixels)>& emit)
+{
+	const int width = index.width;
+	const int height = index.height;
+	if (bandHeight < 1) bandHeight = 1;
+	if (bandHeight > height) bandHeight = height;
+	std::unique_ptr<GIFRowDecoder> decoder(new GIFRowDecoder);
+	std::vector<unsigned int> band((size_t)width * bandHeight);
+	std::vector<unsigned int> saved;
+	std::vector<unsigned char> row;
+	unsigned char colorTable[256 * 3];
+	unsigned int colors[256];
+	for (int bandTop = 0; bandTop < height; bandTop += bandHeight) {
+		ToolTraceSpan span("render band", "gif", (long long)bandTop);
+		const int bandBottom = bandTop + bandHeight < height ? bandTop + bandHeight : height;
+		std::fill(band.begin(), band.end(), 0);
+		// the clipped rectangle of the previous frame within the band, to apply its disposal
+		const GIFFrameInfo* previous = NULL;
+		int px0 = 0, px1 = 0, py0 = 0, py1 = 0;
+		for (int f = 0; f <= frameNumber; ++f) {
+			if (previous && px0 < px1 && py0 < py1) {
+				if (previous->disposal == 2) {
+					for (int y = py0; y < py1; ++y) {
+						memset(band.data() + (size_t)(y - bandTop) * width + px0, 0, (px1 - px0) * sizeof(unsigned int));
+					}
+				}
+				else if (previous->disposal == 3) {
+					for (int y = py0; y < py1; ++y) {
+						memcpy(band.data() + (size_t)(y - bandTop) * width + px0, saved.data() + (size_t)(y - py0) * (px1 - px0), (px1 - px0) * sizeof(unsigned int));
+					}
+				}
+			}
+			const GIFFrameInfo& frame = index.frames[f];
+			previous = &frame;
+			px0 = frame.left;
+			px1 = frame.left + frame.width < width ? frame.left + frame.width : width;
+			py0 = frame.top > bandTop ? frame.top : bandTop;
+			py1 = frame.top + frame.height < bandBottom ? frame.top + frame.height : bandBottom;
+			if (px0 >= px1 || py0 >= py1) {
+				continue;
+			}
+			if (frame.disposal == 3) {
+				saved.resize((size_t)(px1 - px0) * (py1 - py0));
+				for (int y = py0; y < py1; ++y) {
+					memcpy(saved.data() + (size_t)(y - py0) * (px1 - px0), band.data() + (size_t)(y - bandTop) * width + px0, (px1 - px0) * sizeof(unsigned int));
+				}
+			}
+
+			int colorCount = 0;
+			if (frame.localColorTableBits) {
+				colorCount = 1 << frame.localColorTableBits;
+				toolStatsSeek(file, frame.dataOffset - colorCount * 3, SEEK_SET);
+				if (fread(colorTable, 1, (size_t)colorCount * 3, file) != (size_t)colorCount * 3) {
+					return -1;
+				}
+			}
+			else if (index.globalColorTableBits) {
+				colorCount = 1 << index.globalColorTableBits;
+				memcpy(colorTable, index.globalColorTable, (size_t)colorCount * 3);
+			}
+			for (int i = 0; i < 256; ++i) {
+				colors[i] = i < colorCount ? packGIFColor(colorTable + i * 3) : 0xFF000000U;
+			}
+
+			if (decoder->begin(file, frame) != 0) {
+				return -1;
+			}
+			row.resize(frame.width);
+			int rowsLeft = py1 - py0;
+			for (int stored = 0; stored < frame.height && rowsLeft > 0; ++stored) {
+				if (decoder->readRow(row.data(), frame.width) < 0) {
+					return -1;
+				}
+				const int y = frame.top + (frame.interlaced ? interlacedGIFRow(stored, frame.height) : stored);
+				if (y < py0 || y >= py1) {
+					continue;
+				}
+				--rowsLeft;
+				unsigned int* out = band.data() + (size_t)(y - bandTop) * width + px0;
+				for (int x = 0; x < px1 - px0; ++x) {
+					if (row[x] != frame.transparentIndex) {
+						out[x] = colors[row[x]];
+					}
+				}
+			}
+		}
+		if (!emit(bandTop, bandBottom - bandTop, band.data())) {
+			return -2;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+#include <functional>
+#include "GIF_parse.h"
+
+struct GIFDecodedFrame {
+	std::vector<unsigned char> data; // the frame's Table Based Image Data exactly as stored in the file
+	std::vector<unsigned char> indices; // width * height palette indices, rows in display order (deinterlaced)
+	std::vector<unsigned char> interlaced; // scratch buffer for deinterlacing
+	unsigned char colorTable[256 * 3]; // the local color table, or a copy of the Global Color Map
+	int colorTableBits; // 0 if the frame has neither a local color table nor a Global Color Map
+};
+
+/**
+* Composites frames one after another the way a viewer shows them, including disposal methods.
+* Pixels are packed as R | G << 8 | B << 16 | A << 24, 0 is a transparent pixel.
+* Disposal 2 (restore to background) clears to transparent, which is what browsers do.
+*/
+struct GIFCanvas {
+	int width;
+	int height;
+	std::vector<unsigned int> pixels;
+	std::vector<unsigned int> saved; // the rectangle under the previous frame, if it has disposal 3
+	GIFFrameInfo previous; // last frame drawn, its disposal is applied when the next one is drawn
+	bool hasPrevious;
+
+	void reset(int width, int height);
+	void applyDisposal();
+	void drawFrame(const GIFFrameInfo& frame, const GIFDecodedFrame& decoded);
+};
+
+int decodeGIFImageData(const unsigned char* data, size_t size, unsigned char* indices, size_t pixelCount);
+
+void deinterlaceGIFRows(const unsigned char* source, unsigned char* destination, int width, int height);
+
+int readGIFFrameData(FILE* file, const GIFFrameInfo& frame, std::vector<unsigned char>& data);
+
+int decodeGIFFrame(FILE* file, const GIFIndex& index, const GIFFrameInfo& frame, GIFDecodedFrame& decoded);
+
+int renderGIFBands(FILE* file, const GIFIndex& index, int frameNumber, int bandHeight,
+	const std::function<bool(int firstRow, int rowCount, const unsigned int* pixels)>& emit);
+
+inline unsigned int packGIFColor(const unsigned char* rgb) {
+	return rgb[0] | (rgb[1] << 8) | (rgb[2] << 16) | 0xFF000000U;
+}
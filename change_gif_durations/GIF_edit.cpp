@@ -0,0 +1,2139 @@
+#include "GIF_edit.h"
+#include "GIF_decode.h"
+#include "GIF_encode.h"
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+#include <iomanip>
+#include "CrossPlatformDefs.h"
+#include "ToolStats.h"
+#include "ToolTrace.h"
+#ifdef FOR_LINUX
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GIF_EDIT_SSE2
+#endif
+
+#ifdef FOR_LINUX
+// Copies this big or bigger go through copy_file_range, so the kernel moves the bytes without copying them into the process.
+// Smaller ones are cheaper to do through the stdio buffer.
+#define GIF_EDIT_COPY_FILE_RANGE_MIN 16384
+#endif
+
+/**
+* Copies size bytes starting at offset from input to output. Returns false on read or write error.
+* On Linux big copies use copy_file_range, falling back to fread/fwrite if the file systems don't support it.
+*/
+static bool copyGIFBytes(FILE* input, long long offset, long long size, FILE* output) {
+#ifdef FOR_LINUX
+	if (size >= GIF_EDIT_COPY_FILE_RANGE_MIN && fflush(output) == 0) {
+		off_t inputOffset = (off_t)offset;
+		bool copiedAny = false;
+		while (size > 0) {
+			ssize_t copied = copy_file_range(fileno(input), &inputOffset, fileno(output), NULL, (size_t)size, 0);
+			if (copied <= 0) break;
+			size -= copied;
+			copiedAny = true;
+		}
+		offset = inputOffset;
+		// copy_file_range moved the file descriptor's position, tell stdio about it
+		if (copiedAny && toolStatsSeek(output, 0, SEEK_END) != 0) return false;
+		if (size == 0) return true;
+	}
+#endif
+	char buf[65536];
+	toolStatsSeek(input, offset, SEEK_SET);
+	while (size > 0) {
+		size_t chunk = size > (long long)sizeof(buf) ? sizeof(buf) : (size_t)size;
+		if (fread(buf, 1, chunk, input) != chunk) return false;
+		if (fwrite(buf, 1, chunk, output) != chunk) return false;
+		size -= chunk;
+	}
+	return true;
+}
+
+// Empties the output file, to start writing it over. Returns false on error.
+static bool rewindGIFOutput(FILE* output) {
+	if (fflush(output) != 0 || toolStatsSeek(output, 0, SEEK_SET) != 0) return false;
+#ifndef FOR_LINUX
+	return _chsize_s(_fileno(output), 0) == 0;
+#else
+	return ftruncate(fileno(output), 0) == 0;
+#endif
+}
+
+/**
+* Writes the output GIF. Byte ranges copied from the input are held back and merged with the ranges that
+* directly follow them, so a run of frames copied as stored becomes one big copy.
+* Everything written to the output must go through here, so that it lands after the pending copy.
+*/
+struct GIFBlockCopier {
+	FILE* input;
+	FILE* output;
+	long long pendingOffset;
+	long long pendingSize;
+
+	GIFBlockCopier(FILE* input, FILE* output) : input(input), output(output), pendingOffset(0), pendingSize(0) { }
+
+	bool flush() {
+		if (pendingSize == 0) return true;
+		long long size = pendingSize;
+		pendingSize = 0;
+		return copyGIFBytes(input, pendingOffset, size, output);
+	}
+	bool copy(long long offset, long long size) {
+		if (size == 0) return true;
+		if (pendingSize != 0 && pendingOffset + pendingSize == offset) {
+			pendingSize += size;
+			return true;
+		}
+		if (!flush()) return false;
+		pendingOffset = offset;
+		pendingSize = size;
+		return true;
+	}
+	bool write(const void* data, size_t size) {
+		return flush() && fwrite(data, 1, size, output) == size;
+	}
+	// Writes the GIF Trailer and flushes everything. Returns the size of the output, or -1 on write error.
+	long long finish() {
+		if (!write("\x3B", 1) || fflush(output) != 0) return -1;
+#ifndef FOR_LINUX
+		return _ftelli64(output);
+#else
+		return (long long)ftello(output);
+#endif
+	}
+};
+
+// Writes the input's signature, Screen Descriptor and Global Color Map. The version is always written as 89a,
+// because the output uses Graphic Control Extensions.
+static bool writeGIFHeaderFrom(GIFBlockCopier& out, const GIFIndex& index) {
+	return out.write("GIF89a", 6) && out.copy(6, index.headerSize - 6);
+}
+
+// Copies the extension blocks (comments, application extensions and such) that precede the given frame
+// and start before the given offset.
+static bool copyGIFExtensions(GIFBlockCopier& out, const GIFIndex& index, int frameIndex, long long before) {
+	for (const GIFExtensionInfo& extension : index.extensions) {
+		if (extension.frameIndex == frameIndex && extension.offset < before
+				&& !out.copy(extension.offset, extension.size)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Reads size bytes starting at offset. Returns false on read error.
+static bool readGIFBytes(FILE* input, long long offset, long long size, std::vector<unsigned char>& bytes) {
+	bytes.resize((size_t)size);
+	toolStatsSeek(input, offset, SEEK_SET);
+	return fread(bytes.data(), 1, bytes.size(), input) == bytes.size();
+}
+
+/**
+* 64-bit multiply-xorshift hash, 8 bytes per step. Not cryptographic, it's only used to rule out
+* frames that are different before comparing their bytes.
+*/
+static unsigned long long hashGIFBytes(const unsigned char* data, size_t size) {
+	const unsigned long long multiplier = 0x9E3779B97F4A7C15ULL;
+	unsigned long long hash = size * multiplier;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		unsigned long long word;
+		memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * multiplier;
+		hash ^= hash >> 29;
+	}
+	unsigned long long tail = 0;
+	for (; i < size; ++i) {
+		tail = tail << 8 | data[i];
+	}
+	hash = (hash ^ tail) * multiplier;
+	return hash ^ (hash >> 32);
+}
+
+/**
+* Function merges runs of consecutive frames that are byte-for-byte the same (same Image Descriptor,
+* local color table and compressed image data, same disposal and transparency) into one frame, whose delay is
+* the sum of the run's delays. Nothing gets decoded: frames are hashed and compared as stored and
+* the kept ones are copied to the output as is, except for their delay.
+* A run is split if its delay would go past the 655.35 s a GIF delay can hold.
+* Extension blocks of merged frames are kept and written after the frame they were merged into.
+* @param input GIF file to read
+* @param output File to write the GIF without duplicate frames into
+*/
+struct GIFEdit_response dedupGIF(FILE* input, FILE* output)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	const int frameCount = (int)index.frames.size();
+	response.framesIn = frameCount;
+	response.bytesIn = index.trailerOffset + 1;
+	GIFBlockCopier out(input, output);
+	if (!writeGIFHeaderFrom(out, index)) {
+		response.error = -2;
+		return response;
+	}
+
+	// the frame that later identical frames get merged into. It's kept in memory until a different frame shows up
+	std::vector<unsigned char> runBytes;
+	std::vector<unsigned char> frameBytes;
+	std::vector<int> mergedFrames;
+	int runFrame = -1;
+	int runDelay = 0;
+	unsigned long long runHash = 0;
+
+	auto flushRun = [&]() -> bool {
+		if (runFrame == -1) return true;
+		const GIFFrameInfo& frame = index.frames[runFrame];
+		if (mergedFrames.empty()) {
+			if (!out.copy(frame.start, frame.end - frame.start)) return false;
+		}
+		else {
+			if (frame.gceOffset != -1) {
+				size_t delayOffset = (size_t)(frame.gceOffset - frame.start) + 4;
+				runBytes[delayOffset] = (unsigned char)(runDelay & 0xFF);
+				runBytes[delayOffset + 1] = (unsigned char)(runDelay >> 8);
+			}
+			if (!out.write(runBytes.data(), runBytes.size())) return false;
+		}
+		++response.framesOut;
+		for (int merged : mergedFrames) {
+			if (!copyGIFExtensions(out, index, merged, LLONG_MAX)) return false;
+		}
+		mergedFrames.clear();
+		return true;
+	};
+
+	for (int i = 0; i < frameCount; ++i) {
+		const GIFFrameInfo& frame = index.frames[i];
+		if (!readGIFBytes(input, frame.start, frame.end - frame.start, frameBytes)) {
+			response.error = -2;
+			return response;
+		}
+		const size_t imageOffset = (size_t)(frame.descriptorOffset - frame.start);
+		const size_t imageSize = frameBytes.size() - imageOffset;
+		unsigned long long hash = hashGIFBytes(frameBytes.data() + imageOffset, imageSize);
+
+		if (runFrame != -1) {
+			const GIFFrameInfo& run = index.frames[runFrame];
+			const size_t runImageOffset = (size_t)(run.descriptorOffset - run.start);
+			if (hash == runHash
+					&& (run.gceOffset == -1) == (frame.gceOffset == -1)
+					&& (run.gceFlags & ~0x02) == (frame.gceFlags & ~0x02) // ignore the User Input Flag
+					&& run.transparentIndex == frame.transparentIndex
+					&& runDelay + frame.delay <= 0xFFFF
+					&& runBytes.size() - runImageOffset == imageSize
+					&& memcmp(runBytes.data() + runImageOffset, frameBytes.data() + imageOffset, imageSize) == 0) {
+				runDelay += frame.delay;
+				mergedFrames.push_back(i);
+				continue;
+			}
+		}
+
+		if (!flushRun() || !copyGIFExtensions(out, index, i, frame.start)) {
+			response.error = -2;
+			return response;
+		}
+		runBytes.swap(frameBytes);
+		runFrame = i;
+		runDelay = frame.delay;
+		runHash = hash;
+	}
+
+	if (!flushRun() || !copyGIFExtensions(out, index, frameCount, LLONG_MAX)) {
+		response.error = -2;
+		return response;
+	}
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
+
+struct GIFRect {
+	int x0;
+	int y0;
+	int x1; // exclusive
+	int y1; // exclusive
+
+	bool empty() const { return x0 >= x1 || y0 >= y1; }
+	void add(int x, int y, int xEnd) {
+		if (empty()) {
+			x0 = x;
+			x1 = xEnd;
+			y0 = y;
+			y1 = y + 1;
+			return;
+		}
+		if (x < x0) x0 = x;
+		if (xEnd > x1) x1 = xEnd;
+		if (y < y0) y0 = y;
+		if (y + 1 > y1) y1 = y + 1;
+	}
+	void add(const GIFRect& other) {
+		if (other.empty()) return;
+		for (int y = other.y0; y < other.y1; y += other.y1 - other.y0 - 1 > 0 ? other.y1 - other.y0 - 1 : 1) {
+			add(other.x0, y, other.x1);
+		}
+	}
+};
+
+/**
+* Finds the first and last column where rows a and b differ, comparing 4 pixels at a time with SSE2 when available.
+* Returns false if the rows are identical.
+*/
+static bool findRowDifference(const unsigned int* a, const unsigned int* b, int width, int& first, int& last) {
+	int x = 0;
+#ifdef GIF_EDIT_SSE2
+	for (; x + 4 <= width; x += 4) {
+		__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(a + x)), _mm_loadu_si128((const __m128i*)(b + x)));
+		if (_mm_movemask_epi8(equal) != 0xFFFF) break;
+	}
+#endif
+	for (; x < width && a[x] == b[x]; ++x);
+	if (x == width) return false;
+	first = x;
+
+	x = width;
+#ifdef GIF_EDIT_SSE2
+	for (; x - 4 >= first; x -= 4) {
+		__m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(a + x - 4)), _mm_loadu_si128((const __m128i*)(b + x - 4)));
+		if (_mm_movemask_epi8(equal) != 0xFFFF) break;
+	}
+#endif
+	for (; a[x - 1] == b[x - 1]; --x);
+	last = x - 1;
+	return true;
+}
+
+/**
+* Finds the first and last column where a pixel is opaque in row a and transparent in row b.
+* Returns false if there are none.
+*/
+static bool findRowCleared(const unsigned int* a, const unsigned int* b, int width, int& first, int& last) {
+	int x = 0;
+#ifdef GIF_EDIT_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 4 <= width; x += 4) {
+		__m128i aTransparent = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(a + x)), zero);
+		__m128i bTransparent = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(b + x)), zero);
+		if (_mm_movemask_epi8(_mm_andnot_si128(aTransparent, bTransparent)) != 0) break;
+	}
+#endif
+	for (; x < width && !(a[x] != 0 && b[x] == 0); ++x);
+	if (x == width) return false;
+	first = x;
+	for (x = width - 1; !(a[x] != 0 && b[x] == 0); --x);
+	last = x;
+	return true;
+}
+
+// Bounding box of all pixels that differ between two canvases.
+static GIFRect findChangedRect(const std::vector<unsigned int>& a, const std::vector<unsigned int>& b, int width, int height) {
+	GIFRect rect = { 0, 0, 0, 0 };
+	int first, last;
+	for (int y = 0; y < height; ++y) {
+		if (findRowDifference(a.data() + (size_t)y * width, b.data() + (size_t)y * width, width, first, last)) {
+			rect.add(first, y, last + 1);
+		}
+	}
+	return rect;
+}
+
+// Bounding box of all pixels that are opaque on canvas a and transparent on canvas b.
+static GIFRect findClearedRect(const std::vector<unsigned int>& a, const std::vector<unsigned int>& b, int width, int height) {
+	GIFRect rect = { 0, 0, 0, 0 };
+	int first, last;
+	for (int y = 0; y < height; ++y) {
+		if (findRowCleared(a.data() + (size_t)y * width, b.data() + (size_t)y * width, width, first, last)) {
+			rect.add(first, y, last + 1);
+		}
+	}
+	return rect;
+}
+
+#define GIF_COLOR_MAP_SLOTS 1024
+
+/**
+* Up to 256 canvas colors, each with a palette index, in a fixed-size open-addressing table,
+* so that filling it again for every frame doesn't allocate. No color table holds more than 256 colors,
+* so once it's full, more colors only set overflowed.
+*/
+struct GIFColorMap {
+	unsigned int keys[GIF_COLOR_MAP_SLOTS];
+	unsigned char values[GIF_COLOR_MAP_SLOTS];
+	bool occupied[GIF_COLOR_MAP_SLOTS];
+	unsigned int colors[256]; // in the order they were added
+	unsigned short slots[256]; // where each of them is, to clear just those
+	int count;
+	bool overflowed;
+
+	GIFColorMap() : count(0), overflowed(false) {
+		memset(occupied, 0, sizeof(occupied));
+	}
+
+	void clear() {
+		for (int i = 0; i < count; ++i) {
+			occupied[slots[i]] = false;
+		}
+		count = 0;
+		overflowed = false;
+	}
+
+	static size_t slotOf(unsigned int color) {
+		return (size_t)((color * 2654435761U) >> 22) & (GIF_COLOR_MAP_SLOTS - 1);
+	}
+
+	// Adds the color or changes its index. Returns false if the map is full and the color isn't in it.
+	bool set(unsigned int color, unsigned char value) {
+		size_t slot = slotOf(color);
+		while (occupied[slot]) {
+			if (keys[slot] == color) {
+				values[slot] = value;
+				return true;
+			}
+			slot = (slot + 1) & (GIF_COLOR_MAP_SLOTS - 1);
+		}
+		if (count == 256) {
+			overflowed = true;
+			return false;
+		}
+		occupied[slot] = true;
+		keys[slot] = color;
+		values[slot] = value;
+		colors[count] = color;
+		slots[count++] = (unsigned short)slot;
+		return true;
+	}
+
+	bool find(unsigned int color, unsigned char& value) const {
+		for (size_t slot = slotOf(color); occupied[slot]; slot = (slot + 1) & (GIF_COLOR_MAP_SLOTS - 1)) {
+			if (keys[slot] == color) {
+				value = values[slot];
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+/**
+* Tries to express a set of colors plus one transparent index using an existing color table.
+* The transparent index must be a slot whose color isn't needed. Prefers preferredTransparent if it's free.
+* Returns false if some color is missing from the table or there's no free slot.
+*/
+static bool fitColorsIntoTable(const unsigned char* colors, int bits, const GIFColorMap& needed, int preferredTransparent,
+		GIFColorMap& colorToIndex, int& transparentIndex) {
+	const int count = 1 << bits;
+	colorToIndex.clear();
+	for (int i = count - 1; i >= 0; --i) {
+		colorToIndex.set(packGIFColor(colors + i * 3), (unsigned char)i); // lowest index wins
+	}
+	bool used[256] = { false };
+	for (int i = 0; i < needed.count; ++i) {
+		unsigned char found;
+		if (!colorToIndex.find(needed.colors[i], found)) return false;
+		used[found] = true;
+	}
+	transparentIndex = -1;
+	if (preferredTransparent >= 0 && preferredTransparent < count && !used[preferredTransparent]) {
+		transparentIndex = preferredTransparent;
+	}
+	for (int i = count - 1; i >= 0 && transparentIndex == -1; --i) {
+		if (!used[i]) transparentIndex = i;
+	}
+	return transparentIndex != -1;
+}
+
+/**
+* Writes frames that turn what the output GIF currently shows into a given canvas, touching only
+* the rectangle that differs. Keeps its buffers and encoder state between frames.
+*/
+struct GIFDeltaWriter {
+	std::unique_ptr<GIFEncoder> encoder;
+	std::unique_ptr<GIFPaletteLookup> lookup;
+	GIFColorMap needed; // colors the frame needs, the palette index is unused
+	GIFColorMap colorToIndex;
+	GIFPalette palette;
+	std::vector<unsigned char> indices;
+	std::vector<unsigned char> encoded;
+	int lossyFrames;
+
+	GIFDeltaWriter() : encoder(new GIFEncoder()), lossyFrames(0) { }
+	void encode(const GIFIndex& index, const GIFFrameInfo& frame, const unsigned char* localTable,
+		const std::vector<unsigned int>& target, std::vector<unsigned int>& shown, const GIFRect& clearedRect, int delay);
+	bool write(const GIFIndex& index, const GIFFrameInfo& frame, const unsigned char* localTable,
+		const std::vector<unsigned int>& target, std::vector<unsigned int>& shown, const GIFRect& clearedRect, int delay, GIFBlockCopier& out) {
+		encode(index, frame, localTable, target, shown, clearedRect, delay);
+		return out.write(encoded.data(), encoded.size());
+	}
+};
+
+/**
+* Function encodes a frame into encoded that makes the output show target, given that it currently shows shown, and updates shown.
+* The frame covers the bounding box of the pixels that differ, and pixels inside it that don't differ are transparent.
+* If clearedRect isn't empty, the frame is extended to cover it and gets disposal 2 (restore to background), so that
+* the next frame can have transparent pixels there. Otherwise it gets disposal 1 (do not dispose).
+* Colors are kept exact if possible: the Global Color Map is used if it has all the needed colors and a free slot for
+* transparency, then the source frame's own local table, then a new local table with just the needed colors.
+* @param frame The source frame target comes from. Its color table and transparent index are tried first
+* @param localTable The source frame's local color table, if it has one
+*/
+void GIFDeltaWriter::encode(const GIFIndex& index, const GIFFrameInfo& frame, const unsigned char* localTable,
+	const std::vector<unsigned int>& target, std::vector<unsigned int>& shown, const GIFRect& clearedRect, int delay)
+{
+	ToolTraceSpan span("encode frame", "gif", (long long)(&frame - index.frames.data()));
+	const int width = index.width;
+	GIFRect rect = findChangedRect(target, shown, width, index.height);
+	rect.add(clearedRect);
+	if (rect.empty()) {
+		rect.x0 = 0;
+		rect.y0 = 0;
+		rect.x1 = 1;
+		rect.y1 = 1;
+	}
+
+	needed.clear();
+	unsigned int lastColor = 0;
+	for (int y = rect.y0; y < rect.y1; ++y) {
+		const unsigned int* targetRow = target.data() + (size_t)y * width;
+		const unsigned int* shownRow = shown.data() + (size_t)y * width;
+		for (int x = rect.x0; x < rect.x1; ++x) {
+			unsigned int color = targetRow[x];
+			if (color != shownRow[x] && color != lastColor) {
+				needed.set(color, 0);
+				lastColor = color;
+			}
+		}
+	}
+
+	// pick the color table: the Global Color Map if it has everything, then the frame's own table, then a new one
+	int transparentIndex = -1;
+	bool useGlobal = false;
+	bool exact = true;
+	if (index.globalColorTableBits
+		&& fitColorsIntoTable(index.globalColorTable, index.globalColorTableBits, needed,
+			frame.localColorTableBits ? -1 : frame.transparentIndex, colorToIndex, transparentIndex)) {
+		useGlobal = true;
+	}
+	else if (frame.localColorTableBits
+		&& fitColorsIntoTable(localTable, frame.localColorTableBits, needed, frame.transparentIndex, colorToIndex, transparentIndex)) {
+		memcpy(palette.colors, localTable, (size_t)(1 << frame.localColorTableBits) * 3);
+		palette.bitsPerPixel = frame.localColorTableBits;
+	}
+	else if (needed.count < 256) {
+		palette.bitsPerPixel = 1;
+		while (1 << palette.bitsPerPixel < needed.count + 1) ++palette.bitsPerPixel;
+		memset(palette.colors, 0, sizeof(palette.colors));
+		colorToIndex.clear();
+		int nextIndex = 0;
+		for (int i = 0; i < needed.count; ++i) {
+			const unsigned int color = needed.colors[i];
+			palette.colors[nextIndex * 3] = (unsigned char)(color & 0xFF);
+			palette.colors[nextIndex * 3 + 1] = (unsigned char)((color >> 8) & 0xFF);
+			palette.colors[nextIndex * 3 + 2] = (unsigned char)((color >> 16) & 0xFF);
+			colorToIndex.set(color, (unsigned char)nextIndex++);
+		}
+		transparentIndex = nextIndex;
+	}
+	else {
+		// too many colors for one table. Map them to the nearest colors of the frame's own table
+		exact = false;
+		++lossyFrames;
+		if (frame.localColorTableBits) {
+			memcpy(palette.colors, localTable, (size_t)(1 << frame.localColorTableBits) * 3);
+			palette.bitsPerPixel = frame.localColorTableBits;
+		}
+		else if (index.globalColorTableBits) {
+			memcpy(palette.colors, index.globalColorTable, (size_t)(1 << index.globalColorTableBits) * 3);
+			palette.bitsPerPixel = index.globalColorTableBits;
+		}
+		else {
+			makeDefaultGIFPalette(palette);
+		}
+		transparentIndex = frame.transparentIndex != -1 ? frame.transparentIndex : (1 << palette.bitsPerPixel) - 1;
+		palette.transparentIndex = transparentIndex;
+		if (!lookup) lookup.reset(new GIFPaletteLookup());
+		buildGIFPaletteLookup(palette, *lookup);
+	}
+
+	indices.resize((size_t)(rect.x1 - rect.x0) * (rect.y1 - rect.y0));
+	unsigned char* indexOut = indices.data();
+	lastColor = 0;
+	unsigned char lastIndex = (unsigned char)transparentIndex;
+	unsigned int lastShown = 0;
+	for (int y = rect.y0; y < rect.y1; ++y) {
+		const unsigned int* targetRow = target.data() + (size_t)y * width;
+		unsigned int* shownRow = shown.data() + (size_t)y * width;
+		for (int x = rect.x0; x < rect.x1; ++x) {
+			unsigned int color = targetRow[x];
+			if (color == shownRow[x]) {
+				*indexOut++ = (unsigned char)transparentIndex;
+				continue;
+			}
+			if (color != lastColor) {
+				lastColor = color;
+				if (exact) {
+					colorToIndex.find(color, lastIndex);
+					lastShown = color;
+				}
+				else {
+					lastIndex = lookup->cells[(color & 0xF8) << 8 | (color >> 5 & 0x7E0) | (color >> 19 & 0x1F)];
+					lastShown = packGIFColor(palette.colors + lastIndex * 3);
+				}
+			}
+			*indexOut++ = lastIndex;
+			shownRow[x] = lastShown;
+		}
+	}
+
+	GIFFrameParams params;
+	params.left = rect.x0;
+	params.top = rect.y0;
+	params.width = rect.x1 - rect.x0;
+	params.height = rect.y1 - rect.y0;
+	params.delay = delay;
+	params.disposal = 1;
+	params.transparentIndex = transparentIndex;
+	params.localPalette = useGlobal ? NULL : &palette;
+	params.globalBitsPerPixel = index.globalColorTableBits;
+	if (!clearedRect.empty()) {
+		params.disposal = 2;
+		for (int y = rect.y0; y < rect.y1; ++y) {
+			memset(shown.data() + (size_t)y * width + rect.x0, 0, (rect.x1 - rect.x0) * sizeof(unsigned int));
+		}
+	}
+	encoded.clear();
+	writeGIFFrame(*encoder, encoded, params, indices.data());
+}
+
+static void reportLossyFrames(const GIFDeltaWriter& writer) {
+	if (writer.lossyFrames) {
+		CrossPlatformCerr << writer.lossyFrames << CrossPlatformText(" frame(s) had too many new colors to keep them exact and got mapped to the nearest colors.\n");
+	}
+}
+
+/**
+* Function rewrites a GIF so that each frame only covers the rectangle that changed since the previous frame,
+* with pixels inside it that didn't change made transparent, so that they compress into long LZW runs.
+* Frames are composited as a viewer would show them (including disposal methods) and compared against what
+* the output shows at that point. All output frames use disposal 1 (do not dispose), except frames that are followed by
+* pixels turning back to transparent: those get disposal 2 and a rectangle big enough to clear them.
+* Delays, looping and other extension blocks are kept. Colors are kept exact, except in the unlikely case that
+* a changed rectangle has more than 255 colors that none of the existing color tables hold.
+* A frame is copied as stored instead if the rewritten one isn't smaller and the output shows the same as the input
+* before it, and if the whole output still ends up bigger than the input, the input is copied through unchanged.
+* @param input GIF file to read
+* @param output File to write the optimized GIF into
+*/
+struct GIFEdit_response optimizeGIF(FILE* input, FILE* output)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	const int width = index.width;
+	const int height = index.height;
+	const int frameCount = (int)index.frames.size();
+	response.framesIn = frameCount;
+	response.bytesIn = index.trailerOffset + 1;
+	GIFBlockCopier out(input, output);
+	if (!writeGIFHeaderFrom(out, index)) {
+		response.error = -2;
+		return response;
+	}
+
+	GIFCanvas canvas;
+	canvas.reset(width, height);
+	GIFDecodedFrame decoded[2];
+	std::vector<unsigned int> current;
+	std::vector<unsigned int> next;
+	std::vector<unsigned int> before((size_t)width * height, 0); // what the input shows before the current frame is drawn
+	std::vector<unsigned int> nextBefore;
+	std::vector<unsigned int> shown((size_t)width * height, 0);
+	GIFDeltaWriter writer;
+
+	if (frameCount > 0) {
+		if (decodeGIFFrame(input, index, index.frames[0], decoded[0]) != 0) {
+			response.error = -1;
+			return response;
+		}
+		canvas.drawFrame(index.frames[0], decoded[0]);
+		current = canvas.pixels;
+	}
+	for (int i = 0; i < frameCount; ++i) {
+		const GIFFrameInfo& frame = index.frames[i];
+		GIFRect clearedRect = { 0, 0, 0, 0 };
+		if (i + 1 < frameCount) {
+			if (decodeGIFFrame(input, index, index.frames[i + 1], decoded[(i + 1) & 1]) != 0) {
+				response.error = -1;
+				return response;
+			}
+			canvas.applyDisposal();
+			nextBefore = canvas.pixels;
+			canvas.drawFrame(index.frames[i + 1], decoded[(i + 1) & 1]);
+			next = canvas.pixels;
+			clearedRect = findClearedRect(current, next, width, height);
+		}
+		// the stored frame draws the right picture only on top of what it's drawn on in the input
+		const bool canKeep = shown == before;
+		const int lossyFrames = writer.lossyFrames;
+		writer.encode(index, frame, decoded[i & 1].colorTable, current, shown, clearedRect, frame.delay);
+		bool written;
+		if (canKeep && (long long)writer.encoded.size() >= frame.end - frame.start) {
+			writer.lossyFrames = lossyFrames;
+			written = copyGIFExtensions(out, index, i, frame.start) && out.copy(frame.start, frame.end - frame.start);
+			// after the stored frame's own disposal, the output shows what the input does before the next frame
+			shown = nextBefore;
+		}
+		else {
+			written = copyGIFExtensions(out, index, i, LLONG_MAX) && out.write(writer.encoded.data(), writer.encoded.size());
+			++response.framesShrunk;
+		}
+		if (!written) {
+			response.error = -2;
+			return response;
+		}
+		++response.framesOut;
+		current.swap(next);
+		before.swap(nextBefore);
+	}
+
+	if (!copyGIFExtensions(out, index, frameCount, LLONG_MAX)) {
+		response.error = -2;
+		return response;
+	}
+	reportLossyFrames(writer);
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	else if (response.bytesOut >= response.bytesIn) {
+		CrossPlatformCerr << CrossPlatformText("Optimizing didn't make the GIF smaller, it was copied unchanged.\n");
+		if (!rewindGIFOutput(output) || !out.copy(0, index.trailerOffset)) {
+			response.error = -2;
+			return response;
+		}
+		response.framesShrunk = 0;
+		response.bytesOut = out.finish();
+		if (response.bytesOut == -1) {
+			response.error = -2;
+		}
+	}
+	return response;
+}
+
+// Frames read and recompressed at once by recompressGIF. Bounds memory to about this many pixels plus their compressed data.
+#define GIF_RECOMPRESS_BATCH_PIXELS (64LL * 1024 * 1024)
+#define GIF_RECOMPRESS_BATCH_FRAMES 256
+
+struct GIFRecompressJob {
+	const GIFFrameInfo* frame;
+	const unsigned char* colorTable; // the frame's color table, NULL if it has none
+	int colorCount;
+	int lossyBudget; // 0 for lossless
+	const unsigned char* data; // the frame's Table Based Image Data as stored, in the batch's buffer
+	size_t dataSize;
+	int worker; // which worker recompressed the frame, its output buffer holds the result
+	size_t recompressedOffset;
+	size_t recompressedSize; // 0 if no smaller encoding was found
+	double meanError; // average RGB distance pixels were changed by, with lossy encoding
+};
+
+/**
+* What one thread recompresses frames with. Workers live as long as recompressGIF runs, and their buffers are
+* reserved up front for the largest frame in the index, so recompressing a frame doesn't allocate.
+*/
+struct GIFRecompressWorker {
+	GIFEncoder encoder;
+	std::vector<unsigned char> indices;
+	std::vector<unsigned char> check;
+	std::vector<unsigned char> candidate;
+	std::vector<unsigned char> best;
+	std::vector<unsigned char> output; // recompressed data of the current batch's frames, one after another
+	GIFLossyPalette lossy;
+	unsigned char lossyColors[256 * 3]; // the palette lossy was last built for, to only rebuild it when the color table changes
+	int lossyColorCount;
+	int lossyTransparentIndex;
+};
+
+// Builds the worker's lossy tables for the job's color table, unless they are already built for the same one.
+static const GIFLossyPalette* prepareGIFLossyPalette(GIFRecompressWorker& worker, const GIFRecompressJob& job) {
+	if (!job.lossyBudget || !job.colorTable) {
+		return NULL;
+	}
+	const size_t size = (size_t)job.colorCount * 3;
+	if (worker.lossyColorCount != job.colorCount || worker.lossyTransparentIndex != job.frame->transparentIndex
+			|| memcmp(worker.lossyColors, job.colorTable, size) != 0) {
+		ToolTraceSpan span("build lossy palette", "gif", (long long)job.colorCount);
+		memcpy(worker.lossyColors, job.colorTable, size);
+		worker.lossyColorCount = job.colorCount;
+		worker.lossyTransparentIndex = job.frame->transparentIndex;
+		buildGIFLossyPalette(job.colorTable, job.colorCount, job.frame->transparentIndex, job.lossyBudget, worker.lossy);
+	}
+	return &worker.lossy;
+}
+
+/**
+* Function re-encodes one frame's image data with each clear code strategy, at the frame's LZW Minimum Code Size and at
+* the smallest one its indices allow, and keeps the smallest result if it's smaller than the stored data.
+* The result is decoded again and compared with the stored pixels before it's kept: it must be the same,
+* or with lossy encoding, no pixel may be further from the stored one than the budget.
+* Frames whose data is corrupt or ends early are left as stored, and so are frames with a code size above 8, whose indices don't fit in a byte.
+* A kept result is appended to the worker's output buffer.
+*/
+static void recompressGIFFrame(GIFRecompressWorker& worker, GIFRecompressJob& job) {
+	const size_t pixelCount = (size_t)job.frame->width * job.frame->height;
+	job.meanError = 0;
+	job.recompressedSize = 0;
+	if (job.dataSize == 0 || job.data[0] > 8) {
+		return;
+	}
+	worker.indices.resize(pixelCount);
+	if (decodeGIFImageData(job.data, job.dataSize, worker.indices.data(), pixelCount) != 0) {
+		return;
+	}
+	unsigned char maxIndex = 0;
+	for (size_t i = 0; i < pixelCount; ++i) {
+		if (worker.indices[i] > maxIndex) maxIndex = worker.indices[i];
+	}
+	int smallestCodeSize = 2;
+	while ((1 << smallestCodeSize) <= maxIndex) ++smallestCodeSize;
+	const int storedCodeSize = job.data[0];
+	const int codeSizes[2] = { storedCodeSize < smallestCodeSize ? smallestCodeSize : storedCodeSize, smallestCodeSize };
+	const GIFClearStrategy strategies[2] = { GIF_CLEAR_WHEN_FULL, GIF_CLEAR_DEFERRED };
+	const GIFLossyPalette* lossy = prepareGIFLossyPalette(worker, job);
+	worker.best.clear();
+	for (int c = 0; c < (codeSizes[0] == codeSizes[1] ? 1 : 2); ++c) {
+		for (GIFClearStrategy strategy : strategies) {
+			worker.candidate.clear();
+			encodeGIFImageData(worker.encoder, worker.indices.data(), pixelCount, codeSizes[c], worker.candidate, strategy, lossy);
+			const size_t best = worker.best.empty() ? job.dataSize : worker.best.size();
+			if (worker.candidate.size() < best) {
+				worker.best.swap(worker.candidate);
+			}
+		}
+	}
+	if (worker.best.empty()) {
+		return;
+	}
+	worker.check.resize(pixelCount);
+	if (decodeGIFImageData(worker.best.data(), worker.best.size(), worker.check.data(), pixelCount) != 0) {
+		return;
+	}
+	if (!lossy) {
+		if (memcmp(worker.check.data(), worker.indices.data(), pixelCount) != 0) {
+			return;
+		}
+	}
+	else {
+		const unsigned int squaredBudget = (unsigned int)job.lossyBudget * (unsigned int)job.lossyBudget;
+		double errorSum = 0;
+		for (size_t i = 0; i < pixelCount; ++i) {
+			const unsigned int distance = lossy->distance[worker.indices[i]][worker.check[i]];
+			if (distance > squaredBudget) {
+				return;
+			}
+			if (distance) errorSum += sqrt((double)distance);
+		}
+		job.meanError = pixelCount ? errorSum / pixelCount : 0;
+	}
+	job.recompressedOffset = worker.output.size();
+	job.recompressedSize = worker.best.size();
+	worker.output.insert(worker.output.end(), worker.best.begin(), worker.best.end());
+}
+
+static void runGIFRecompressWorker(GIFRecompressWorker* worker, int workerIndex, std::vector<GIFRecompressJob>* jobs, std::atomic<size_t>* nextJob) {
+	while (true) {
+		const size_t job = nextJob->fetch_add(1);
+		if (job >= jobs->size()) {
+			return;
+		}
+		ToolTraceSpan span("recompress frame", "gif", (long long)job);
+		(*jobs)[job].worker = workerIndex;
+		recompressGIFFrame(*worker, (*jobs)[job]);
+	}
+}
+
+// Prints how much smaller a frame got and by how much its pixels changed on average, for lossy encoding.
+static void reportGIFRecompressFrame(size_t frameNumber, const GIFRecompressJob& job) {
+	const long long bytesIn = (long long)job.dataSize;
+	const long long bytesOut = job.recompressedSize ? (long long)job.recompressedSize : bytesIn;
+	const std::streamsize precision = CrossPlatformCout.precision();
+	CrossPlatformCout << CrossPlatformText("Frame ") << frameNumber << CrossPlatformText(": ") << bytesIn << CrossPlatformText(" -> ") << bytesOut
+		<< CrossPlatformText(" bytes (") << bytesIn - bytesOut << CrossPlatformText(" saved), mean error ") << std::fixed << std::setprecision(2)
+		<< job.meanError << CrossPlatformText("\n");
+	CrossPlatformCout.unsetf(std::ios_base::floatfield);
+	CrossPlatformCout.precision(precision);
+}
+
+/**
+* Function rewrites the compressed image data of every frame that can be stored smaller.
+* Many encoders emit clear codes long before the code table fills up, or use a bigger LZW Minimum Code Size than the
+* frame's colors need. Each frame is decoded and encoded again with both a clear-when-full and a deferred clear
+* strategy, at the stored and at the smallest possible code size, and the new data is only used if it's smaller.
+* With a lossy budget, the encoder may also replace pixels with colors at most that far away (RGB distance) to make
+* LZW strings longer, and a line with the bytes saved and the mean error is printed for each frame.
+* Everything else (header, extensions, Graphic Control Extensions, Image Descriptors, color tables) is copied as stored,
+* in the same order. Frames are read in batches, recompressed on threadCount threads and written in order.
+* Buffers are sized from the Image Descriptors before the first batch and reused for all of them: each batch's
+* local color tables and image data go into one buffer, and each worker appends its results to its own.
+* @param input GIF file to read
+* @param output File to write the recompressed GIF into
+* @param threadCount How many threads recompress frames
+* @param lossyBudget 0 to keep every pixel exact, otherwise the largest RGB distance a pixel may be changed by
+*/
+struct GIFEdit_response recompressGIF(FILE* input, FILE* output, int threadCount, int lossyBudget)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	response.framesIn = index.frames.size();
+	response.framesOut = index.frames.size();
+	response.bytesIn = index.trailerOffset + 1;
+	if (threadCount < 1) threadCount = 1;
+	if ((size_t)threadCount > index.frames.size()) threadCount = index.frames.empty() ? 1 : (int)index.frames.size();
+
+	// split into batches and find the biggest frame and batch, to size the buffers once
+	std::vector<size_t> batchEnds;
+	size_t largestPixels = 0;
+	size_t largestData = 0;
+	size_t largestBatchBytes = 0;
+	for (size_t batchStart = 0; batchStart < index.frames.size(); ) {
+		size_t batchEnd = batchStart;
+		long long batchPixels = 0;
+		size_t batchBytes = 0;
+		while (batchEnd < index.frames.size() && batchEnd - batchStart < GIF_RECOMPRESS_BATCH_FRAMES
+			&& (batchEnd == batchStart || batchPixels + (long long)index.frames[batchEnd].width * index.frames[batchEnd].height <= GIF_RECOMPRESS_BATCH_PIXELS)) {
+			const GIFFrameInfo& frame = index.frames[batchEnd];
+			const size_t pixels = (size_t)frame.width * frame.height;
+			const size_t data = (size_t)(frame.end - frame.dataOffset);
+			batchPixels += (long long)pixels;
+			batchBytes += data + (frame.localColorTableBits ? (size_t)3 << frame.localColorTableBits : 0);
+			if (pixels > largestPixels) largestPixels = pixels;
+			if (data > largestData) largestData = data;
+			++batchEnd;
+		}
+		if (batchBytes > largestBatchBytes) largestBatchBytes = batchBytes;
+		batchEnds.push_back(batchEnd);
+		batchStart = batchEnd;
+	}
+	std::vector<unsigned char> batchBytes;
+	batchBytes.reserve(largestBatchBytes);
+	std::vector<GIFRecompressJob> jobs;
+	jobs.reserve(index.frames.size() < GIF_RECOMPRESS_BATCH_FRAMES ? index.frames.size() : GIF_RECOMPRESS_BATCH_FRAMES);
+	std::vector<std::unique_ptr<GIFRecompressWorker>> workers;
+	for (int t = 0; t < threadCount; ++t) {
+		workers.emplace_back(new GIFRecompressWorker);
+		GIFRecompressWorker& worker = *workers.back();
+		worker.lossyColorCount = 0;
+		worker.lossyTransparentIndex = -1;
+		worker.indices.reserve(largestPixels);
+		worker.check.reserve(largestPixels);
+		// results are only kept if they're smaller than the stored data
+		worker.candidate.reserve(largestData);
+		worker.best.reserve(largestData);
+		worker.output.reserve(largestBatchBytes / threadCount);
+	}
+
+	GIFBlockCopier out(input, output);
+	long long position = 0;
+	size_t batchStart = 0;
+	for (size_t batchEnd : batchEnds) {
+		jobs.resize(batchEnd - batchStart);
+		batchBytes.clear();
+		for (size_t i = batchStart; i < batchEnd; ++i) {
+			const GIFFrameInfo& frame = index.frames[i];
+			GIFRecompressJob& job = jobs[i - batchStart];
+			job.frame = &frame;
+			job.lossyBudget = lossyBudget;
+			// the local color table comes right before the image data, both are read at once
+			const size_t tableSize = frame.localColorTableBits ? (size_t)3 << frame.localColorTableBits : 0;
+			const size_t offset = batchBytes.size();
+			job.dataSize = (size_t)(frame.end - frame.dataOffset);
+			batchBytes.resize(offset + tableSize + job.dataSize);
+			toolStatsSeek(input, frame.dataOffset - (long long)tableSize, SEEK_SET);
+			if (fread(batchBytes.data() + offset, 1, tableSize + job.dataSize, input) != tableSize + job.dataSize) {
+				response.error = -2;
+				return response;
+			}
+		}
+		// only now that the buffer is done growing can jobs point into it
+		size_t offset = 0;
+		for (GIFRecompressJob& job : jobs) {
+			const GIFFrameInfo& frame = *job.frame;
+			job.colorTable = NULL;
+			job.colorCount = 0;
+			if (frame.localColorTableBits) {
+				job.colorCount = 1 << frame.localColorTableBits;
+				job.colorTable = batchBytes.data() + offset;
+				offset += (size_t)job.colorCount * 3;
+			}
+			else if (index.globalColorTableBits) {
+				job.colorCount = 1 << index.globalColorTableBits;
+				job.colorTable = index.globalColorTable;
+			}
+			job.data = batchBytes.data() + offset;
+			offset += job.dataSize;
+		}
+		for (std::unique_ptr<GIFRecompressWorker>& worker : workers) {
+			worker->output.clear();
+		}
+		std::atomic<size_t> nextJob(0);
+		std::vector<std::thread> threads;
+		for (int t = 1; t < threadCount && (size_t)t < jobs.size(); ++t) {
+			GIFRecompressWorker* worker = workers[t].get();
+			threads.emplace_back([worker, t, &jobs, &nextJob]() {
+				setToolTraceThreadName("recompress worker");
+				runGIFRecompressWorker(worker, t, &jobs, &nextJob);
+			});
+		}
+		runGIFRecompressWorker(workers[0].get(), 0, &jobs, &nextJob);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		for (size_t i = 0; i < jobs.size(); ++i) {
+			const GIFRecompressJob& job = jobs[i];
+			const GIFFrameInfo& frame = *job.frame;
+			bool written;
+			if (!job.recompressedSize) {
+				written = out.copy(position, frame.end - position);
+			}
+			else {
+				written = out.copy(position, frame.dataOffset - position)
+					&& out.write(workers[job.worker]->output.data() + job.recompressedOffset, job.recompressedSize);
+				++response.framesRecompressed;
+			}
+			if (!written) {
+				response.error = -2;
+				return response;
+			}
+			position = frame.end;
+			if (lossyBudget) {
+				reportGIFRecompressFrame(batchStart + i, job);
+			}
+		}
+		batchStart = batchEnd;
+	}
+	if (!out.copy(position, index.trailerOffset - position)) {
+		response.error = -2;
+		return response;
+	}
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
+
+// Frames composited at once by resizeGIF. Bounds memory to about this many source pixels plus their resized copies.
+#define GIF_RESIZE_BATCH_PIXELS (64LL * 1024 * 1024)
+#define GIF_RESIZE_BATCH_FRAMES 256
+
+// A source frame of the batch resizeGIF is working on
+struct GIFResizeFrame {
+	int number;
+	std::vector<unsigned int> canvas; // what the source shows during the frame
+	GIFPalette palette; // the frame's color table, resized pixels get mapped back to it
+	std::vector<std::vector<unsigned int>> filtered; // the canvas at each output size, straight from the filter
+	std::vector<std::vector<unsigned int>> resized; // the same with colors mapped to the palette
+};
+
+struct GIFResizeWorker {
+	std::vector<float> scratch;
+	GIFPaletteLookup lookup;
+	GIFPalette lookupPalette; // the palette lookup was built for, to only rebuild it when the color table changes
+	bool hasLookup;
+};
+
+// Everything about one output of resizeGIF that lasts from batch to batch
+struct GIFResizeWriter {
+	GIFIndex index; // the source index with the output's screen size, the way GIFDeltaWriter wants it
+	GIFDeltaWriter writer;
+	GIFBlockCopier out;
+	std::vector<unsigned int> current; // the last resized frame, written once the next one shows what it must clear
+	std::vector<unsigned int> currentFiltered; // the same before its colors were mapped
+	std::vector<unsigned int> shown;
+	unsigned char currentColors[256 * 3];
+	int currentFrame; // -1 before the first frame
+	bool failed;
+
+	GIFResizeWriter(FILE* output) : out(NULL, output), currentFrame(-1), failed(false) { }
+};
+
+// The source's extension blocks, read up front so that the output writers never touch the input file.
+struct GIFResizeExtensions {
+	std::vector<unsigned char> bytes;
+	std::vector<size_t> starts; // where each of index.extensions begins in bytes
+
+	bool write(GIFBlockCopier& out, const GIFIndex& index, int frameIndex) const {
+		for (size_t i = 0; i < index.extensions.size(); ++i) {
+			if (index.extensions[i].frameIndex == frameIndex
+					&& !out.write(bytes.data() + starts[i], (size_t)index.extensions[i].size)) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+// Resizes a frame's canvas to one output's size. A pixel that came out the same as the nearest source pixel keeps its color,
+// one the filter blended gets mapped to the nearest color of the frame's color table.
+static void resizeGIFFrameTo(GIFResizeWorker& worker, GIFResizeFrame& frame, const GIFIndex& source, const GIFIndex& target,
+	const GIFResizeAxis& xAxis, const GIFResizeAxis& yAxis, std::vector<unsigned int>& filtered, std::vector<unsigned int>& resized)
+{
+	filtered.resize((size_t)target.width * target.height);
+	resizeGIFCanvas(frame.canvas.data(), source.width, source.height, xAxis, yAxis, filtered.data(), target.width, target.height, worker.scratch);
+	resized = filtered;
+	const GIFPalette& palette = frame.palette;
+	if (!worker.hasLookup || worker.lookupPalette.bitsPerPixel != palette.bitsPerPixel
+			|| memcmp(worker.lookupPalette.colors, palette.colors, (size_t)3 << palette.bitsPerPixel) != 0) {
+		ToolTraceSpan span("build palette lookup", "gif", (long long)frame.number);
+		buildGIFPaletteLookup(palette, worker.lookup);
+		worker.lookupPalette = palette;
+		worker.hasLookup = true;
+	}
+	unsigned int lastColor = 0;
+	unsigned int lastMapped = 0;
+	for (int y = 0; y < target.height; ++y) {
+		const unsigned int* nearestRow = frame.canvas.data() + (size_t)(((long long)y * 2 + 1) * source.height / (target.height * 2LL)) * source.width;
+		unsigned int* row = resized.data() + (size_t)y * target.width;
+		for (int x = 0; x < target.width; ++x) {
+			const unsigned int pixel = row[x];
+			if (pixel == 0 || pixel == nearestRow[((long long)x * 2 + 1) * source.width / (target.width * 2LL)]) continue;
+			if (pixel != lastColor) {
+				lastColor = pixel;
+				lastMapped = packGIFColor(palette.colors + 3 * worker.lookup.cells[(pixel & 0xF8) << 8 | (pixel >> 5 & 0x7E0) | (pixel >> 19 & 0x1F)]);
+			}
+			row[x] = lastMapped;
+		}
+	}
+}
+
+static void runGIFResizeWorker(GIFResizeWorker* worker, std::vector<GIFResizeFrame>* frames, size_t frameCount, const GIFIndex* source,
+	std::vector<std::unique_ptr<GIFResizeWriter>>* writers, const std::vector<GIFResizeAxis>* axes, std::atomic<size_t>* nextJob)
+{
+	const size_t outputCount = writers->size();
+	while (true) {
+		const size_t job = nextJob->fetch_add(1);
+		if (job >= frameCount * outputCount) {
+			return;
+		}
+		GIFResizeFrame& frame = (*frames)[job / outputCount];
+		const size_t output = job % outputCount;
+		ToolTraceSpan span("resize frame", "gif", (long long)frame.number);
+		resizeGIFFrameTo(*worker, frame, *source, (*writers)[output]->index, (*axes)[output * 2], (*axes)[output * 2 + 1],
+			frame.filtered[output], frame.resized[output]);
+	}
+}
+
+// Writes the frame waiting in the writer, now that the one after it is known (or NULL if it was the last).
+static bool writeResizedGIFFrame(GIFResizeWriter& writer, const GIFResizeExtensions& extensions, const std::vector<unsigned int>* next) {
+	const GIFIndex& index = writer.index;
+	GIFRect clearedRect = { 0, 0, 0, 0 };
+	if (next) {
+		clearedRect = findClearedRect(writer.current, *next, index.width, index.height);
+	}
+	const GIFFrameInfo& frame = index.frames[writer.currentFrame];
+	return extensions.write(writer.out, index, writer.currentFrame)
+		&& writer.writer.write(index, frame, writer.currentColors, writer.current, writer.shown, clearedRect, frame.delay, writer.out);
+}
+
+// Writes the batch's resized frames into one output, in order.
+static void runGIFResizeWriter(GIFResizeWriter& writer, size_t output, std::vector<GIFResizeFrame>& frames, size_t frameCount,
+	const GIFResizeExtensions& extensions)
+{
+	for (size_t i = 0; i < frameCount && !writer.failed; ++i) {
+		GIFResizeFrame& frame = frames[i];
+		std::vector<unsigned int>& resized = frame.resized[output];
+		std::vector<unsigned int>& filtered = frame.filtered[output];
+		if (writer.currentFrame >= 0) {
+			// where the filter gave the same color as for the last frame, keep the last frame's mapped color: this frame's
+			// color table may not have it, and remapping would make pixels change that didn't change in the source
+			for (size_t p = 0; p < resized.size(); ++p) {
+				if (filtered[p] == writer.currentFiltered[p]) resized[p] = writer.current[p];
+			}
+			if (!writeResizedGIFFrame(writer, extensions, &resized)) {
+				writer.failed = true;
+				return;
+			}
+		}
+		// the batch's buffers get the old frame's, which are the same size and get overwritten in the next batch
+		writer.current.swap(resized);
+		writer.currentFiltered.swap(filtered);
+		memcpy(writer.currentColors, frame.palette.colors, sizeof(writer.currentColors));
+		writer.currentFrame = frame.number;
+	}
+}
+
+/**
+* Function writes the GIF at several sizes at once, decoding it only once.
+* Frames are composited as a viewer shows them, in batches, and every frame of a batch is resized to every size
+* on threadCount threads, with a separable filter (rows, then columns). Resized pixels are mapped back to the nearest
+* color of the frame's own color table, so the outputs keep the source's colors. Then each output is written on its own
+* thread the way optimizeGIF writes frames: each frame only covers the rectangle that changed, so frame rectangles and
+* positions follow what changes at the new size. Delays, looping and other extension blocks are kept.
+* @param input GIF file to read
+* @param outputs Sizes and files to write. bytesOut of each gets the size written, or -1 on write error
+* @param filter Resampling filter
+* @param threadCount How many threads resize frames
+*/
+struct GIFEdit_response resizeGIF(FILE* input, std::vector<GIFResizeOutput>& outputs, GIFResizeFilter filter, int threadCount)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0 || index.width == 0 || index.height == 0) {
+		response.error = -1;
+		return response;
+	}
+	const int frameCount = (int)index.frames.size();
+	response.framesIn = frameCount;
+	response.bytesIn = index.trailerOffset + 1;
+	if (threadCount < 1) threadCount = 1;
+
+	GIFResizeExtensions extensions;
+	for (const GIFExtensionInfo& extension : index.extensions) {
+		extensions.starts.push_back(extensions.bytes.size());
+		extensions.bytes.resize(extensions.bytes.size() + (size_t)extension.size);
+		toolStatsSeek(input, extension.offset, SEEK_SET);
+		if (fread(extensions.bytes.data() + extensions.starts.back(), 1, (size_t)extension.size, input) != (size_t)extension.size) {
+			response.error = -2;
+			return response;
+		}
+	}
+	std::vector<std::unique_ptr<GIFResizeWriter>> writers;
+	std::vector<GIFResizeAxis> axes(outputs.size() * 2);
+	for (size_t o = 0; o < outputs.size(); ++o) {
+		writers.emplace_back(new GIFResizeWriter(outputs[o].file));
+		GIFResizeWriter& writer = *writers.back();
+		writer.index = index;
+		writer.index.width = outputs[o].width;
+		writer.index.height = outputs[o].height;
+		writer.shown.assign((size_t)outputs[o].width * outputs[o].height, 0);
+		buildGIFResizeAxis(index.width, outputs[o].width, filter, axes[o * 2]);
+		buildGIFResizeAxis(index.height, outputs[o].height, filter, axes[o * 2 + 1]);
+		const unsigned char screen[13] = { 'G', 'I', 'F', '8', '9', 'a',
+			(unsigned char)(outputs[o].width & 0xFF), (unsigned char)(outputs[o].width >> 8),
+			(unsigned char)(outputs[o].height & 0xFF), (unsigned char)(outputs[o].height >> 8),
+			index.screenFlags, index.backgroundIndex, index.aspectRatio };
+		if (!writer.out.write(screen, sizeof(screen))
+				|| (index.globalColorTableBits && !writer.out.write(index.globalColorTable, (size_t)3 << index.globalColorTableBits))) {
+			response.error = -2;
+			return response;
+		}
+	}
+
+	std::vector<std::unique_ptr<GIFResizeWorker>> workers;
+	for (int t = 0; t < threadCount; ++t) {
+		workers.emplace_back(new GIFResizeWorker);
+		workers.back()->hasLookup = false;
+	}
+	long long batchFrames = GIF_RESIZE_BATCH_PIXELS / ((long long)index.width * index.height);
+	if (batchFrames < 1) batchFrames = 1;
+	if (batchFrames > GIF_RESIZE_BATCH_FRAMES) batchFrames = GIF_RESIZE_BATCH_FRAMES;
+	if (batchFrames > frameCount) batchFrames = frameCount;
+	std::vector<GIFResizeFrame> frames((size_t)batchFrames);
+	for (GIFResizeFrame& frame : frames) {
+		frame.filtered.resize(outputs.size());
+		frame.resized.resize(outputs.size());
+	}
+	GIFCanvas canvas;
+	canvas.reset(index.width, index.height);
+	GIFDecodedFrame decoded;
+	for (int batchStart = 0; batchStart < frameCount; batchStart += (int)batchFrames) {
+		const size_t batchSize = (size_t)(frameCount - batchStart < batchFrames ? frameCount - batchStart : batchFrames);
+		for (size_t i = 0; i < batchSize; ++i) {
+			GIFResizeFrame& frame = frames[i];
+			frame.number = batchStart + (int)i;
+			const GIFFrameInfo& info = index.frames[frame.number];
+			if (decodeGIFFrame(input, index, info, decoded) != 0) {
+				response.error = -1;
+				return response;
+			}
+			canvas.drawFrame(info, decoded);
+			frame.canvas = canvas.pixels;
+			if (decoded.colorTableBits) {
+				memcpy(frame.palette.colors, decoded.colorTable, sizeof(frame.palette.colors));
+				frame.palette.bitsPerPixel = decoded.colorTableBits;
+			}
+			else {
+				makeDefaultGIFPalette(frame.palette);
+			}
+			// every entry may be used: GIFDeltaWriter picks the output's transparent index itself
+			frame.palette.transparentIndex = -1;
+		}
+
+		std::atomic<size_t> nextJob(0);
+		std::vector<std::thread> threads;
+		for (int t = 1; t < threadCount && (size_t)t < batchSize * outputs.size(); ++t) {
+			GIFResizeWorker* worker = workers[t].get();
+			threads.emplace_back([worker, &frames, batchSize, &index, &writers, &axes, &nextJob]() {
+				setToolTraceThreadName("resize worker");
+				runGIFResizeWorker(worker, &frames, batchSize, &index, &writers, &axes, &nextJob);
+			});
+		}
+		runGIFResizeWorker(workers[0].get(), &frames, batchSize, &index, &writers, &axes, &nextJob);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+
+		// each output gets written on its own thread, they don't share anything
+		threads.clear();
+		for (size_t o = 1; o < writers.size(); ++o) {
+			GIFResizeWriter* writer = writers[o].get();
+			threads.emplace_back([writer, o, &frames, batchSize, &extensions]() {
+				setToolTraceThreadName("resize writer");
+				runGIFResizeWriter(*writer, o, frames, batchSize, extensions);
+			});
+		}
+		if (!writers.empty()) {
+			runGIFResizeWriter(*writers[0], 0, frames, batchSize, extensions);
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+
+	response.framesOut = frameCount;
+	for (size_t o = 0; o < writers.size(); ++o) {
+		GIFResizeWriter& writer = *writers[o];
+		if (!writer.failed && writer.currentFrame >= 0) {
+			writer.failed = !writeResizedGIFFrame(writer, extensions, NULL);
+		}
+		outputs[o].bytesOut = writer.failed || !extensions.write(writer.out, writer.index, frameCount) ? -1 : writer.out.finish();
+		if (outputs[o].bytesOut == -1) {
+			response.error = -2;
+		}
+		else {
+			response.bytesOut += outputs[o].bytesOut;
+		}
+	}
+	return response;
+}
+
+// A frame that covers the whole screen, has no transparency and doesn't restore to previous.
+// What's on screen during and after it doesn't depend on earlier frames.
+static bool isGIFFrameIndependent(const GIFIndex& index, const GIFFrameInfo& frame) {
+	return frame.left == 0 && frame.top == 0 && frame.width >= index.width && frame.height >= index.height
+		&& frame.transparentIndex == -1 && frame.disposal != 3;
+}
+
+// Copies a frame as stored, with its Graphic Control Extension's delay and disposal replaced. Adds a Graphic Control Extension if it has none.
+static bool copyGIFFrameWithTiming(GIFBlockCopier& out, const GIFFrameInfo& frame, int delay, int disposal, std::vector<unsigned char>& bytes) {
+	if (delay == frame.delay && disposal == frame.disposal) {
+		return out.copy(frame.start, frame.end - frame.start);
+	}
+	if (frame.gceOffset == -1) {
+		unsigned char gce[8] = { 0x21, 0xF9, 0x04, (unsigned char)(disposal << 2), (unsigned char)(delay & 0xFF), (unsigned char)(delay >> 8), 0, 0 };
+		return out.write(gce, sizeof(gce)) && out.copy(frame.start, frame.end - frame.start);
+	}
+	if (!readGIFBytes(out.input, frame.start, frame.end - frame.start, bytes)) return false;
+	size_t gce = (size_t)(frame.gceOffset - frame.start);
+	bytes[gce + 3] = (unsigned char)((bytes[gce + 3] & ~0x1C) | (disposal << 2));
+	bytes[gce + 4] = (unsigned char)(delay & 0xFF);
+	bytes[gce + 5] = (unsigned char)(delay >> 8);
+	return out.write(bytes.data(), bytes.size());
+}
+
+// Memory the canvas checkpoints of a GIFCanvasCursor may take
+#define GIF_EDIT_CHECKPOINT_BYTES (256LL * 1024 * 1024)
+
+/**
+* Keeps track of what the input GIF shows after a given frame, decoding only the frames needed for that.
+* Decoding starts at the last frame before the requested one that doesn't depend on earlier frames.
+* To go back to an earlier frame it starts over from there, or from a saved copy of the canvas if that's closer:
+* with checkpoints enabled, a copy is saved every checkpointInterval frames.
+*/
+struct GIFCanvasCursor {
+	GIFCanvas canvas;
+	GIFDecodedFrame decoded;
+	int frame; // last frame drawn on canvas, -1 if none
+	int checkpointInterval; // 0 if no checkpoints are saved
+	std::vector<GIFCanvas> checkpoints; // checkpoints[n] is the canvas after frame n * checkpointInterval, if it's been reached
+
+	void reset(const GIFIndex& index) {
+		canvas.reset(index.width, index.height);
+		frame = -1;
+		checkpointInterval = 0;
+		checkpoints.clear();
+	}
+
+	// Saves checkpoints for going back when frames are requested out of order. Keeps them within GIF_EDIT_CHECKPOINT_BYTES.
+	void enableCheckpoints(const GIFIndex& index) {
+		const long long frameCount = (long long)index.frames.size();
+		const long long canvasBytes = (long long)index.width * index.height * sizeof(unsigned int);
+		long long interval = 1;
+		while (interval * interval < frameCount) ++interval;
+		if (interval < 8) interval = 8;
+		if (frameCount / interval * canvasBytes > GIF_EDIT_CHECKPOINT_BYTES) {
+			interval = frameCount * canvasBytes / GIF_EDIT_CHECKPOINT_BYTES + 1;
+		}
+		checkpointInterval = (int)interval;
+	}
+
+	// Returns false if a frame fails to decode.
+	bool advanceTo(FILE* input, const GIFIndex& index, int target) {
+		if (target < frame) {
+			canvas.reset(index.width, index.height);
+			frame = -1;
+			if (checkpointInterval) {
+				size_t n = (size_t)(target / checkpointInterval);
+				if (n < checkpoints.size() && !checkpoints[n].pixels.empty()) {
+					canvas = checkpoints[n];
+					frame = (int)n * checkpointInterval;
+				}
+			}
+		}
+		int first = frame + 1;
+		for (int i = target; i > first; --i) {
+			if (isGIFFrameIndependent(index, index.frames[i])) {
+				canvas.reset(index.width, index.height);
+				first = i;
+				break;
+			}
+		}
+		for (int i = first; i <= target; ++i) {
+			if (decodeGIFFrame(input, index, index.frames[i], decoded) != 0) return false;
+			canvas.drawFrame(index.frames[i], decoded);
+			if (checkpointInterval && i % checkpointInterval == 0) {
+				size_t n = (size_t)(i / checkpointInterval);
+				if (checkpoints.size() <= n) checkpoints.resize(n + 1);
+				if (checkpoints[n].pixels.empty()) checkpoints[n] = canvas;
+			}
+		}
+		frame = target;
+		return true;
+	}
+};
+
+// What's on screen right before the frame is drawn is empty: it's the first frame, or the one before it covers the whole screen
+// and gets restored to background.
+static bool isGIFFrameOnEmptyScreen(const GIFIndex& index, int frameIndex) {
+	if (frameIndex == 0) return true;
+	const GIFFrameInfo& previous = index.frames[frameIndex - 1];
+	return previous.disposal == 2 && previous.left == 0 && previous.top == 0
+		&& previous.width >= index.width && previous.height >= index.height;
+}
+
+struct GIFSequenceEntry {
+	int frame;
+	int delay;
+	bool copyExtensions; // write the extension blocks before the frame, and those of the dropped frames after it
+	int droppedEnd; // one past the last dropped frame that follows this one
+};
+
+/**
+* Function writes a sequence of the input's frames, in any order, so that each one shows what it shows in the input.
+* Frames are copied as stored (only their delay and disposal can change) whenever their data still draws the right picture:
+* - frames that replace the whole screen;
+* - frames drawn on an empty screen in the input, when the output has an empty screen there too. A copied frame
+*   that covers the whole screen gets disposal 2 (restore to background) if the frame after it needs that;
+* - frames right after the frame before them in the input, when the output shows the same as the input at that point.
+* Otherwise the rectangle that differs between what the output shows and what the input shows is re-composited
+* and written as a new frame, same as optimizeGIF does.
+* Returns 0 on success, -1 if a frame failed to decode, -2 on write error.
+* @param sequence Frames to write, in order
+* @param framesOut Incremented for every frame written
+*/
+static int writeGIFFrameSequence(GIFBlockCopier& out, const GIFIndex& index, const std::vector<GIFSequenceEntry>& sequence, size_t& framesOut)
+{
+	FILE* input = out.input;
+	GIFCanvasCursor cursor;
+	cursor.reset(index);
+	for (size_t k = 1; k < sequence.size(); ++k) {
+		if (sequence[k].frame < sequence[k - 1].frame) {
+			cursor.enableCheckpoints(index);
+			break;
+		}
+	}
+	GIFDeltaWriter writer;
+	std::vector<unsigned int> shown((size_t)index.width * index.height, 0); // what the output shows before the current frame
+	bool shownValid = true;
+	bool outputEmpty = true; // the output shows nothing before the current frame
+	bool previousMatches = false; // after the previous frame, the output shows the same as the input
+	int previous = -1;
+	std::vector<unsigned int> current;
+	std::vector<unsigned char> bytes;
+	unsigned char localTable[256 * 3];
+	GIFCanvas after;
+
+	for (size_t k = 0; k < sequence.size(); ++k) {
+		const int i = sequence[k].frame;
+		const GIFFrameInfo& frame = index.frames[i];
+		const bool fullScreen = frame.left == 0 && frame.top == 0 && frame.width >= index.width && frame.height >= index.height;
+		const int next = k + 1 < sequence.size() ? sequence[k + 1].frame : -1;
+
+		bool copy = isGIFFrameIndependent(index, frame) || (outputEmpty && isGIFFrameOnEmptyScreen(index, i))
+			|| (previousMatches && i == previous + 1);
+		int disposal = frame.disposal;
+		bool nextCopied = next == -1 || isGIFFrameIndependent(index, index.frames[next])
+			|| (next == i + 1 && (copy || frame.disposal <= 1))
+			|| (copy && fullScreen && disposal == 2 && isGIFFrameOnEmptyScreen(index, next));
+		if (!nextCopied && copy && fullScreen && isGIFFrameOnEmptyScreen(index, next)) {
+			// clearing the screen after this frame lets the next one be copied too
+			disposal = 2;
+			nextCopied = true;
+		}
+		GIFRect clearedRect = { 0, 0, 0, 0 };
+		if ((!copy || !nextCopied) && !shownValid) {
+			// the output matches the input right after the previous frame
+			if (!cursor.advanceTo(input, index, previous)) return -1;
+			after = cursor.canvas;
+			after.applyDisposal();
+			shown = after.pixels;
+			shownValid = true;
+		}
+		if (!nextCopied) {
+			// the next frame will be re-composited on top of this one. Find pixels it needs cleared to transparent
+			if (!cursor.advanceTo(input, index, i)) return -1;
+			current = cursor.canvas.pixels;
+			after = cursor.canvas;
+			if (!cursor.advanceTo(input, index, next)) return -1;
+			if (copy) {
+				after.applyDisposal();
+				if (!findClearedRect(after.pixels, cursor.canvas.pixels, index.width, index.height).empty()) {
+					// try clearing the frame's own rectangle with disposal 2
+					after.pixels = current;
+					after.previous = frame;
+					after.previous.disposal = 2;
+					after.hasPrevious = true;
+					after.applyDisposal();
+					if (findClearedRect(after.pixels, cursor.canvas.pixels, index.width, index.height).empty()) {
+						disposal = 2;
+					}
+					else {
+						copy = false;
+					}
+				}
+			}
+			if (!copy) {
+				clearedRect = findClearedRect(current, cursor.canvas.pixels, index.width, index.height);
+			}
+			else {
+				shown = after.pixels;
+				shownValid = true;
+			}
+		}
+		else if (!copy) {
+			if (!cursor.advanceTo(input, index, i)) return -1;
+			current = cursor.canvas.pixels;
+		}
+
+		if (copy) {
+			if ((sequence[k].copyExtensions && !copyGIFExtensions(out, index, i, frame.start))
+					|| !copyGIFFrameWithTiming(out, frame, sequence[k].delay, disposal, bytes)) {
+				return -2;
+			}
+			previousMatches = disposal == frame.disposal;
+			outputEmpty = fullScreen && disposal == 2;
+			if (outputEmpty) {
+				std::fill(shown.begin(), shown.end(), 0);
+				shownValid = true;
+			}
+			else {
+				shownValid = shownValid && !nextCopied;
+			}
+		}
+		else {
+			if (frame.localColorTableBits) {
+				if (!readGIFBytes(input, frame.descriptorOffset + 10, (long long)(1 << frame.localColorTableBits) * 3, bytes)) return -2;
+				memcpy(localTable, bytes.data(), bytes.size());
+			}
+			if ((sequence[k].copyExtensions && !copyGIFExtensions(out, index, i, LLONG_MAX))
+					|| !writer.write(index, frame, localTable, current, shown, clearedRect, sequence[k].delay, out)) {
+				return -2;
+			}
+			previousMatches = clearedRect.empty() && frame.disposal <= 1;
+			outputEmpty = false;
+		}
+		++framesOut;
+		previous = i;
+		if (sequence[k].copyExtensions) {
+			// extension blocks of the dropped frames go after the frame they got merged into
+			for (int j = i + 1; j < sequence[k].droppedEnd; ++j) {
+				if (!copyGIFExtensions(out, index, j, LLONG_MAX)) return -2;
+			}
+		}
+	}
+	reportLossyFrames(writer);
+	return 0;
+}
+
+// Sums up the delays of frames from first to end - 1 into one delay, up to the 655.35 s a GIF delay can hold.
+static int sumGIFDelays(const GIFIndex& index, int first, int end) {
+	long long delay = 0;
+	for (int j = first; j < end; ++j) {
+		delay += index.frames[j].delay;
+	}
+	return delay > 0xFFFF ? 0xFFFF : (int)delay;
+}
+
+/**
+* Function thins out a GIF's frames, keeping either every Nth frame or as many frames as needed for a target framerate.
+* Delays of dropped frames are added to the frame before them, so the animation keeps its length.
+* Frames get copied as stored where possible, see writeGIFFrameSequence. The first frame is always kept.
+* @param input GIF file to read
+* @param output File to write the thinned out GIF into
+* @param keepEvery Keep frames 0, N, 2N and so on. Ignored if fps is not 0
+* @param fps Keep the first frame that starts in each 1/fps second long time slot
+*/
+struct GIFEdit_response decimateGIF(FILE* input, FILE* output, int keepEvery, int fps)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	const int frameCount = (int)index.frames.size();
+	response.framesIn = frameCount;
+	response.bytesIn = index.trailerOffset + 1;
+	GIFBlockCopier out(input, output);
+	if (!writeGIFHeaderFrom(out, index)) {
+		response.error = -2;
+		return response;
+	}
+
+	std::vector<GIFSequenceEntry> sequence;
+	long long time = 0; // start of the current frame in 1/100 of a second
+	long long nextSlot = 0;
+	for (int i = 0; i < frameCount; ++i) {
+		if (fps > 0 ? time * fps >= nextSlot * 100 : i % keepEvery == 0) {
+			if (!sequence.empty()) {
+				sequence.back().droppedEnd = i;
+			}
+			sequence.push_back({ i, 0, true, frameCount });
+			nextSlot = time * fps / 100 + 1;
+		}
+		time += index.frames[i].delay;
+	}
+	for (GIFSequenceEntry& entry : sequence) {
+		entry.delay = sumGIFDelays(index, entry.frame, entry.droppedEnd);
+	}
+
+	response.error = writeGIFFrameSequence(out, index, sequence, response.framesOut);
+	if (response.error != 0) {
+		return response;
+	}
+	if (!copyGIFExtensions(out, index, frameCount, LLONG_MAX)) {
+		response.error = -2;
+		return response;
+	}
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
+
+/**
+* Function writes frames start to end of a GIF into a new GIF, copying them as stored.
+* If the first kept frame only draws over part of the frames before it, it gets re-composited (see writeGIFFrameSequence),
+* and so do the following frames until one of them leaves the output showing the same as the input.
+* Application extensions before the range, such as the looping one, are kept.
+* @param input GIF file to read
+* @param output File to write the frames into
+* @param start First frame to keep, counting from 0
+* @param end Last frame to keep, inclusive
+*/
+struct GIFEdit_response trimGIF(FILE* input, FILE* output, int start, int end)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	const int frameCount = (int)index.frames.size();
+	response.framesIn = frameCount;
+	response.bytesIn = index.trailerOffset + 1;
+	if (start < 0 || end < start || end >= frameCount) {
+		response.error = -3;
+		return response;
+	}
+	GIFBlockCopier out(input, output);
+	if (!writeGIFHeaderFrom(out, index)) {
+		response.error = -2;
+		return response;
+	}
+	for (const GIFExtensionInfo& extension : index.extensions) {
+		if (extension.frameIndex < start && extension.label == 0xFF && !out.copy(extension.offset, extension.size)) {
+			response.error = -2;
+			return response;
+		}
+	}
+
+	std::vector<GIFSequenceEntry> sequence;
+	for (int i = start; i <= end; ++i) {
+		sequence.push_back({ i, index.frames[i].delay, true, i + 1 });
+	}
+	response.error = writeGIFFrameSequence(out, index, sequence, response.framesOut);
+	if (response.error != 0) {
+		return response;
+	}
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
+
+// Checks if an application extension is a NETSCAPE2.0 or ANIMEXTS1.0 one, which set how many times the GIF loops.
+static bool isGIFLoopExtension(FILE* input, const GIFExtensionInfo& extension) {
+	std::vector<unsigned char> bytes;
+	if (extension.label != 0xFF || extension.size < 14 || !readGIFBytes(input, extension.offset, 14, bytes)) return false;
+	return bytes[2] == 11 && (memcmp(bytes.data() + 3, "NETSCAPE2.0", 11) == 0 || memcmp(bytes.data() + 3, "ANIMEXTS1.0", 11) == 0);
+}
+
+// Copies the extension blocks that precede the given frame and start before the given offset, except looping ones.
+static bool copyGIFExtensionsExceptLoop(GIFBlockCopier& out, const GIFIndex& index, int frameIndex, long long before) {
+	for (const GIFExtensionInfo& extension : index.extensions) {
+		if (extension.frameIndex == frameIndex && extension.offset < before && !isGIFLoopExtension(out.input, extension)
+				&& !out.copy(extension.offset, extension.size)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+* Function writes a frame as stored, except for the parts of its Graphic Control Extension and Image Descriptor that change:
+* the delay, the position, and a local color table added in place of the Global Color Map it used.
+* The image data is block copied.
+* @param localTable Color table to add to the frame if it has no local color table. NULL to keep using the Global Color Map
+* @param localTableBits Bits per pixel of localTable
+*/
+static bool copyGIFFrameMoved(GIFBlockCopier& out, const GIFFrameInfo& frame, int delay, int dx, int dy,
+	const unsigned char* localTable, int localTableBits, std::vector<unsigned char>& bytes)
+{
+	if (delay != frame.delay && frame.gceOffset == -1) {
+		unsigned char gce[8] = { 0x21, 0xF9, 0x04, (unsigned char)(frame.disposal << 2), (unsigned char)(delay & 0xFF), (unsigned char)(delay >> 8), 0, 0 };
+		if (!out.write(gce, sizeof(gce))) return false;
+	}
+	if (!readGIFBytes(out.input, frame.start, frame.dataOffset - frame.start, bytes)) return false;
+	if (frame.gceOffset != -1) {
+		size_t gce = (size_t)(frame.gceOffset - frame.start);
+		bytes[gce + 4] = (unsigned char)(delay & 0xFF);
+		bytes[gce + 5] = (unsigned char)(delay >> 8);
+	}
+	unsigned char* descriptor = bytes.data() + (frame.descriptorOffset - frame.start);
+	descriptor[1] = (unsigned char)((frame.left + dx) & 0xFF);
+	descriptor[2] = (unsigned char)((frame.left + dx) >> 8);
+	descriptor[3] = (unsigned char)((frame.top + dy) & 0xFF);
+	descriptor[4] = (unsigned char)((frame.top + dy) >> 8);
+	if (localTable && !frame.localColorTableBits) {
+		descriptor[9] = (unsigned char)((descriptor[9] & 0x40) | 0x80 | (localTableBits - 1));
+		bytes.insert(bytes.end(), localTable, localTable + (1 << localTableBits) * 3);
+	}
+	return out.write(bytes.data(), bytes.size()) && out.copy(frame.dataOffset, frame.end - frame.dataOffset);
+}
+
+/**
+* Function joins GIFs one after another into one GIF, block copying their frames.
+* The output's Logical Screen is big enough for the biggest input and smaller inputs are centered on it
+* by moving their frames. The first input's Global Color Map becomes the output's one, frames of
+* other inputs with a different Global Color Map get that map as their local color table.
+* Looping extensions are taken from the first input only.
+* When an input's first frame only draws over part of the screen, an invisible frame that clears the screen
+* is put before it, taking 2/100 of a second from the last frame of the input before it.
+* @param inputs GIF files to read, in the order they're played
+* @param output File to write the joined GIF into
+*/
+struct GIFEdit_response concatGIFs(const std::vector<FILE*>& inputs, FILE* output)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	std::vector<GIFIndex> indexes(inputs.size());
+	int width = 0;
+	int height = 0;
+	for (size_t n = 0; n < inputs.size(); ++n) {
+		if (buildGIFIndex(inputs[n], indexes[n]) != 0) {
+			response.error = -1;
+			return response;
+		}
+		if (indexes[n].width > width) width = indexes[n].width;
+		if (indexes[n].height > height) height = indexes[n].height;
+		response.framesIn += indexes[n].frames.size();
+		response.bytesIn += indexes[n].trailerOffset + 1;
+	}
+	if (inputs.empty()) {
+		response.error = -1;
+		return response;
+	}
+	const GIFIndex& first = indexes[0];
+	GIFBlockCopier out(inputs[0], output);
+	unsigned char screen[13] = { 'G', 'I', 'F', '8', '9', 'a', (unsigned char)(width & 0xFF), (unsigned char)(width >> 8),
+		(unsigned char)(height & 0xFF), (unsigned char)(height >> 8), first.screenFlags, first.backgroundIndex, first.aspectRatio };
+	if (!out.write(screen, sizeof(screen)) || !out.copy(13, first.headerSize - 13)) {
+		response.error = -2;
+		return response;
+	}
+
+	// an input needs the screen cleared before it unless its first frame covers all of it
+	std::vector<bool> needsClear(inputs.size(), false);
+	for (size_t n = 1; n < inputs.size(); ++n) {
+		const GIFIndex& index = indexes[n];
+		needsClear[n] = !index.frames.empty() && !(index.width == width && index.height == height && isGIFFrameIndependent(index, index.frames[0]));
+	}
+	std::unique_ptr<GIFEncoder> encoder;
+	std::vector<unsigned char> bytes;
+	std::vector<unsigned char> clearIndices; // the clearing frames are the same apart from the delay, so these are reused
+	std::vector<unsigned char> clearEncoded;
+	int clearDelay = 0;
+
+	for (size_t n = 0; n < inputs.size(); ++n) {
+		const GIFIndex& index = indexes[n];
+		if (!out.flush()) {
+			response.error = -2;
+			return response;
+		}
+		out.input = inputs[n];
+		if (needsClear[n]) {
+			if (!encoder) encoder.reset(new GIFEncoder());
+			GIFPalette palette;
+			memset(&palette, 0, sizeof(palette));
+			palette.bitsPerPixel = 1;
+			palette.transparentIndex = 0;
+			GIFFrameParams params;
+			params.left = 0;
+			params.top = 0;
+			params.width = width;
+			params.height = height;
+			params.delay = clearDelay;
+			params.disposal = 2;
+			params.transparentIndex = 0;
+			params.localPalette = &palette;
+			params.globalBitsPerPixel = first.globalColorTableBits;
+			clearIndices.resize((size_t)width * height, 0);
+			clearEncoded.clear();
+			writeGIFFrame(*encoder, clearEncoded, params, clearIndices.data());
+			if (!out.write(clearEncoded.data(), clearEncoded.size())) {
+				response.error = -2;
+				return response;
+			}
+		}
+
+		const int dx = (width - index.width) / 2;
+		const int dy = (height - index.height) / 2;
+		const bool paletteDiffers = index.globalColorTableBits && (index.globalColorTableBits != first.globalColorTableBits
+			|| memcmp(index.globalColorTable, first.globalColorTable, (size_t)(1 << index.globalColorTableBits) * 3) != 0);
+		const bool clearAfter = n + 1 < inputs.size() && needsClear[n + 1];
+		const int frameCount = (int)index.frames.size();
+		for (int i = 0; i < frameCount; ++i) {
+			const GIFFrameInfo& frame = index.frames[i];
+			int delay = frame.delay;
+			if (clearAfter && i == frameCount - 1) {
+				// the clearing frame takes the end of this frame's delay. Browsers show delays below 2 as 10, so it gets at least 2
+				delay = frame.delay >= 4 ? frame.delay - 2 : frame.delay;
+				clearDelay = frame.delay - delay;
+			}
+			bool ok = n == 0 ? copyGIFExtensions(out, index, i, frame.start) : copyGIFExtensionsExceptLoop(out, index, i, frame.start);
+			if (ok) {
+				if (dx || dy || paletteDiffers || delay != frame.delay) {
+					ok = copyGIFFrameMoved(out, frame, delay, dx, dy,
+						paletteDiffers ? index.globalColorTable : NULL, index.globalColorTableBits, bytes);
+				}
+				else {
+					ok = out.copy(frame.start, frame.end - frame.start);
+				}
+			}
+			if (!ok) {
+				response.error = -2;
+				return response;
+			}
+			++response.framesOut;
+		}
+		if (!(n == 0 ? copyGIFExtensions(out, index, frameCount, LLONG_MAX) : copyGIFExtensionsExceptLoop(out, index, frameCount, LLONG_MAX))) {
+			response.error = -2;
+			return response;
+		}
+	}
+
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
+
+/**
+* Function writes a GIF's frames in reverse order, or forward and then backward (ping-pong) so that it loops smoothly.
+* In ping-pong the first and the last frames aren't repeated at the turning points. Each frame keeps its delay.
+* Frames get copied as stored where possible, see writeGIFFrameSequence. Frames that replace the whole screen,
+* and frames with transparency that are drawn on a cleared screen (like the ones frames_to_gif writes) always are.
+* The looping extension is kept, comments and other extension blocks are not.
+* @param input GIF file to read
+* @param output File to write the reordered GIF into
+* @param pingPong false to only play the frames backward
+*/
+struct GIFEdit_response reverseGIF(FILE* input, FILE* output, bool pingPong)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	const int frameCount = (int)index.frames.size();
+	response.framesIn = frameCount;
+	response.bytesIn = index.trailerOffset + 1;
+	GIFBlockCopier out(input, output);
+	if (!writeGIFHeaderFrom(out, index)) {
+		response.error = -2;
+		return response;
+	}
+	for (const GIFExtensionInfo& extension : index.extensions) {
+		if (extension.frameIndex == 0 && extension.label == 0xFF && !out.copy(extension.offset, extension.size)) {
+			response.error = -2;
+			return response;
+		}
+	}
+
+	std::vector<GIFSequenceEntry> sequence;
+	if (pingPong) {
+		for (int i = 0; i < frameCount; ++i) {
+			sequence.push_back({ i, index.frames[i].delay, false, i + 1 });
+		}
+		for (int i = frameCount - 2; i > 0; --i) {
+			sequence.push_back({ i, index.frames[i].delay, false, i + 1 });
+		}
+	}
+	else {
+		for (int i = frameCount - 1; i >= 0; --i) {
+			sequence.push_back({ i, index.frames[i].delay, false, i + 1 });
+		}
+	}
+	response.error = writeGIFFrameSequence(out, index, sequence, response.framesOut);
+	if (response.error != 0) {
+		return response;
+	}
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
+
+/**
+* Function writes a GIF without its comments, plain text and application extensions (like XMP or ICC profiles),
+* except the looping extension. Everything else, including Graphic Control Extensions, is copied as stored
+* in as few copies as possible, one per run of bytes between removed blocks.
+* @param input GIF file to read
+* @param output File to write the stripped GIF into
+*/
+struct GIFEdit_response stripGIF(FILE* input, FILE* output)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	response.framesIn = index.frames.size();
+	response.framesOut = index.frames.size();
+	response.bytesIn = index.trailerOffset + 1;
+	GIFBlockCopier out(input, output);
+	long long position = 0;
+	for (const GIFExtensionInfo& extension : index.extensions) {
+		if (isGIFLoopExtension(input, extension)) continue;
+		if (!out.copy(position, extension.offset - position)) {
+			response.error = -2;
+			return response;
+		}
+		position = extension.offset + extension.size;
+		++response.extensionsRemoved;
+	}
+	if (!out.copy(position, index.trailerOffset - position)) {
+		response.error = -2;
+		return response;
+	}
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
+
+struct GIFColorTableGroup {
+	unsigned long long hash;
+	int bits;
+	std::vector<unsigned char> colors;
+	size_t frameCount;
+};
+
+// Checks if every color of a smaller or same size table is at the same index in a bigger one,
+// so frames using it can use the bigger one without changing their image data.
+static bool isGIFColorTablePrefix(const GIFColorTableGroup& table, const GIFColorTableGroup& of) {
+	return table.bits <= of.bits && memcmp(table.colors.data(), of.colors.data(), table.colors.size()) == 0;
+}
+
+/**
+* Function finds the local color table that most frames have and makes it the Global Color Map,
+* removing it from those frames. Frames whose local color table is the start of that table lose theirs too,
+* since their indices mean the same colors in it. Their image data is copied as stored.
+* Frames that used the old Global Color Map get it as their local color table, if it's different.
+* Frames with other local color tables are copied as stored. If no table would save any bytes, the GIF is copied as is.
+* @param input GIF file to read
+* @param output File to write the GIF into
+*/
+struct GIFEdit_response unifyGIFPalette(FILE* input, FILE* output)
+{
+	struct GIFEdit_response response;
+	memset(&response, 0, sizeof(response));
+	GIFIndex index;
+	if (buildGIFIndex(input, index) != 0) {
+		response.error = -1;
+		return response;
+	}
+	const int frameCount = (int)index.frames.size();
+	response.framesIn = frameCount;
+	response.framesOut = frameCount;
+	response.bytesIn = index.trailerOffset + 1;
+
+	// group identical local color tables
+	std::vector<GIFColorTableGroup> groups;
+	std::vector<int> frameGroup(frameCount, -1);
+	std::unordered_map<unsigned long long, std::vector<int>> groupsByHash;
+	std::vector<unsigned char> bytes;
+	int framesUsingGlobal = 0;
+	for (int i = 0; i < frameCount; ++i) {
+		const GIFFrameInfo& frame = index.frames[i];
+		if (!frame.localColorTableBits) {
+			++framesUsingGlobal;
+			continue;
+		}
+		if (!readGIFBytes(input, frame.descriptorOffset + 10, (long long)(1 << frame.localColorTableBits) * 3, bytes)) {
+			response.error = -2;
+			return response;
+		}
+		unsigned long long hash = hashGIFBytes(bytes.data(), bytes.size());
+		std::vector<int>& candidates = groupsByHash[hash];
+		for (int candidate : candidates) {
+			if (groups[candidate].colors == bytes) {
+				frameGroup[i] = candidate;
+				break;
+			}
+		}
+		if (frameGroup[i] == -1) {
+			frameGroup[i] = (int)groups.size();
+			candidates.push_back(frameGroup[i]);
+			groups.push_back({ hash, frame.localColorTableBits, bytes, 0 });
+		}
+		++groups[frameGroup[i]].frameCount;
+	}
+
+	// pick the table that saves the most bytes
+	const long long globalSize = index.globalColorTableBits ? (3LL << index.globalColorTableBits) : 0;
+	int best = -1;
+	long long bestSaving = 0;
+	for (size_t g = 0; g < groups.size(); ++g) {
+		const GIFColorTableGroup& table = groups[g];
+		long long saving = globalSize - (long long)table.colors.size();
+		for (const GIFColorTableGroup& other : groups) {
+			if (isGIFColorTablePrefix(other, table)) {
+				saving += (long long)other.colors.size() * other.frameCount;
+			}
+		}
+		const bool sameAsGlobal = index.globalColorTableBits == table.bits
+			&& memcmp(index.globalColorTable, table.colors.data(), table.colors.size()) == 0;
+		if (globalSize && !sameAsGlobal) {
+			saving -= globalSize * framesUsingGlobal;
+		}
+		if (saving > bestSaving) {
+			best = (int)g;
+			bestSaving = saving;
+		}
+	}
+
+	GIFBlockCopier out(input, output);
+	if (best == -1) {
+		if (!out.copy(0, index.trailerOffset)) {
+			response.error = -2;
+			return response;
+		}
+		response.bytesOut = out.finish();
+		if (response.bytesOut == -1) {
+			response.error = -2;
+		}
+		return response;
+	}
+	const GIFColorTableGroup& table = groups[best];
+	const bool globalChanges = !(index.globalColorTableBits == table.bits
+		&& memcmp(index.globalColorTable, table.colors.data(), table.colors.size()) == 0);
+
+	unsigned char screen[13];
+	if (!readGIFBytes(input, 0, 13, bytes)) {
+		response.error = -2;
+		return response;
+	}
+	memcpy(screen, bytes.data(), 13);
+	screen[10] = (unsigned char)((screen[10] & 0x70) | 0x80 | (table.bits - 1)); // keep the color resolution, drop the sort flag
+	if (!out.write(screen, sizeof(screen)) || !out.write(table.colors.data(), table.colors.size())) {
+		response.error = -2;
+		return response;
+	}
+	long long position = index.headerSize;
+	for (int i = 0; i < frameCount; ++i) {
+		const GIFFrameInfo& frame = index.frames[i];
+		bool ok = true;
+		if (frameGroup[i] != -1 && isGIFColorTablePrefix(groups[frameGroup[i]], table)) {
+			// drop the local color table, everything else stays
+			ok = out.copy(position, frame.descriptorOffset + 9 - position) && readGIFBytes(input, frame.descriptorOffset + 9, 1, bytes);
+			if (ok) {
+				unsigned char flags = (unsigned char)(bytes[0] & 0x40); // keep the interlace flag
+				ok = out.write(&flags, 1);
+			}
+			position = frame.dataOffset;
+			++response.colorTablesRemoved;
+		}
+		else if (frameGroup[i] == -1 && globalChanges && index.globalColorTableBits) {
+			// the frame used the old Global Color Map, give it a copy of it
+			ok = out.copy(position, frame.start - position)
+				&& copyGIFFrameMoved(out, frame, frame.delay, 0, 0, index.globalColorTable, index.globalColorTableBits, bytes);
+			position = frame.end;
+		}
+		if (!ok) {
+			response.error = -2;
+			return response;
+		}
+	}
+	if (!out.copy(position, index.trailerOffset - position)) {
+		response.error = -2;
+		return response;
+	}
+	response.bytesOut = out.finish();
+	if (response.bytesOut == -1) {
+		response.error = -2;
+	}
+	return response;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+#include "GIF_parse.h"
+#include "GIF_resize.h"
+
+struct GIFEdit_response {
+	int error; // 0 if no error. -1 - invalid format. -2 - read or write error. -3 - frame range outside of the GIF
+	size_t framesIn;
+	size_t framesOut;
+	long long bytesIn;
+	long long bytesOut;
+	size_t extensionsRemoved;
+	size_t colorTablesRemoved;
+	size_t framesRecompressed;
+	size_t framesShrunk; // -optimize: frames rewritten smaller, the others are copied as stored
+};
+
+// One size resizeGIF writes
+struct GIFResizeOutput {
+	int width;
+	int height;
+	FILE* file;
+	long long bytesOut; // filled in by resizeGIF
+};
+
+struct GIFEdit_response optimizeGIF(FILE* input, FILE* output);
+
+struct GIFEdit_response resizeGIF(FILE* input, std::vector<GIFResizeOutput>& outputs, GIFResizeFilter filter, int threadCount);
+
+struct GIFEdit_response recompressGIF(FILE* input, FILE* output, int threadCount, int lossyBudget);
+
+struct GIFEdit_response dedupGIF(FILE* input, FILE* output);
+
+struct GIFEdit_response decimateGIF(FILE* input, FILE* output, int keepEvery, int fps);
+
+struct GIFEdit_response trimGIF(FILE* input, FILE* output, int start, int end);
+
+struct GIFEdit_response concatGIFs(const std::vector<FILE*>& inputs, FILE* output);
+
+struct GIFEdit_response reverseGIF(FILE* input, FILE* output, bool pingPong);
+
+struct GIFEdit_response stripGIF(FILE* input, FILE* output);
+
+struct GIFEdit_response unifyGIFPalette(FILE* input, FILE* output);
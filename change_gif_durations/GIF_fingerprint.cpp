@@ -0,0 +1,679 @@
+#include "GIF_fingerprint.h"
+#include "GIF_parse.h"
+#include "GIF_decode.h"
+#include "GIF_resize.h"
+#include "GIF_tree.h"
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+#include <tuple>
+#ifndef FOR_LINUX
+#include <Windows.h>
+#endif
+#include "ToolStats.h"
+#include "ToolTrace.h"
+
+#define GIF_FINGERPRINT_INDEX_HEADER "GIFTools fingerprint index 1"
+#define GIF_FINGERPRINT_THUMBNAIL 32 // width and height of the grayscale thumbnail the frequencies are taken from
+#define GIF_FINGERPRINT_FREQUENCIES 8 // the lowest 8x8 frequencies give the 64 bits
+#define GIF_FINGERPRINT_CHUNKS (GIF_FINGERPRINT_FRAMES * 4) // 16-bit pieces the lookup tables are keyed by
+#define GIF_FINGERPRINT_PI 3.14159265358979323846
+
+typedef std::tuple<unsigned long long, unsigned long long, long long, long long> GIFFingerprintKey; // device, inode, size, modified
+
+static GIFFingerprintKey getGIFFingerprintKey(const GIFFingerprintEntry& entry) {
+	return GIFFingerprintKey(entry.device, entry.inode, entry.size, entry.modified);
+}
+
+// Buffers one thread keeps between the GIFs it fingerprints
+struct GIFFingerprintWorker {
+	GIFDecodedFrame decoded;
+	GIFCanvas canvas;
+	GIFResizeAxis xAxis; // made for a screen of axisWidth x axisHeight, 0 x 0 if not made yet
+	GIFResizeAxis yAxis;
+	int axisWidth;
+	int axisHeight;
+	std::vector<float> scratch;
+	unsigned int thumbnail[GIF_FINGERPRINT_THUMBNAIL * GIF_FINGERPRINT_THUMBNAIL];
+
+	GIFFingerprintWorker() : axisWidth(0), axisHeight(0) { }
+};
+
+// Cosines of the DCT-II, only for the frequencies that make it into the hash
+struct GIFFingerprintCosines {
+	float values[GIF_FINGERPRINT_FREQUENCIES][GIF_FINGERPRINT_THUMBNAIL];
+
+	GIFFingerprintCosines() {
+		for (int u = 0; u < GIF_FINGERPRINT_FREQUENCIES; ++u) {
+			for (int x = 0; x < GIF_FINGERPRINT_THUMBNAIL; ++x) {
+				values[u][x] = (float)cos((2 * x + 1) * u * GIF_FINGERPRINT_PI / (2 * GIF_FINGERPRINT_THUMBNAIL));
+			}
+		}
+	}
+};
+
+static int countGIFFingerprintBits(unsigned long long x) {
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+// Returns how many bits of the two fingerprints differ
+int countGIFFingerprintDistance(const GIFFingerprint& a, const GIFFingerprint& b) {
+	int distance = 0;
+	for (int i = 0; i < GIF_FINGERPRINT_FRAMES; ++i) {
+		distance += countGIFFingerprintBits(a.bits[i] ^ b.bits[i]);
+	}
+	return distance;
+}
+
+/**
+* Function hashes a thumbnail: its lowest 8x8 DCT frequencies of the brightness, 1 bits for those above their median.
+* Transparent pixels count as black.
+*/
+static unsigned long long hashGIFThumbnail(const unsigned int* thumbnail) {
+	static const GIFFingerprintCosines cosines;
+	float luma[GIF_FINGERPRINT_THUMBNAIL][GIF_FINGERPRINT_THUMBNAIL];
+	for (int i = 0; i < GIF_FINGERPRINT_THUMBNAIL * GIF_FINGERPRINT_THUMBNAIL; ++i) {
+		const unsigned int pixel = thumbnail[i];
+		luma[i / GIF_FINGERPRINT_THUMBNAIL][i % GIF_FINGERPRINT_THUMBNAIL]
+			= 0.299F * (pixel & 0xFF) + 0.587F * ((pixel >> 8) & 0xFF) + 0.114F * ((pixel >> 16) & 0xFF);
+	}
+	// rows first, then columns, only for the frequencies that are kept
+	float rows[GIF_FINGERPRINT_THUMBNAIL][GIF_FINGERPRINT_FREQUENCIES];
+	for (int y = 0; y < GIF_FINGERPRINT_THUMBNAIL; ++y) {
+		for (int u = 0; u < GIF_FINGERPRINT_FREQUENCIES; ++u) {
+			float sum = 0.F;
+			for (int x = 0; x < GIF_FINGERPRINT_THUMBNAIL; ++x) {
+				sum += luma[y][x] * cosines.values[u][x];
+			}
+			rows[y][u] = sum;
+		}
+	}
+	float frequencies[GIF_FINGERPRINT_FREQUENCIES * GIF_FINGERPRINT_FREQUENCIES];
+	for (int v = 0; v < GIF_FINGERPRINT_FREQUENCIES; ++v) {
+		for (int u = 0; u < GIF_FINGERPRINT_FREQUENCIES; ++u) {
+			float sum = 0.F;
+			for (int y = 0; y < GIF_FINGERPRINT_THUMBNAIL; ++y) {
+				sum += rows[y][u] * cosines.values[v][y];
+			}
+			frequencies[v * GIF_FINGERPRINT_FREQUENCIES + u] = sum;
+		}
+	}
+	float sorted[GIF_FINGERPRINT_FREQUENCIES * GIF_FINGERPRINT_FREQUENCIES];
+	memcpy(sorted, frequencies, sizeof(sorted));
+	const int middle = GIF_FINGERPRINT_FREQUENCIES * GIF_FINGERPRINT_FREQUENCIES / 2;
+	std::nth_element(sorted, sorted + middle, sorted + GIF_FINGERPRINT_FREQUENCIES * GIF_FINGERPRINT_FREQUENCIES);
+	const float median = sorted[middle];
+	unsigned long long bits = 0;
+	for (int i = 0; i < GIF_FINGERPRINT_FREQUENCIES * GIF_FINGERPRINT_FREQUENCIES; ++i) {
+		if (frequencies[i] > median) bits |= 1ULL << i;
+	}
+	return bits;
+}
+
+/**
+* Function picks the frames to fingerprint: the ones showing at evenly spaced moments of the animation,
+* so that GIFs with frames dropped or merged pick the same moments. By frame number if there are no delays.
+*/
+static void pickGIFFingerprintFrames(const GIFIndex& index, int frames[GIF_FINGERPRINT_FRAMES]) {
+	const int count = (int)index.frames.size();
+	long long total = 0;
+	for (const GIFFrameInfo& frame : index.frames) {
+		total += frame.delay;
+	}
+	int frame = 0;
+	long long frameEnd = count ? index.frames[0].delay : 0;
+	for (int i = 0; i < GIF_FINGERPRINT_FRAMES; ++i) {
+		if (total == 0) {
+			frames[i] = (int)((long long)count * (2 * i + 1) / (2 * GIF_FINGERPRINT_FRAMES));
+			continue;
+		}
+		const long long moment = total * (2 * i + 1) / (2 * GIF_FINGERPRINT_FRAMES);
+		while (frameEnd <= moment && frame < count - 1) {
+			frameEnd += index.frames[++frame].delay;
+		}
+		frames[i] = frame;
+	}
+}
+
+// A frame from which the screen can be put together without the frames before it
+static bool isGIFFingerprintStart(const GIFIndex& index, const GIFFrameInfo& frame, bool last) {
+	return frame.left == 0 && frame.top == 0 && frame.width >= index.width && frame.height >= index.height
+		&& frame.transparentIndex == -1 && (last || frame.disposal != 3);
+}
+
+/**
+* Function fingerprints a GIF with the worker's buffers. Each sampled frame is put together the way a viewer shows it,
+* starting from the last frame before it that covers the whole screen, so GIFs that aren't delta-encoded only have
+* their sampled frames decoded. Then it's shrunk to a 32x32 thumbnail with the box filter -resize uses.
+* Returns error code. 0 for no error, -1 if it isn't a valid GIF.
+*/
+static int fingerprintGIFWith(GIFFingerprintWorker& worker, FILE* file, GIFFingerprint& fingerprint) {
+	GIFIndex index;
+	if (buildGIFIndex(file, index) != 0 || index.frames.empty() || index.width == 0 || index.height == 0) {
+		return -1;
+	}
+	if (worker.axisWidth != index.width || worker.axisHeight != index.height) {
+		buildGIFResizeAxis(index.width, GIF_FINGERPRINT_THUMBNAIL, GIF_RESIZE_BOX, worker.xAxis);
+		buildGIFResizeAxis(index.height, GIF_FINGERPRINT_THUMBNAIL, GIF_RESIZE_BOX, worker.yAxis);
+		worker.axisWidth = index.width;
+		worker.axisHeight = index.height;
+	}
+	int frames[GIF_FINGERPRINT_FRAMES];
+	pickGIFFingerprintFrames(index, frames);
+	int drawn = -1; // the last frame on the canvas
+	for (int i = 0; i < GIF_FINGERPRINT_FRAMES; ++i) {
+		const int target = frames[i];
+		if (target != drawn) {
+			int start = target;
+			while (start > drawn + 1 && !isGIFFingerprintStart(index, index.frames[start], start == target)) {
+				--start;
+			}
+			if (drawn == -1 || start > drawn + 1) {
+				worker.canvas.reset(index.width, index.height);
+			}
+			for (int f = start; f <= target; ++f) {
+				if (decodeGIFFrame(file, index, index.frames[f], worker.decoded) != 0) {
+					return -1;
+				}
+				worker.canvas.drawFrame(index.frames[f], worker.decoded);
+			}
+			drawn = target;
+		}
+		resizeGIFCanvas(worker.canvas.pixels.data(), index.width, index.height, worker.xAxis, worker.yAxis,
+			worker.thumbnail, GIF_FINGERPRINT_THUMBNAIL, GIF_FINGERPRINT_THUMBNAIL, worker.scratch);
+		fingerprint.bits[i] = hashGIFThumbnail(worker.thumbnail);
+	}
+	return 0;
+}
+
+/**
+* Function works out the perceptual fingerprint of a GIF.
+* Returns error code. 0 for no error, -1 if it isn't a valid GIF.
+*/
+int fingerprintGIF(FILE* file, GIFFingerprint& fingerprint) {
+	std::unique_ptr<GIFFingerprintWorker> worker(new GIFFingerprintWorker());
+	return fingerprintGIFWith(*worker, file, fingerprint);
+}
+
+// Paths are stored as UTF-8 in the index file
+static std::string toGIFFingerprintIndexText(const CrossPlatformString& path) {
+#ifndef FOR_LINUX
+	const int length = WideCharToMultiByte(CP_UTF8, 0, path.c_str(), (int)path.size(), NULL, 0, NULL, NULL);
+	std::string text((size_t)length, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, path.c_str(), (int)path.size(), &text[0], length, NULL, NULL);
+	return text;
+#else
+	return path;
+#endif
+}
+
+static CrossPlatformString fromGIFFingerprintIndexText(const char* text) {
+#ifndef FOR_LINUX
+	const int length = MultiByteToWideChar(CP_UTF8, 0, text, -1, NULL, 0);
+	std::wstring path((size_t)(length > 0 ? length - 1 : 0), L'\0');
+	if (length > 1) MultiByteToWideChar(CP_UTF8, 0, text, -1, &path[0], length);
+	return path;
+#else
+	return text;
+#endif
+}
+
+static FILE* openGIFFingerprintIndex(const CrossPlatformString& path, bool write) {
+	FILE* file = NULL;
+#ifndef FOR_LINUX
+	if (_wfopen_s(&file, path.c_str(), write ? L"wb" : L"rb")) file = NULL;
+#else
+	file = fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+	return file;
+}
+
+// Reads a line of any length, without the line break. Returns false at the end of the file.
+static bool readGIFFingerprintLine(FILE* file, std::string& line) {
+	line.clear();
+	char chunk[512];
+	while (fgets(chunk, sizeof(chunk), file)) {
+		line += chunk;
+		if (!line.empty() && line.back() == '\n') {
+			line.pop_back();
+			return true;
+		}
+	}
+	return !line.empty();
+}
+
+/**
+* Function reads a fingerprint index. Stops at the first line it doesn't understand.
+* Returns false if the file can't be opened or isn't a fingerprint index.
+*/
+static bool loadGIFFingerprintIndex(const CrossPlatformString& path, std::vector<GIFFingerprintEntry>& entries) {
+	FILE* file = openGIFFingerprintIndex(path, false);
+	if (!file) {
+		return false;
+	}
+	std::string line;
+	const bool valid = readGIFFingerprintLine(file, line) && line == GIF_FINGERPRINT_INDEX_HEADER;
+	while (valid && readGIFFingerprintLine(file, line)) {
+		GIFFingerprintEntry entry;
+		int consumed = 0;
+		if (sscanf(line.c_str(), "%llu %llu %lld %lld %d%n", &entry.device, &entry.inode, &entry.size, &entry.modified,
+				&entry.error, &consumed) != 5) {
+			break;
+		}
+		int i = 0;
+		for (; i < GIF_FINGERPRINT_FRAMES; ++i) {
+			int more = 0;
+			if (sscanf(line.c_str() + consumed, " %llx%n", &entry.fingerprint.bits[i], &more) != 1) break;
+			consumed += more;
+		}
+		if (i != GIF_FINGERPRINT_FRAMES || line[consumed] != '\t') {
+			break;
+		}
+		entry.path = fromGIFFingerprintIndexText(line.c_str() + consumed + 1);
+		entries.push_back(std::move(entry));
+	}
+	fclose(file);
+	return valid;
+}
+
+// Writes the index, one line per GIF. Returns false on failure.
+static bool saveGIFFingerprintIndex(const CrossPlatformString& path, const std::vector<GIFFingerprintEntry>& entries) {
+	FILE* file = openGIFFingerprintIndex(path, true);
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "%s\n", GIF_FINGERPRINT_INDEX_HEADER);
+	for (const GIFFingerprintEntry& entry : entries) {
+		const std::string text = toGIFFingerprintIndexText(entry.path);
+		if (entry.error == -2 || text.find('\n') != std::string::npos) continue; // no identity to key it by, or can't be stored on a line
+		fprintf(file, "%llu %llu %lld %lld %d", entry.device, entry.inode, entry.size, entry.modified, entry.error);
+		for (int i = 0; i < GIF_FINGERPRINT_FRAMES; ++i) {
+			fprintf(file, " %016llx", entry.fingerprint.bits[i]);
+		}
+		fprintf(file, "\t%s\n", text.c_str());
+	}
+	const bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+/**
+* Multi-index hashing over the fingerprints of an index. Each fingerprint is cut into 16 pieces of 16 bits, and each
+* piece has a table from its 65536 values to the entries that have it. If two fingerprints are within distance
+* 16 * s + a of each other, then one of their first a + 1 pieces is within s of each other, or one of the other pieces
+* is within s - 1: otherwise the distance would add up to more. So a lookup only checks the entries found under the
+* values that close to its own pieces, instead of every entry.
+*/
+struct GIFFingerprintLookup {
+	std::vector<GIFFingerprint> fingerprints; // of all the entries, packed together for checking candidates
+	std::vector<unsigned int> starts[GIF_FINGERPRINT_CHUNKS]; // for each piece value, where its entries begin in ids. 65537 long
+	std::vector<unsigned int> ids[GIF_FINGERPRINT_CHUNKS];
+
+	void build(const std::vector<GIFFingerprintEntry>& entries);
+};
+
+// What one thread keeps between its lookups
+struct GIFFingerprintQuery {
+	std::vector<unsigned int> seen; // the lookup that last checked each entry, so that it's checked once per lookup
+	std::vector<unsigned int> candidates;
+	unsigned int lookups;
+
+	GIFFingerprintQuery() : lookups(0) { }
+	void find(const GIFFingerprintLookup& lookup, const GIFFingerprint& fingerprint, int maxDistance,
+		std::vector<std::pair<int, unsigned int>>& found);
+	void collect(const GIFFingerprintLookup& lookup, int chunk, unsigned int value, int fromBit, int flipsLeft);
+};
+
+static unsigned int getGIFFingerprintChunk(const GIFFingerprint& fingerprint, int chunk) {
+	return (unsigned int)(fingerprint.bits[chunk >> 2] >> ((chunk & 3) * 16)) & 0xFFFF;
+}
+
+// Fills the tables with the entries that have no error, counting sort style
+void GIFFingerprintLookup::build(const std::vector<GIFFingerprintEntry>& entries) {
+	fingerprints.resize(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		fingerprints[i] = entries[i].fingerprint;
+	}
+	for (int chunk = 0; chunk < GIF_FINGERPRINT_CHUNKS; ++chunk) {
+		std::vector<unsigned int>& chunkStarts = starts[chunk];
+		chunkStarts.assign(65537, 0);
+		for (const GIFFingerprintEntry& entry : entries) {
+			if (entry.error == 0) ++chunkStarts[getGIFFingerprintChunk(entry.fingerprint, chunk) + 1];
+		}
+		for (size_t value = 1; value < chunkStarts.size(); ++value) {
+			chunkStarts[value] += chunkStarts[value - 1];
+		}
+		ids[chunk].resize(chunkStarts[65536]);
+		std::vector<unsigned int> next(chunkStarts.begin(), chunkStarts.end() - 1);
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (entries[i].error == 0) ids[chunk][next[getGIFFingerprintChunk(entries[i].fingerprint, chunk)]++] = (unsigned int)i;
+		}
+	}
+}
+
+// Adds the entries under value and under every value that differs from it in up to flipsLeft bits from fromBit on
+void GIFFingerprintQuery::collect(const GIFFingerprintLookup& lookup, int chunk, unsigned int value, int fromBit, int flipsLeft) {
+	const std::vector<unsigned int>& ids = lookup.ids[chunk];
+	for (unsigned int i = lookup.starts[chunk][value]; i < lookup.starts[chunk][value + 1]; ++i) {
+		const unsigned int id = ids[i];
+		if (seen[id] != lookups) {
+			seen[id] = lookups;
+			candidates.push_back(id);
+		}
+	}
+	if (flipsLeft == 0) {
+		return;
+	}
+	for (int bit = fromBit; bit < 16; ++bit) {
+		collect(lookup, chunk, value ^ (1U << bit), bit + 1, flipsLeft - 1);
+	}
+}
+
+/**
+* Function finds the entries within maxDistance of a fingerprint.
+* @param found Gets the distance and entry number of each, sorted by distance
+*/
+void GIFFingerprintQuery::find(const GIFFingerprintLookup& lookup, const GIFFingerprint& fingerprint, int maxDistance,
+	std::vector<std::pair<int, unsigned int>>& found)
+{
+	found.clear();
+	candidates.clear();
+	if (seen.size() != lookup.fingerprints.size()) {
+		seen.assign(lookup.fingerprints.size(), 0);
+		lookups = 0;
+	}
+	if (++lookups == 0) {
+		// wrapped around, entries seen 2^32 lookups ago would look seen
+		std::fill(seen.begin(), seen.end(), 0);
+		lookups = 1;
+	}
+	const int radius = maxDistance / GIF_FINGERPRINT_CHUNKS;
+	const int widerChunks = maxDistance % GIF_FINGERPRINT_CHUNKS + 1;
+	for (int chunk = 0; chunk < GIF_FINGERPRINT_CHUNKS; ++chunk) {
+		const int chunkRadius = chunk < widerChunks ? radius : radius - 1;
+		if (chunkRadius >= 0) {
+			collect(lookup, chunk, getGIFFingerprintChunk(fingerprint, chunk), 0, chunkRadius);
+		}
+	}
+	for (unsigned int id : candidates) {
+		const int distance = countGIFFingerprintDistance(fingerprint, lookup.fingerprints[id]);
+		if (distance <= maxDistance) {
+			found.push_back(std::make_pair(distance, id));
+		}
+	}
+	std::sort(found.begin(), found.end());
+}
+
+/**
+* Function fingerprints one file of the tree, or takes its fingerprint from the old index if the file didn't change.
+* Returns true if it was taken from the old index.
+*/
+static bool fingerprintGIFTreeFile(GIFFingerprintWorker& worker, GIFFingerprintEntry& entry,
+	const std::map<GIFFingerprintKey, const GIFFingerprintEntry*>& previous)
+{
+	ToolTraceSpan span("fingerprint", "file", entry.path.c_str());
+	memset(&entry.fingerprint, 0, sizeof(entry.fingerprint));
+	entry.error = 0;
+	FILE* handle = openGIFTreeFile(entry.path);
+	if (!handle) {
+		entry.error = -2;
+		return false;
+	}
+	countToolStats(toolStats.files);
+	if (!getGIFFileIdentity(handle, entry.device, entry.inode, entry.size, entry.modified)) {
+		fclose(handle);
+		entry.error = -2;
+		return false;
+	}
+	auto found = previous.find(getGIFFingerprintKey(entry));
+	if (found != previous.end()) {
+		fclose(handle);
+		entry.error = found->second->error;
+		entry.fingerprint = found->second->fingerprint;
+		return true;
+	}
+	entry.error = fingerprintGIFWith(worker, handle, entry.fingerprint);
+	fclose(handle);
+	return false;
+}
+
+static void runGIFFingerprintWorker(std::vector<GIFFingerprintEntry>* entries, const std::map<GIFFingerprintKey, const GIFFingerprintEntry*>* previous,
+	std::atomic<size_t>* nextEntry, std::atomic<size_t>* reused)
+{
+	std::unique_ptr<GIFFingerprintWorker> worker(new GIFFingerprintWorker());
+	while (true) {
+		const size_t i = nextEntry->fetch_add(1);
+		if (i >= entries->size()) {
+			return;
+		}
+		if (fingerprintGIFTreeFile(*worker, (*entries)[i], *previous)) {
+			reused->fetch_add(1);
+		}
+	}
+}
+
+/**
+* Function fingerprints all GIF files under a directory, including subdirectories, on several threads, and writes
+* the fingerprints into an index file for -similar and -groups. If the index file already exists, files whose device,
+* inode, size and modification time are in it are not read again.
+* Returns error code. 0 for no error, -1 if the directory can't be read, -2 if the index can't be written.
+* @param root The directory to look in
+* @param indexPath The index file to update
+* @param threadCount How many files get fingerprinted at once
+*/
+int fingerprintGIFTree(const CrossPlatformString& root, const CrossPlatformString& indexPath, int threadCount)
+{
+	std::vector<GIFFingerprintEntry> previousEntries;
+	loadGIFFingerprintIndex(indexPath, previousEntries);
+	std::map<GIFFingerprintKey, const GIFFingerprintEntry*> previous;
+	for (const GIFFingerprintEntry& entry : previousEntries) {
+		previous[getGIFFingerprintKey(entry)] = &entry;
+	}
+
+	std::vector<CrossPlatformString> directories;
+	std::vector<CrossPlatformString> gifs;
+	if (!listGIFTreeDirectory(root, directories, gifs)) {
+		return -1;
+	}
+	size_t unreadableDirectories = 0;
+	while (!directories.empty()) {
+		CrossPlatformString directory = std::move(directories.back());
+		directories.pop_back();
+		if (!listGIFTreeDirectory(directory, directories, gifs)) {
+			++unreadableDirectories;
+			CrossPlatformCerr << CrossPlatformText("Failed to read directory ") << directory.c_str() << std::endl;
+		}
+	}
+	std::sort(gifs.begin(), gifs.end());
+	std::vector<GIFFingerprintEntry> entries(gifs.size());
+	for (size_t i = 0; i < gifs.size(); ++i) {
+		entries[i].path = std::move(gifs[i]);
+	}
+
+	std::atomic<size_t> nextEntry(0);
+	std::atomic<size_t> reused(0);
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threadCount && (size_t)i < entries.size(); ++i) {
+		threads.emplace_back([&entries, &previous, &nextEntry, &reused]() {
+			setToolTraceThreadName("fingerprint worker");
+			runGIFFingerprintWorker(&entries, &previous, &nextEntry, &reused);
+		});
+	}
+	runGIFFingerprintWorker(&entries, &previous, &nextEntry, &reused);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	size_t invalid = 0;
+	size_t unreadable = 0;
+	for (const GIFFingerprintEntry& entry : entries) {
+		if (entry.error == -1) ++invalid;
+		if (entry.error == -2) ++unreadable;
+	}
+	if (!saveGIFFingerprintIndex(indexPath, entries)) {
+		return -2;
+	}
+	CrossPlatformCout << CrossPlatformText("Fingerprinted ") << entries.size() << CrossPlatformText(" GIFs: ")
+		<< entries.size() - reused.load() - unreadable << CrossPlatformText(" read, ") << reused.load() << CrossPlatformText(" unchanged since the last run, ")
+		<< invalid << CrossPlatformText(" invalid, ") << unreadable << CrossPlatformText(" unreadable, ")
+		<< unreadableDirectories << CrossPlatformText(" unreadable directories.\n");
+	return 0;
+}
+
+static void printGIFFingerprintPath(const CrossPlatformString& path) {
+	CrossPlatformCout << CrossPlatformText('"');
+	for (CrossPlatformChar c : path) {
+		if (c == CrossPlatformText('"')) CrossPlatformCout << CrossPlatformText('"');
+		CrossPlatformCout << c;
+	}
+	CrossPlatformCout << CrossPlatformText('"');
+}
+
+/**
+* Function prints, as CSV, the GIFs in an index that look like a given GIF, the most similar first.
+* Returns error code. 0 for no error, -1 if the GIF isn't valid, -2 if the GIF or the index can't be read.
+* @param maxDistance How many of the fingerprint's bits may differ, up to GIF_FINGERPRINT_MAX_DISTANCE
+*/
+int findSimilarGIFs(const CrossPlatformString& gifPath, const CrossPlatformString& indexPath, int maxDistance)
+{
+	FILE* file = openGIFTreeFile(gifPath);
+	if (!file) {
+		return -2;
+	}
+	GIFFingerprint fingerprint;
+	const int result = fingerprintGIF(file, fingerprint);
+	fclose(file);
+	if (result != 0) {
+		return result;
+	}
+	std::vector<GIFFingerprintEntry> entries;
+	if (!loadGIFFingerprintIndex(indexPath, entries)) {
+		return -2;
+	}
+	std::unique_ptr<GIFFingerprintLookup> lookup(new GIFFingerprintLookup());
+	lookup->build(entries);
+	GIFFingerprintQuery query;
+	std::vector<std::pair<int, unsigned int>> found;
+	query.find(*lookup, fingerprint, maxDistance, found);
+	CrossPlatformCout << CrossPlatformText("path,distance\n");
+	for (const std::pair<int, unsigned int>& match : found) {
+		printGIFFingerprintPath(entries[match.second].path);
+		CrossPlatformCout << CrossPlatformText(",") << match.first << CrossPlatformText("\n");
+	}
+	return 0;
+}
+
+static unsigned int findGIFFingerprintGroup(std::vector<unsigned int>& parents, unsigned int i) {
+	while (parents[i] != i) {
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+#define GIF_FINGERPRINT_GROUP_BATCH 256 // entries a -groups thread takes at a time
+
+// Finds the pairs of entries within maxDistance, each pair once, for groupSimilarGIFs
+static void runGIFFingerprintGroupWorker(const GIFFingerprintLookup* lookup, const std::vector<GIFFingerprintEntry>* entries, int maxDistance,
+	std::atomic<size_t>* nextEntry, std::vector<std::pair<unsigned int, unsigned int>>* pairs)
+{
+	GIFFingerprintQuery query;
+	std::vector<std::pair<int, unsigned int>> found;
+	while (true) {
+		const size_t first = nextEntry->fetch_add(GIF_FINGERPRINT_GROUP_BATCH);
+		if (first >= entries->size()) {
+			return;
+		}
+		ToolTraceSpan span("find similar", "fingerprint", (long long)first);
+		const size_t end = first + GIF_FINGERPRINT_GROUP_BATCH < entries->size() ? first + GIF_FINGERPRINT_GROUP_BATCH : entries->size();
+		for (size_t i = first; i < end; ++i) {
+			if ((*entries)[i].error != 0) continue;
+			query.find(*lookup, lookup->fingerprints[i], maxDistance, found);
+			for (const std::pair<int, unsigned int>& match : found) {
+				if (match.second > i) pairs->push_back(std::make_pair((unsigned int)i, match.second));
+			}
+		}
+	}
+}
+
+/**
+* Function prints, as CSV, groups of GIFs in an index that look alike: GIFs within maxDistance of each other
+* are in the same group, and so are GIFs linked through others. GIFs that look like no other aren't printed.
+* Returns error code. 0 for no error, -2 if the index can't be read.
+* @param maxDistance How many of the fingerprint's bits may differ, up to GIF_FINGERPRINT_MAX_DISTANCE
+* @param threadCount How many threads look for similar GIFs
+*/
+int groupSimilarGIFs(const CrossPlatformString& indexPath, int maxDistance, int threadCount)
+{
+	std::vector<GIFFingerprintEntry> entries;
+	if (!loadGIFFingerprintIndex(indexPath, entries)) {
+		return -2;
+	}
+	std::sort(entries.begin(), entries.end(), [](const GIFFingerprintEntry& a, const GIFFingerprintEntry& b) { return a.path < b.path; });
+	std::unique_ptr<GIFFingerprintLookup> lookup(new GIFFingerprintLookup());
+	lookup->build(entries);
+	std::atomic<size_t> nextEntry(0);
+	std::vector<std::vector<std::pair<unsigned int, unsigned int>>> pairs((size_t)(threadCount > 0 ? threadCount : 1));
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < pairs.size(); ++t) {
+		std::vector<std::pair<unsigned int, unsigned int>>* threadPairs = &pairs[t];
+		const GIFFingerprintLookup* shared = lookup.get();
+		threads.emplace_back([shared, &entries, maxDistance, &nextEntry, threadPairs]() {
+			setToolTraceThreadName("fingerprint lookup");
+			runGIFFingerprintGroupWorker(shared, &entries, maxDistance, &nextEntry, threadPairs);
+		});
+	}
+	runGIFFingerprintGroupWorker(lookup.get(), &entries, maxDistance, &nextEntry, &pairs[0]);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	std::vector<unsigned int> parents(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		parents[i] = (unsigned int)i;
+	}
+	for (const std::vector<std::pair<unsigned int, unsigned int>>& threadPairs : pairs) {
+		for (const std::pair<unsigned int, unsigned int>& pair : threadPairs) {
+			// the root of a group is its first entry
+			const unsigned int a = findGIFFingerprintGroup(parents, pair.first);
+			const unsigned int b = findGIFFingerprintGroup(parents, pair.second);
+			if (a < b) parents[b] = a;
+			else if (b < a) parents[a] = b;
+		}
+	}
+	// entries are sorted by path, and the root of a group is its first entry, so sorting by root, then by entry number,
+	// puts groups in the order of their first path, with their paths sorted
+	std::vector<std::pair<unsigned int, unsigned int>> members(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		members[i] = std::make_pair(findGIFFingerprintGroup(parents, (unsigned int)i), (unsigned int)i);
+	}
+	std::sort(members.begin(), members.end());
+	size_t groups = 0;
+	size_t grouped = 0;
+	CrossPlatformCout << CrossPlatformText("group,path,distance_to_first\n");
+	for (size_t i = 0; i < members.size();) {
+		size_t end = i + 1;
+		while (end < members.size() && members[end].first == members[i].first) ++end;
+		if (end - i >= 2) {
+			++groups;
+			for (; i < end; ++i) {
+				const GIFFingerprintEntry& entry = entries[members[i].second];
+				CrossPlatformCout << groups << CrossPlatformText(",");
+				printGIFFingerprintPath(entry.path);
+				CrossPlatformCout << CrossPlatformText(",") << countGIFFingerprintDistance(entry.fingerprint, entries[members[i].first].fingerprint)
+					<< CrossPlatformText("\n");
+				++grouped;
+			}
+		}
+		i = end;
+	}
+	CrossPlatformCout << CrossPlatformText("\ngroups,files_in_groups,files\n") << groups << CrossPlatformText(",") << grouped
+		<< CrossPlatformText(",") << entries.size() << CrossPlatformText("\n");
+	return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "CrossPlatformDefs.h"
+
+#define GIF_FINGERPRINT_FRAMES 4 // frames sampled from each GIF, each gives 64 bits of the fingerprint
+#define GIF_FINGERPRINT_MAX_DISTANCE 64 // farthest a lookup can go, in differing bits
+
+/**
+* A perceptual hash of a GIF: for each sampled frame, bits saying which of the lowest 8x8 frequencies of its
+* 32x32 grayscale thumbnail are above their median. GIFs that look alike differ in few bits, however they're encoded.
+*/
+struct GIFFingerprint {
+	unsigned long long bits[GIF_FINGERPRINT_FRAMES];
+};
+
+// One GIF in a fingerprint index. The identity fields are the same as GIFTreeFile's: unchanged files aren't read again.
+struct GIFFingerprintEntry {
+	CrossPlatformString path;
+	unsigned long long device;
+	unsigned long long inode;
+	long long size;
+	long long modified;
+	int error; // 0 if no error. -1 - not a valid GIF. -2 - couldn't open or read the file
+	GIFFingerprint fingerprint;
+};
+
+int fingerprintGIF(FILE* file, GIFFingerprint& fingerprint);
+
+int countGIFFingerprintDistance(const GIFFingerprint& a, const GIFFingerprint& b);
+
+int fingerprintGIFTree(const CrossPlatformString& root, const CrossPlatformString& indexPath, int threadCount);
+
+int findSimilarGIFs(const CrossPlatformString& gifPath, const CrossPlatformString& indexPath, int maxDistance);
+
+int groupSimilarGIFs(const CrossPlatformString& indexPath, int maxDistance, int threadCount);
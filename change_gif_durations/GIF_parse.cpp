@@ -3,7 +3,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <iostream>
+#include <queue>
+#include <functional>
 #include "CrossPlatformDefs.h"
+#include "ToolStats.h"
+#include "ToolTrace.h"
 
 /**
 * Function walks a GIF file and calls the callback function whenever it finds a frame duration segment,
@@ -16,6 +20,7 @@
 */
 struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int), bool readOnly)
 {
+	ToolTraceSpan span("walk", "gif");
 	struct GIFDuration_response response;
 	response.frame_count = -1;
 	response.modifications_count = 0;
@@ -36,7 +41,7 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 		response.error = -1;
 		return response;
 	}
-	fseek(file, 7, SEEK_CUR); // skip 3 bytes GIF version and 4 bytes screen size
+	toolStatsSeek(file, 7, SEEK_CUR); // skip 3 bytes GIF version and 4 bytes screen size
 	c = fgetc(file);
 	if (c == EOF) {
 		response.frame_count = -1;
@@ -48,11 +53,11 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 		bitsPerPixel = (c & 0x07) + 1;
 	}
 
-	fseek(file, 2, SEEK_CUR); // skip bytes 6-7 of Screen descriptor
+	toolStatsSeek(file, 2, SEEK_CUR); // skip bytes 6-7 of Screen descriptor
 
 	// skip Global Color Map
 	if (hasGlobalColorMap) {
-		fseek(file,
+		toolStatsSeek(file,
 			(1 << (bitsPerPixel)) * 3,
 			SEEK_CUR);
 	}
@@ -78,9 +83,10 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 			if (c == 0xF9) {
 				// Graphic Control Extension
 				frame_count += 1;
+				countToolStats(toolStats.frames);
 				response.frame_count = frame_count;
 
-				fseek(file, 2, SEEK_CUR);
+				toolStatsSeek(file, 2, SEEK_CUR);
 				int callbackResult = 0;
 				if (!readOnly) {
 					if (callback == NULL) {
@@ -92,20 +98,20 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 					if (callbackResult >= 0) {
 						fwrite(&callbackResult, 2, 1, file);
 						++response.modifications_count;
-						fseek(file, 2, SEEK_CUR);
+						toolStatsSeek(file, 2, SEEK_CUR);
 					}
 					else if (callbackResult != -2) {
-						fseek(file, 4, SEEK_CUR);
+						toolStatsSeek(file, 4, SEEK_CUR);
 					}
 				}
 				else if (callback != NULL) {
 					int duration = 0;
 					fread(&duration, 2, 1, file);
 					callbackResult = callback(duration);
-					fseek(file, 2, SEEK_CUR);
+					toolStatsSeek(file, 2, SEEK_CUR);
 				}
 				else {
-					fseek(file, 4, SEEK_CUR);
+					toolStatsSeek(file, 4, SEEK_CUR);
 				}
 				if (callbackResult == -2) {
 					response.frame_count = -1;
@@ -120,7 +126,7 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 					response.error = -1;
 					return response;
 				}
-				fseek(file, c, SEEK_CUR);
+				toolStatsSeek(file, c, SEEK_CUR);
 				while (true) {
 					c = fgetc(file);
 					if (c == EOF) {
@@ -131,12 +137,12 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 					if (c == 0) {
 						break;
 					}
-					fseek(file, c, SEEK_CUR);
+					toolStatsSeek(file, c, SEEK_CUR);
 				}
 			}
 		}
 		else if (c == 0x2C) { // Image Descriptor
-			fseek(file, 8, SEEK_CUR);
+			toolStatsSeek(file, 8, SEEK_CUR);
 			char hasLocalColorTable = 0;
 			bitsPerPixel = 0;
 			c = fgetc(file);
@@ -150,13 +156,13 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 				bitsPerPixel = (c & 0x07) + 1;
 			}
 			if (hasLocalColorTable) {
-				fseek(file,
+				toolStatsSeek(file,
 					(1 << (bitsPerPixel)) * 3,
 					SEEK_CUR);
 			}
 
 			// Table Based Image Data
-			fseek(file, 1, SEEK_CUR); // LZW Minimum Code Size
+			toolStatsSeek(file, 1, SEEK_CUR); // LZW Minimum Code Size
 			while (true) {
 				c = fgetc(file);
 				if (c == EOF) {
@@ -167,7 +173,7 @@ struct GIFDuration_response GIFDuration_walker(FILE* file, int (*callback)(int),
 				if (c == 0) {
 					break;
 				}
-				fseek(file, c, SEEK_CUR);
+				toolStatsSeek(file, c, SEEK_CUR);
 			}
 		}
 		else {
@@ -399,3 +405,273 @@ int reportGIFDurationDurationsFormat(FILE* file)
 	return 0;
 
 }
+
+// Skips a chain of data sub-blocks up to and including the block terminator. Returns false on EOF.
+static bool buildGIFIndex_skipSubBlocks(FILE* file, long long& pos) {
+	while (true) {
+		int c = fgetc(file);
+		if (c == EOF) {
+			return false;
+		}
+		++pos;
+		if (c == 0) {
+			return true;
+		}
+		toolStatsSeek(file, c, SEEK_CUR);
+		pos += c;
+	}
+}
+
+/**
+ * Function walks a GIF file the same way GIFDuration_walker does, but instead of calling back it records
+ * where every frame and extension block is and what its Image Descriptor and Graphic Control Extension say,
+ * so that frames can later be copied, decoded or rewritten without walking the file again.
+ * Returns 0 on success, -1 if the file is not a valid GIF.
+ * @param file GIF file. Gets read from the start
+*/
+int buildGIFIndex(FILE* file, struct GIFIndex& index)
+{
+	ToolTraceSpan span("index", "gif");
+	unsigned char buf[16];
+	index.frames.clear();
+	index.extensions.clear();
+	toolStatsSeek(file, 0, SEEK_SET);
+	if (fread(buf, 1, 13, file) != 13 || memcmp(buf, "GIF", 3) != 0) {
+		return -1;
+	}
+	index.width = buf[6] | (buf[7] << 8);
+	index.height = buf[8] | (buf[9] << 8);
+	index.screenFlags = buf[10];
+	index.backgroundIndex = buf[11];
+	index.aspectRatio = buf[12];
+	index.globalColorTableBits = 0;
+	long long pos = 13;
+	if ((index.screenFlags & 0x80) == 0x80) {
+		index.globalColorTableBits = (index.screenFlags & 0x07) + 1;
+		size_t size = (size_t)(1 << index.globalColorTableBits) * 3;
+		if (fread(index.globalColorTable, 1, size, file) != size) {
+			return -1;
+		}
+		pos += size;
+	}
+	index.headerSize = pos;
+
+	GIFFrameInfo frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.start = -1;
+	frame.gceOffset = -1;
+	frame.transparentIndex = -1;
+	while (true) {
+		int c = fgetc(file);
+		if (c == EOF) {
+			return -1;
+		}
+		long long blockOffset = pos++;
+		if (c == 0x3B) { // GIF Trailer
+			index.trailerOffset = blockOffset;
+			return 0;
+		}
+
+		if (c == 0x21) { // some kind of extension
+			int label = fgetc(file);
+			if (label == EOF) {
+				return -1;
+			}
+			++pos;
+			if (label == 0xF9) {
+				// Graphic Control Extension
+				if (fread(buf, 1, 6, file) != 6) {
+					return -1;
+				}
+				pos += 6;
+				frame.start = blockOffset;
+				frame.gceOffset = blockOffset;
+				frame.gceFlags = buf[1];
+				frame.disposal = (buf[1] >> 2) & 0x07;
+				frame.delay = buf[2] | (buf[3] << 8);
+				frame.transparentIndex = (buf[1] & 0x01) ? buf[4] : -1;
+				if (buf[0] != 4 || buf[5] != 0) {
+					// unusual block size. Go back to right after the size byte and skip whatever's there
+					toolStatsSeek(file, blockOffset + 3, SEEK_SET);
+					pos = blockOffset + 3;
+					toolStatsSeek(file, buf[0], SEEK_CUR);
+					pos += buf[0];
+					if (!buildGIFIndex_skipSubBlocks(file, pos)) {
+						return -1;
+					}
+				}
+			}
+			else {
+				// Other type of extension, usually denoted by length of header information, then a chain of data blocks terminated by 0
+				if (!buildGIFIndex_skipSubBlocks(file, pos)) {
+					return -1;
+				}
+				GIFExtensionInfo extension;
+				extension.offset = blockOffset;
+				extension.size = pos - blockOffset;
+				extension.label = label;
+				extension.frameIndex = (int)index.frames.size();
+				index.extensions.push_back(extension);
+				frame.extensionBytes += extension.size;
+			}
+		}
+		else if (c == 0x2C) { // Image Descriptor
+			if (fread(buf, 1, 9, file) != 9) {
+				return -1;
+			}
+			pos += 9;
+			if (frame.start == -1) frame.start = blockOffset;
+			frame.descriptorOffset = blockOffset;
+			frame.left = buf[0] | (buf[1] << 8);
+			frame.top = buf[2] | (buf[3] << 8);
+			frame.width = buf[4] | (buf[5] << 8);
+			frame.height = buf[6] | (buf[7] << 8);
+			frame.interlaced = (buf[8] & 0x40) == 0x40;
+			frame.localColorTableBits = 0;
+			if ((buf[8] & 0x80) == 0x80) {
+				frame.localColorTableBits = (buf[8] & 0x07) + 1;
+				toolStatsSeek(file,
+					(1 << frame.localColorTableBits) * 3,
+					SEEK_CUR);
+				pos += (1 << frame.localColorTableBits) * 3;
+			}
+
+			// Table Based Image Data
+			frame.dataOffset = pos;
+			toolStatsSeek(file, 1, SEEK_CUR); // LZW Minimum Code Size
+			++pos;
+			if (!buildGIFIndex_skipSubBlocks(file, pos)) {
+				return -1;
+			}
+			frame.end = pos;
+			index.frames.push_back(frame);
+			countToolStats(toolStats.frames);
+
+			memset(&frame, 0, sizeof(frame));
+			frame.start = -1;
+			frame.gceOffset = -1;
+			frame.transparentIndex = -1;
+		}
+		else {
+			return -1;
+		}
+	}
+}
+
+// Prints a non-negative value with two digits after the decimal point.
+static void reportGIFProfile_printHundredths(long long hundredths) {
+	CrossPlatformCout << hundredths / 100 << CrossPlatformText(".") << (hundredths % 100 < 10 ? CrossPlatformText("0") : CrossPlatformText(""))
+		<< hundredths % 100;
+}
+
+/**
+ * Function prints to console where the bytes of a GIF go: for each frame its rectangle, duration, how many bytes
+ * its compressed image data, local color table and extension blocks take, and how many bytes of image data it spends per pixel.
+ * After that prints totals, a histogram of frame sizes and the largest frames.
+ * Everything is gathered while going over the frames once.
+ * Returns error code. 0 for no error.
+ * @param file GIF file
+ * @param topCount How many of the largest frames to list
+*/
+int reportGIFProfile(FILE* file, int topCount)
+{
+	struct GIFIndex index;
+	if (buildGIFIndex(file, index) != 0) {
+		return -1;
+	}
+
+	// frame sizes go into buckets by power of two: bucket n holds sizes from 2^n to 2^(n+1)-1
+	const int bucketCount = 64;
+	size_t histogram[bucketCount] = { 0 };
+	// the largest frames seen so far, smallest of them on top, so it can be replaced
+	std::priority_queue<std::pair<long long, int>, std::vector<std::pair<long long, int>>, std::greater<std::pair<long long, int>>> largest;
+	long long dataTotal = 0;
+	long long colorTableTotal = 0;
+	long long extensionTotal = 0;
+	long long otherTotal = 0;
+	long long durationSum = 0;
+	long long previousEnd = index.headerSize;
+	for (size_t i = 0; i < index.frames.size(); ++i) {
+		const GIFFrameInfo& frame = index.frames[i];
+		const long long frameBytes = frame.end - previousEnd; // everything since the previous frame belongs to this one
+		const long long dataBytes = frame.end - frame.dataOffset;
+		const long long colorTableBytes = frame.localColorTableBits ? (3LL << frame.localColorTableBits) : 0;
+		const long long area = (long long)frame.width * frame.height;
+		previousEnd = frame.end;
+		dataTotal += dataBytes;
+		colorTableTotal += colorTableBytes;
+		extensionTotal += frame.extensionBytes;
+		otherTotal += frameBytes - dataBytes - colorTableBytes - frame.extensionBytes;
+		durationSum += frame.delay;
+
+		int bucket = 0;
+		while (bucket + 1 < bucketCount && (frameBytes >> (bucket + 1)) != 0) {
+			++bucket;
+		}
+		++histogram[bucket];
+		if (topCount > 0) {
+			if ((int)largest.size() < topCount) {
+				largest.push(std::make_pair(frameBytes, (int)i));
+			}
+			else if (frameBytes > largest.top().first) {
+				largest.pop();
+				largest.push(std::make_pair(frameBytes, (int)i));
+			}
+		}
+
+		CrossPlatformCout << i << CrossPlatformText(": ") << frame.width << CrossPlatformText("x") << frame.height
+			<< CrossPlatformText(" at ") << frame.left << CrossPlatformText(",") << frame.top
+			<< CrossPlatformText(", ") << frame.delay * 10 << CrossPlatformText(" ms, ") << frameBytes << CrossPlatformText(" bytes (image data ")
+			<< dataBytes << CrossPlatformText(", color table ") << colorTableBytes << CrossPlatformText(", extensions ") << frame.extensionBytes
+			<< CrossPlatformText("), ");
+		reportGIFProfile_printHundredths(area ? dataBytes * 100 / area : 0);
+		CrossPlatformCout << CrossPlatformText(" bytes per pixel\n");
+	}
+	const long long trailingBytes = index.trailerOffset + 1 - previousEnd;
+	const long long totalBytes = index.trailerOffset + 1;
+
+	CrossPlatformCout << CrossPlatformText("\nTotal: ") << totalBytes << CrossPlatformText(" bytes in ") << index.frames.size() << CrossPlatformText(" frames\n")
+		<< CrossPlatformText("Header and global color table: ") << index.headerSize << CrossPlatformText(" bytes\n")
+		<< CrossPlatformText("Image data: ") << dataTotal << CrossPlatformText(" bytes\n")
+		<< CrossPlatformText("Local color tables: ") << colorTableTotal << CrossPlatformText(" bytes\n")
+		<< CrossPlatformText("Extension blocks: ") << extensionTotal << CrossPlatformText(" bytes\n")
+		<< CrossPlatformText("Image descriptors and graphic control extensions: ") << otherTotal << CrossPlatformText(" bytes\n")
+		<< CrossPlatformText("After the last frame: ") << trailingBytes << CrossPlatformText(" bytes\n");
+	if (!index.frames.empty()) {
+		CrossPlatformCout << CrossPlatformText("Average frame: ") << (totalBytes - index.headerSize) / (long long)index.frames.size()
+			<< CrossPlatformText(" bytes, ") << durationSum * 10 / (long long)index.frames.size() << CrossPlatformText(" ms\n");
+	}
+
+	size_t histogramMax = 0;
+	for (int bucket = 0; bucket < bucketCount; ++bucket) {
+		if (histogram[bucket] > histogramMax) histogramMax = histogram[bucket];
+	}
+	if (histogramMax) {
+		CrossPlatformCout << CrossPlatformText("\nFrame sizes:\n");
+		for (int bucket = 0; bucket < bucketCount; ++bucket) {
+			if (!histogram[bucket]) continue;
+			CrossPlatformCout << (bucket ? (1LL << bucket) : 0) << CrossPlatformText("-") << (1LL << (bucket + 1)) - 1 << CrossPlatformText(" bytes: ")
+				<< histogram[bucket] << CrossPlatformText(" ");
+			const size_t barLength = (histogram[bucket] * 40 + histogramMax - 1) / histogramMax;
+			for (size_t j = 0; j < barLength; ++j) {
+				CrossPlatformCout << CrossPlatformText("#");
+			}
+			CrossPlatformCout << CrossPlatformText("\n");
+		}
+	}
+
+	if (!largest.empty()) {
+		std::vector<std::pair<long long, int>> top;
+		while (!largest.empty()) {
+			top.push_back(largest.top());
+			largest.pop();
+		}
+		CrossPlatformCout << CrossPlatformText("\nLargest frames:\n");
+		for (auto it = top.rbegin(); it != top.rend(); ++it) {
+			CrossPlatformCout << it->second << CrossPlatformText(": ") << it->first << CrossPlatformText(" bytes (");
+			reportGIFProfile_printHundredths(totalBytes ? it->first * 10000 / totalBytes : 0);
+			CrossPlatformCout << CrossPlatformText("% of the file)\n");
+		}
+	}
+	return 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <stdio.h>
 #include <stdbool.h>
+#include <vector>
 
 struct GIFDuration_response {
 	size_t frame_count; // -1 - unknown or interrupted (reached end of range).
@@ -27,3 +28,47 @@ int reportGIFDuration(FILE* file);
 int reportGIFDurationDurationsFormat_callback(int duration);
 
 int reportGIFDurationDurationsFormat(FILE* file);
+
+struct GIFFrameInfo {
+	long long start; // offset of the frame's Graphic Control Extension, or of its Image Descriptor if it has none
+	long long gceOffset; // -1 if the frame has no Graphic Control Extension
+	long long descriptorOffset;
+	long long dataOffset; // offset of the LZW Minimum Code Size byte
+	long long end; // one past the image data's block terminator
+	int left;
+	int top;
+	int width;
+	int height;
+	bool interlaced;
+	int localColorTableBits; // 0 if the frame has no local color table
+	int delay; // in 1/100 of a second, 0 if no Graphic Control Extension
+	int disposal;
+	int transparentIndex; // -1 if none
+	unsigned char gceFlags; // the packed byte of the Graphic Control Extension
+	long long extensionBytes; // size of other extension blocks between the previous frame and this one
+};
+
+struct GIFExtensionInfo {
+	long long offset; // offset of the 0x21 byte
+	long long size; // including the block terminator
+	int label;
+	int frameIndex; // index of the frame this extension precedes. Equal to the number of frames if it comes after the last one
+};
+
+struct GIFIndex {
+	int width;
+	int height;
+	unsigned char screenFlags; // the packed byte of the Screen Descriptor
+	unsigned char backgroundIndex;
+	unsigned char aspectRatio;
+	int globalColorTableBits; // 0 if there's no Global Color Map
+	unsigned char globalColorTable[256 * 3];
+	long long headerSize; // signature, Screen Descriptor and Global Color Map
+	long long trailerOffset;
+	std::vector<GIFFrameInfo> frames;
+	std::vector<GIFExtensionInfo> extensions; // all extensions except Graphic Control Extensions
+};
+
+int buildGIFIndex(FILE* file, struct GIFIndex& index);
+
+int reportGIFProfile(FILE* file, int topCount);
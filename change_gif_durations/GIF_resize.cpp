@@ -0,0 +1,181 @@
+#include "GIF_resize.h"
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GIF_RESIZE_SSE2
+#endif
+
+#define GIF_RESIZE_PI 3.14159265358979323846
+
+static double gifResizeSupport(GIFResizeFilter filter) {
+	switch (filter) {
+	case GIF_RESIZE_BOX: return 0.5;
+	case GIF_RESIZE_BILINEAR: return 1.;
+	default: return 3.;
+	}
+}
+
+static double gifResizeSinc(double x) {
+	if (x == 0.) return 1.;
+	x *= GIF_RESIZE_PI;
+	return sin(x) / x;
+}
+
+static double gifResizeKernel(GIFResizeFilter filter, double x) {
+	switch (filter) {
+	case GIF_RESIZE_BOX:
+		return x >= -0.5 && x < 0.5 ? 1. : 0.;
+	case GIF_RESIZE_BILINEAR:
+		x = fabs(x);
+		return x < 1. ? 1. - x : 0.;
+	default:
+		return x > -3. && x < 3. ? gifResizeSinc(x) * gifResizeSinc(x / 3.) : 0.;
+	}
+}
+
+/**
+* Function works out the taps and weights of each target pixel along one axis.
+* When shrinking, the filter is stretched to cover all the source pixels a target pixel stands for, so nothing is skipped.
+* Near the edges the window is moved inside the image and the weights shifted with it, so no tap reads outside.
+*/
+void buildGIFResizeAxis(int sourceSize, int targetSize, GIFResizeFilter filter, GIFResizeAxis& axis)
+{
+	const double scale = (double)sourceSize / targetSize;
+	const double filterScale = scale > 1. ? scale : 1.;
+	const double support = gifResizeSupport(filter) * filterScale;
+	axis.taps = (int)ceil(support) * 2 + 1;
+	if (axis.taps > sourceSize) axis.taps = sourceSize;
+	axis.first.assign(targetSize, 0);
+	axis.weights.assign((size_t)targetSize * axis.taps, 0.F);
+	std::vector<double> weights;
+	for (int i = 0; i < targetSize; ++i) {
+		const double center = (i + 0.5) * scale;
+		int from = (int)(center - support + 0.5);
+		int to = (int)(center + support + 0.5);
+		if (from < 0) from = 0;
+		if (to > sourceSize) to = sourceSize;
+		if (to - from > axis.taps) to = from + axis.taps;
+		weights.assign(to - from > 0 ? to - from : 0, 0.);
+		double sum = 0.;
+		for (int j = from; j < to; ++j) {
+			weights[j - from] = gifResizeKernel(filter, (j - center + 0.5) / filterScale);
+			sum += weights[j - from];
+		}
+		if (sum == 0.) {
+			// the filter missed every pixel in the window, take the nearest one
+			from = (int)center < sourceSize ? (int)center : sourceSize - 1;
+			weights.assign(1, 1.);
+			sum = 1.;
+		}
+		int first = from;
+		if (first + axis.taps > sourceSize) first = sourceSize - axis.taps;
+		axis.first[i] = first;
+		float* out = axis.weights.data() + (size_t)i * axis.taps;
+		for (size_t k = 0; k < weights.size(); ++k) {
+			out[from - first + k] = (float)(weights[k] / sum);
+		}
+	}
+}
+
+/**
+* Function resamples a canvas (pixels packed as R | G << 8 | B << 16 | A << 24, alpha 0 or 255) to the target size,
+* one axis at a time: rows first into scratch, as floats, then columns.
+* Transparent pixels are 0 in all channels, so the sums are alpha-premultiplied as they are, and transparent
+* pixels don't bleed their color into their neighbors. A target pixel comes out opaque if its alpha reaches
+* half, with its color divided by the alpha, and transparent otherwise.
+* Each pixel's 4 channels go through the multiply-adds together in one SSE2 register when available.
+* @param scratch Reused between calls, grows to sourceHeight * targetWidth * 4 floats
+*/
+void resizeGIFCanvas(const unsigned int* source, int sourceWidth, int sourceHeight, const GIFResizeAxis& xAxis, const GIFResizeAxis& yAxis,
+	unsigned int* target, int targetWidth, int targetHeight, std::vector<float>& scratch)
+{
+	scratch.resize((size_t)sourceHeight * targetWidth * 4);
+	float* rows = scratch.data();
+	// a row range is only needed if some target row takes a tap from it
+	const int rowFrom = yAxis.first[0];
+	const int rowTo = yAxis.first[targetHeight - 1] + yAxis.taps;
+#ifdef GIF_RESIZE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (int y = rowFrom; y < rowTo; ++y) {
+		const unsigned int* sourceRow = source + (size_t)y * sourceWidth;
+		float* out = rows + (size_t)y * targetWidth * 4;
+		for (int x = 0; x < targetWidth; ++x) {
+			const unsigned int* taps = sourceRow + xAxis.first[x];
+			const float* weights = xAxis.weights.data() + (size_t)x * xAxis.taps;
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < xAxis.taps; ++k) {
+				__m128i pixel = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)taps[k]), zero), zero);
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(pixel), _mm_set1_ps(weights[k])));
+			}
+			_mm_storeu_ps(out + x * 4, sum);
+		}
+	}
+	const __m128 half = _mm_set1_ps(127.5F);
+	const __m128 full = _mm_set1_ps(255.F);
+	for (int y = 0; y < targetHeight; ++y) {
+		const float* weights = yAxis.weights.data() + (size_t)y * yAxis.taps;
+		const float* firstRow = rows + (size_t)yAxis.first[y] * targetWidth * 4;
+		unsigned int* out = target + (size_t)y * targetWidth;
+		for (int x = 0; x < targetWidth; ++x) {
+			const float* tap = firstRow + x * 4;
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < yAxis.taps; ++k) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(tap), _mm_set1_ps(weights[k])));
+				tap += (size_t)targetWidth * 4;
+			}
+			__m128 alpha = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3));
+			if (_mm_comilt_ss(alpha, half)) {
+				out[x] = 0;
+				continue;
+			}
+			// the alpha lane comes out as 255, the color lanes get clamped to 0-255 by the saturating packs
+			__m128i color = _mm_cvtps_epi32(_mm_mul_ps(_mm_div_ps(sum, alpha), full));
+			color = _mm_packs_epi32(color, color);
+			out[x] = (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(color, color));
+		}
+	}
+#else
+	for (int y = rowFrom; y < rowTo; ++y) {
+		const unsigned int* sourceRow = source + (size_t)y * sourceWidth;
+		float* out = rows + (size_t)y * targetWidth * 4;
+		for (int x = 0; x < targetWidth; ++x) {
+			const unsigned int* taps = sourceRow + xAxis.first[x];
+			const float* weights = xAxis.weights.data() + (size_t)x * xAxis.taps;
+			float sum[4] = { 0.F, 0.F, 0.F, 0.F };
+			for (int k = 0; k < xAxis.taps; ++k) {
+				for (int c = 0; c < 4; ++c) {
+					sum[c] += (float)((taps[k] >> (c * 8)) & 0xFF) * weights[k];
+				}
+			}
+			for (int c = 0; c < 4; ++c) {
+				out[x * 4 + c] = sum[c];
+			}
+		}
+	}
+	for (int y = 0; y < targetHeight; ++y) {
+		const float* weights = yAxis.weights.data() + (size_t)y * yAxis.taps;
+		const float* firstRow = rows + (size_t)yAxis.first[y] * targetWidth * 4;
+		unsigned int* out = target + (size_t)y * targetWidth;
+		for (int x = 0; x < targetWidth; ++x) {
+			float sum[4] = { 0.F, 0.F, 0.F, 0.F };
+			for (int k = 0; k < yAxis.taps; ++k) {
+				const float* tap = firstRow + (size_t)k * targetWidth * 4 + x * 4;
+				for (int c = 0; c < 4; ++c) {
+					sum[c] += tap[c] * weights[k];
+				}
+			}
+			if (sum[3] < 127.5F) {
+				out[x] = 0;
+				continue;
+			}
+			unsigned int pixel = 0xFF000000U;
+			for (int c = 0; c < 3; ++c) {
+				const float value = sum[c] / sum[3] * 255.F;
+				const int rounded = (int)lrintf(value);
+				pixel |= (unsigned int)(rounded < 0 ? 0 : rounded > 255 ? 255 : rounded) << (c * 8);
+			}
+			out[x] = pixel;
+		}
+	}
+#endif
+}
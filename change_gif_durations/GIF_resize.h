@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+
+enum GIFResizeFilter {
+	GIF_RESIZE_BOX, // average of the source pixels each target pixel covers. Sharpest for big reductions of pixel art
+	GIF_RESIZE_BILINEAR, // triangle filter
+	GIF_RESIZE_LANCZOS // Lanczos with 3 lobes. Sharpest for photos, may ring a little around hard edges
+};
+
+/**
+* How each target pixel along one axis is made from source pixels: a weighted sum of taps source pixels starting at first[i].
+* Weights are normalized to add up to 1 and zero-padded, so that every target pixel has the same number of taps.
+*/
+struct GIFResizeAxis {
+	int taps;
+	std::vector<int> first;
+	std::vector<float> weights; // taps weights for each target pixel
+};
+
+void buildGIFResizeAxis(int sourceSize, int targetSize, GIFResizeFilter filter, GIFResizeAxis& axis);
+
+void resizeGIFCanvas(const unsigned int* source, int sourceWidth, int sourceHeight, const GIFResizeAxis& xAxis, const GIFResizeAxis& yAxis,
+	unsigned int* target, int targetWidth, int targetHeight, std::vector<float>& scratch);
@@ -0,0 +1,512 @@
+#include "GIF_tree.h"
+#include "GIF_parse.h"
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifndef FOR_LINUX
+#include <Windows.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+#include "ToolStats.h"
+#include "ToolTrace.h"
+
+#define GIF_TREE_CACHE_HEADER "GIFTools tree cache 1"
+// Where there's no way to ask the OS to load a file in the background, the read-ahead thread reads it through this buffer
+#define GIF_TREE_READ_AHEAD_BUFFER (1024 * 1024)
+
+typedef std::tuple<unsigned long long, unsigned long long, long long, long long> GIFTreeCacheKey; // device, inode, size, modified
+
+static GIFTreeCacheKey getGIFTreeCacheKey(const GIFTreeFile& file) {
+	return GIFTreeCacheKey(file.device, file.inode, file.size, file.modified);
+}
+
+static bool hasGIFExtension(const CrossPlatformChar* name) {
+	size_t length = 0;
+	while (name[length]) ++length;
+	return length >= 4 && CrossPlatformCaseInsensitiveTextCompare(name + length - 4, CrossPlatformText(".gif")) == 0;
+}
+
+/**
+* Function lists a directory, adding its subdirectories and the GIF files in it to the lists.
+* Symbolic links and junctions are not followed, so the same files don't get counted twice and loops can't happen.
+* Returns false if the directory couldn't be read.
+*/
+bool listGIFTreeDirectory(const CrossPlatformString& directory, std::vector<CrossPlatformString>& directories,
+	std::vector<CrossPlatformString>& gifs)
+{
+	ToolTraceSpan span("list directory", "file", directory.c_str());
+	CrossPlatformString prefix = directory;
+#ifndef FOR_LINUX
+	if (!prefix.empty() && prefix.back() != L'\\' && prefix.back() != L'/') prefix += L'\\';
+	WIN32_FIND_DATAW data;
+	HANDLE handle = FindFirstFileW((prefix + L"*").c_str(), &data);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	do {
+		if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0
+			|| (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+			continue;
+		}
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			directories.push_back(prefix + data.cFileName);
+		}
+		else if (hasGIFExtension(data.cFileName)) {
+			gifs.push_back(prefix + data.cFileName);
+		}
+	} while (FindNextFileW(handle, &data));
+	FindClose(handle);
+#else
+	if (!prefix.empty() && prefix.back() != '/') prefix += '/';
+	DIR* handle = opendir(directory.c_str());
+	if (!handle) {
+		return false;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(handle)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+		unsigned char type = entry->d_type;
+		if (type == DT_UNKNOWN) {
+			// some file systems don't say, ask for it separately
+			struct stat info;
+			if (lstat((prefix + entry->d_name).c_str(), &info) != 0) continue;
+			type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_LNK;
+		}
+		if (type == DT_DIR) {
+			directories.push_back(prefix + entry->d_name);
+		}
+		else if (type == DT_REG && hasGIFExtension(entry->d_name)) {
+			gifs.push_back(prefix + entry->d_name);
+		}
+	}
+	closedir(handle);
+#endif
+	return true;
+}
+
+// Fills in what identifies an unchanged file between runs, see GIFTreeFile. Returns false on failure.
+bool getGIFFileIdentity(FILE* handle, unsigned long long& device, unsigned long long& inode, long long& size, long long& modified) {
+#ifndef FOR_LINUX
+	BY_HANDLE_FILE_INFORMATION info;
+	if (!GetFileInformationByHandle((HANDLE)_get_osfhandle(_fileno(handle)), &info)) {
+		return false;
+	}
+	device = info.dwVolumeSerialNumber;
+	inode = ((unsigned long long)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+	size = ((long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	modified = ((long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat info;
+	if (fstat(fileno(handle), &info) != 0) {
+		return false;
+	}
+	device = (unsigned long long)info.st_dev;
+	inode = (unsigned long long)info.st_ino;
+	size = (long long)info.st_size;
+	modified = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+FILE* openGIFTreeFile(const CrossPlatformString& path) {
+	FILE* handle = NULL;
+#ifndef FOR_LINUX
+	if (_wfopen_s(&handle, path.c_str(), L"rb")) handle = NULL;
+#else
+	handle = fopen(path.c_str(), "rb");
+#endif
+	return handle;
+}
+
+/**
+* Function fills in the timing of a GIF, from the cache if the file is unchanged, otherwise by parsing it.
+* @param file Has the path filled in
+* @param handle The file opened by the read-ahead thread, or NULL to open it here. Gets closed
+* @param cache Results of the previous run
+*/
+static void analyzeGIFTreeFile(GIFTreeFile& file, FILE* handle, const std::map<GIFTreeCacheKey, GIFTreeFile>& cache) {
+	ToolTraceSpan span("analyze", "file", file.path.c_str());
+	file.error = 0;
+	file.cached = false;
+	file.frames = 0;
+	file.durationMs = 0;
+	file.minDelayMs = -1;
+	file.framesUnder20Ms = 0;
+	if (!handle) {
+		handle = openGIFTreeFile(file.path);
+	}
+	if (!handle) {
+		file.error = -2;
+		return;
+	}
+	countToolStats(toolStats.files);
+	if (!getGIFFileIdentity(handle, file.device, file.inode, file.size, file.modified)) {
+		fclose(handle);
+		file.error = -2;
+		return;
+	}
+	auto found = cache.find(getGIFTreeCacheKey(file));
+	if (found != cache.end()) {
+		fclose(handle);
+		CrossPlatformString path = std::move(file.path);
+		file = found->second;
+		file.path = std::move(path);
+		file.cached = true;
+		// buildGIFIndex counts the frames it reads. Cached frames count too, so that --stats covers every file the tree reports
+		countToolStats(toolStats.frames, file.frames);
+		return;
+	}
+	GIFIndex index;
+	const int result = buildGIFIndex(handle, index);
+	fclose(handle);
+	if (result != 0) {
+		file.error = -1;
+		return;
+	}
+	file.frames = (int)index.frames.size();
+	for (const GIFFrameInfo& frame : index.frames) {
+		const int delayMs = frame.delay * 10;
+		file.durationMs += delayMs;
+		if (file.minDelayMs == -1 || delayMs < file.minDelayMs) file.minDelayMs = delayMs;
+		if (delayMs < 20) ++file.framesUnder20Ms;
+	}
+}
+
+enum GIFTreeReadAheadState {
+	GIF_TREE_NOT_READ_AHEAD, // the worker that takes the file opens it
+	GIF_TREE_READING_AHEAD,
+	GIF_TREE_READ_AHEAD // handle is the opened file, or NULL if opening it failed
+};
+
+// What the read-ahead thread did with a file
+struct GIFTreeReadAhead {
+	GIFTreeReadAheadState state;
+	FILE* handle;
+};
+
+/**
+* Directories left to list and files left to analyze, shared by the worker threads.
+* Listing a directory adds more of both, so workers only stop when both are used up and nobody is listing.
+*/
+struct GIFTreeWork {
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<CrossPlatformString> directories;
+	std::deque<GIFTreeFile> files; // a deque so that adding files doesn't move the ones being analyzed
+	std::deque<GIFTreeReadAhead> readAhead; // one for each of files
+	size_t nextFile; // files before this one are taken
+	size_t nextReadAhead; // files before this one are taken by the read-ahead thread or a worker. Never less than nextFile
+	size_t readAheadCount; // how far nextReadAhead may get ahead of nextFile
+	int listing; // workers that are listing a directory
+	int working; // workers that haven't finished
+	size_t unreadableDirectories;
+	const std::map<GIFTreeCacheKey, GIFTreeFile>* cache;
+
+	void addListing(std::vector<CrossPlatformString>& newDirectories, std::vector<CrossPlatformString>& gifs) {
+		for (CrossPlatformString& directory : newDirectories) {
+			directories.push_back(std::move(directory));
+		}
+		for (CrossPlatformString& gif : gifs) {
+			files.emplace_back();
+			files.back().path = std::move(gif);
+			readAhead.push_back({ GIF_TREE_NOT_READ_AHEAD, NULL });
+		}
+	}
+};
+
+/**
+* Function opens a file before a worker gets to it and gets the OS loading it, so that by the time it's parsed
+* the data is already in memory. Cached files are only opened: their contents aren't needed.
+* On Linux posix_fadvise asks the kernel to read the whole file in the background and returns right away, so the
+* reads of all the files ahead are in flight at once. On Windows the file is read through a buffer, which loads it
+* into the system file cache, and the handle is rewound for the worker.
+* Returns the opened file, or NULL if it couldn't be opened.
+*/
+static FILE* readGIFTreeFileAhead(const CrossPlatformString& path, const std::map<GIFTreeCacheKey, GIFTreeFile>& cache,
+	std::vector<unsigned char>& buffer)
+{
+	ToolTraceSpan span("read ahead", "file", path.c_str());
+	FILE* handle = openGIFTreeFile(path);
+	GIFTreeFile identity;
+	if (!handle || !getGIFFileIdentity(handle, identity.device, identity.inode, identity.size, identity.modified)
+			|| cache.count(getGIFTreeCacheKey(identity))) {
+		return handle;
+	}
+#ifndef FOR_LINUX
+	buffer.resize(GIF_TREE_READ_AHEAD_BUFFER);
+	while (fread(buffer.data(), 1, buffer.size(), handle) == buffer.size()) { }
+	rewind(handle);
+#else
+	(void)buffer;
+	posix_fadvise(fileno(handle), 0, 0, POSIX_FADV_WILLNEED);
+#endif
+	return handle;
+}
+
+static void runGIFTreeReadAhead(GIFTreeWork* work) {
+	setToolTraceThreadName("tree read-ahead");
+	std::vector<unsigned char> buffer;
+	std::unique_lock<std::mutex> guard(work->mutex);
+	while (work->working) {
+		if (work->nextReadAhead < work->files.size() && work->nextReadAhead < work->nextFile + work->readAheadCount) {
+			const size_t index = work->nextReadAhead++;
+			work->readAhead[index].state = GIF_TREE_READING_AHEAD;
+			const CrossPlatformString& path = work->files[index].path;
+			guard.unlock();
+			FILE* handle = readGIFTreeFileAhead(path, *work->cache, buffer);
+			guard.lock();
+			work->readAhead[index].handle = handle;
+			work->readAhead[index].state = GIF_TREE_READ_AHEAD;
+			work->changed.notify_all();
+		}
+		else {
+			work->changed.wait(guard);
+		}
+	}
+}
+
+static void runGIFTreeWorker(GIFTreeWork* work) {
+	setToolTraceThreadName("tree worker");
+	std::vector<CrossPlatformString> directories;
+	std::vector<CrossPlatformString> gifs;
+	std::unique_lock<std::mutex> guard(work->mutex);
+	while (true) {
+		if (!work->directories.empty()) {
+			CrossPlatformString directory = std::move(work->directories.back());
+			work->directories.pop_back();
+			++work->listing;
+			guard.unlock();
+			directories.clear();
+			gifs.clear();
+			const bool listed = listGIFTreeDirectory(directory, directories, gifs);
+			guard.lock();
+			--work->listing;
+			if (!listed) {
+				++work->unreadableDirectories;
+				CrossPlatformCerr << CrossPlatformText("Failed to read directory ") << directory.c_str() << std::endl;
+			}
+			work->addListing(directories, gifs);
+			work->changed.notify_all();
+		}
+		else if (work->nextFile < work->files.size()) {
+			const size_t index = work->nextFile++;
+			if (work->nextReadAhead < work->nextFile) {
+				// the read-ahead thread is behind, skip it past this file
+				work->nextReadAhead = work->nextFile;
+			}
+			else {
+				// there's room for one more file ahead
+				work->changed.notify_all();
+			}
+			while (work->readAhead[index].state == GIF_TREE_READING_AHEAD) {
+				work->changed.wait(guard);
+			}
+			FILE* handle = work->readAhead[index].handle;
+			GIFTreeFile* file = &work->files[index];
+			guard.unlock();
+			analyzeGIFTreeFile(*file, handle, *work->cache);
+			guard.lock();
+		}
+		else if (work->listing == 0) {
+			--work->working;
+			work->changed.notify_all();
+			return;
+		}
+		else {
+			work->changed.wait(guard);
+		}
+	}
+}
+
+static FILE* openGIFTreeCache(const CrossPlatformString& path, bool write) {
+	FILE* file = NULL;
+#ifndef FOR_LINUX
+	if (_wfopen_s(&file, path.c_str(), write ? L"wb" : L"rb")) file = NULL;
+#else
+	file = fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+	return file;
+}
+
+// Reads the cache file, if there is one. Stops at the first line it doesn't understand.
+static void loadGIFTreeCache(const CrossPlatformString& path, std::map<GIFTreeCacheKey, GIFTreeFile>& cache) {
+	FILE* file = openGIFTreeCache(path, false);
+	if (!file) {
+		return;
+	}
+	char line[256];
+	if (fgets(line, sizeof(line), file) && strncmp(line, GIF_TREE_CACHE_HEADER, strlen(GIF_TREE_CACHE_HEADER)) == 0) {
+		GIFTreeFile entry;
+		while (fgets(line, sizeof(line), file)) {
+			if (sscanf(line, "%llu %llu %lld %lld %d %d %lld %d %d", &entry.device, &entry.inode, &entry.size, &entry.modified,
+					&entry.error, &entry.frames, &entry.durationMs, &entry.minDelayMs, &entry.framesUnder20Ms) != 9) {
+				break;
+			}
+			cache[getGIFTreeCacheKey(entry)] = entry;
+		}
+	}
+	fclose(file);
+}
+
+// Writes the results of this run as the new cache, dropping files that are gone. Returns false on failure.
+static bool saveGIFTreeCache(const CrossPlatformString& path, const std::deque<GIFTreeFile>& files) {
+	FILE* file = openGIFTreeCache(path, true);
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "%s\n", GIF_TREE_CACHE_HEADER);
+	for (const GIFTreeFile& entry : files) {
+		if (entry.error == -2) continue; // there's no identity to key it by
+		fprintf(file, "%llu %llu %lld %lld %d %d %lld %d %d\n", entry.device, entry.inode, entry.size, entry.modified,
+			entry.error, entry.frames, entry.durationMs, entry.minDelayMs, entry.framesUnder20Ms);
+	}
+	const bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+static const CrossPlatformChar* describeGIFTreeError(int error) {
+	if (error == -1) return CrossPlatformText("invalid GIF");
+	if (error == -2) return CrossPlatformText("can't read");
+	return CrossPlatformText("");
+}
+
+static void printGIFTreeQuoted(const CrossPlatformString& text, bool json) {
+	CrossPlatformCout << CrossPlatformText('"');
+	for (CrossPlatformChar c : text) {
+		if (json && (c == CrossPlatformText('"') || c == CrossPlatformText('\\'))) {
+			CrossPlatformCout << CrossPlatformText('\\') << c;
+		}
+		else if (json && (unsigned)c < 0x20) {
+			CrossPlatformCout << CrossPlatformText("\\u00") << CrossPlatformText("0123456789abcdef")[c >> 4] << CrossPlatformText("0123456789abcdef")[c & 15];
+		}
+		else if (!json && c == CrossPlatformText('"')) {
+			CrossPlatformCout << CrossPlatformText("\"\"");
+		}
+		else {
+			CrossPlatformCout << c;
+		}
+	}
+	CrossPlatformCout << CrossPlatformText('"');
+}
+
+/**
+* Function finds all GIF files under a directory, including subdirectories, reads their frame delays on several threads
+* and prints a row for each file and totals for all of them, as CSV or JSON.
+* Returns error code. 0 for no error, -1 if the directory can't be read.
+* @param root The directory to look in
+* @param options Thread count, read-ahead, output format and where to keep the cache.
+*                Files whose device, inode, size and modification time are in the cache are not parsed again
+*/
+int analyzeGIFTree(const CrossPlatformString& root, const GIFTreeOptions& options)
+{
+	std::map<GIFTreeCacheKey, GIFTreeFile> cache;
+	if (!options.cachePath.empty()) {
+		loadGIFTreeCache(options.cachePath, cache);
+	}
+
+	GIFTreeWork work;
+	work.nextFile = 0;
+	work.nextReadAhead = 0;
+	work.readAheadCount = options.readAhead > 0 ? (size_t)options.readAhead : 0;
+	work.listing = 0;
+	work.working = options.threadCount;
+	work.unreadableDirectories = 0;
+	work.cache = &cache;
+	std::vector<CrossPlatformString> directories;
+	std::vector<CrossPlatformString> gifs;
+	if (!listGIFTreeDirectory(root, directories, gifs)) {
+		return -1;
+	}
+	work.addListing(directories, gifs);
+
+	std::vector<std::thread> threads;
+	if (work.readAheadCount) {
+		threads.emplace_back(runGIFTreeReadAhead, &work);
+	}
+	for (int i = 1; i < options.threadCount; ++i) {
+		threads.emplace_back(runGIFTreeWorker, &work);
+	}
+	runGIFTreeWorker(&work);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	std::deque<GIFTreeFile>& files = work.files;
+	std::sort(files.begin(), files.end(), [](const GIFTreeFile& a, const GIFTreeFile& b) { return a.path < b.path; });
+	if (!options.cachePath.empty() && !saveGIFTreeCache(options.cachePath, files)) {
+		CrossPlatformPerror(options.cachePath.c_str());
+		CrossPlatformCerr << CrossPlatformText("Failed to write the cache file.\n");
+	}
+
+	size_t cached = 0;
+	size_t errors = 0;
+	size_t filesUnder20Ms = 0;
+	long long frames = 0;
+	long long durationMs = 0;
+	std::ios_base::fmtflags flags = CrossPlatformCout.flags();
+	std::streamsize precision = CrossPlatformCout.precision();
+	CrossPlatformCout << std::fixed << std::setprecision(2);
+	if (options.json) {
+		CrossPlatformCout << CrossPlatformText("{\"files\":[");
+	}
+	else {
+		CrossPlatformCout << CrossPlatformText("path,frames,duration_ms,average_fps,min_delay_ms,frames_under_20ms,cached,error\n");
+	}
+	for (size_t i = 0; i < files.size(); ++i) {
+		const GIFTreeFile& file = files[i];
+		if (file.cached) ++cached;
+		if (file.error) ++errors;
+		if (file.framesUnder20Ms) ++filesUnder20Ms;
+		frames += file.frames;
+		durationMs += file.durationMs;
+		const double fps = file.durationMs ? file.frames * 1000. / file.durationMs : 0.;
+		if (options.json) {
+			CrossPlatformCout << (i ? CrossPlatformText(",\n") : CrossPlatformText("\n")) << CrossPlatformText("{\"path\":");
+			printGIFTreeQuoted(file.path, true);
+			CrossPlatformCout << CrossPlatformText(",\"frames\":") << file.frames << CrossPlatformText(",\"duration_ms\":") << file.durationMs
+				<< CrossPlatformText(",\"average_fps\":") << fps << CrossPlatformText(",\"min_delay_ms\":") << file.minDelayMs
+				<< CrossPlatformText(",\"frames_under_20ms\":") << file.framesUnder20Ms
+				<< CrossPlatformText(",\"cached\":") << (file.cached ? CrossPlatformText("true") : CrossPlatformText("false"))
+				<< CrossPlatformText(",\"error\":");
+			printGIFTreeQuoted(describeGIFTreeError(file.error), true);
+			CrossPlatformCout << CrossPlatformText("}");
+		}
+		else {
+			printGIFTreeQuoted(file.path, false);
+			CrossPlatformCout << CrossPlatformText(",") << file.frames << CrossPlatformText(",") << file.durationMs << CrossPlatformText(",") << fps
+				<< CrossPlatformText(",") << file.minDelayMs << CrossPlatformText(",") << file.framesUnder20Ms
+				<< CrossPlatformText(",") << (file.cached ? 1 : 0) << CrossPlatformText(",") << describeGIFTreeError(file.error) << CrossPlatformText("\n");
+		}
+	}
+	const double fps = durationMs ? frames * 1000. / durationMs : 0.;
+	if (options.json) {
+		CrossPlatformCout << CrossPlatformText("\n],\"summary\":{\"files\":") << files.size() << CrossPlatformText(",\"cached\":") << cached
+			<< CrossPlatformText(",\"errors\":") << errors << CrossPlatformText(",\"unreadable_directories\":") << work.unreadableDirectories
+			<< CrossPlatformText(",\"frames\":") << frames << CrossPlatformText(",\"duration_ms\":") << durationMs
+			<< CrossPlatformText(",\"average_fps\":") << fps << CrossPlatformText(",\"files_with_frames_under_20ms\":") << filesUnder20Ms
+			<< CrossPlatformText("}}\n");
+	}
+	else {
+		CrossPlatformCout << CrossPlatformText("\nfiles,cached,errors,unreadable_directories,frames,duration_ms,average_fps,files_with_frames_under_20ms\n")
+			<< files.size() << CrossPlatformText(",") << cached << CrossPlatformText(",") << errors << CrossPlatformText(",") << work.unreadableDirectories
+			<< CrossPlatformText(",") << frames << CrossPlatformText(",") << durationMs << CrossPlatformText(",") << fps
+			<< CrossPlatformText(",") << filesUnder20Ms << CrossPlatformText("\n");
+	}
+	CrossPlatformCout.flags(flags);
+	CrossPlatformCout.precision(precision);
+	return 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "CrossPlatformDefs.h"
+
+/**
+* Timing of one GIF found by analyzeGIFTree.
+* The identity fields are what the cache is keyed by: if all of them are the same on the next run, the file isn't parsed again.
+*/
+struct GIFTreeFile {
+	CrossPlatformString path;
+	unsigned long long device; // st_dev, or the volume serial number on Windows
+	unsigned long long inode; // st_ino, or the file index on Windows
+	long long size;
+	long long modified; // modification time in nanoseconds on Linux, 100 ns units on Windows
+	int error; // 0 if no error. -1 - not a valid GIF. -2 - couldn't open or read the file
+	bool cached; // taken from the cache instead of parsing the file
+	int frames;
+	long long durationMs;
+	int minDelayMs; // -1 if there are no frames
+	int framesUnder20Ms; // most browsers show these slower than the GIF says
+};
+
+struct GIFTreeOptions {
+	int threadCount;
+	int readAhead; // how many files ahead of the ones being parsed get opened and start loading, 0 for none
+	bool json; // CSV if false
+	CrossPlatformString cachePath; // empty if no cache
+};
+
+int analyzeGIFTree(const CrossPlatformString& root, const GIFTreeOptions& options);
+
+bool listGIFTreeDirectory(const CrossPlatformString& directory, std::vector<CrossPlatformString>& directories,
+	std::vector<CrossPlatformString>& gifs);
+
+FILE* openGIFTreeFile(const CrossPlatformString& path);
+
+bool getGIFFileIdentity(FILE* handle, unsigned long long& device, unsigned long long& inode, long long& size, long long& modified);
@@ -0,0 +1,208 @@
+#include "PNG_write.h"
+#include <string.h>
+
+// Compressed data is written as an IDAT chunk once there's this much of it
+#define PNG_WRITE_IDAT_SIZE 65536
+
+static unsigned int pngCRCTable[256];
+static bool pngCRCTableBuilt = false;
+
+static unsigned int updatePNGCRC(unsigned int crc, const unsigned char* data, size_t size) {
+	if (!pngCRCTableBuilt) {
+		for (unsigned int n = 0; n < 256; ++n) {
+			unsigned int c = n;
+			for (int k = 0; k < 8; ++k) {
+				c = c & 1 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+			}
+			pngCRCTable[n] = c;
+		}
+		pngCRCTableBuilt = true;
+	}
+	for (size_t i = 0; i < size; ++i) {
+		crc = pngCRCTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void putPNGUInt(unsigned char* out, unsigned int value) {
+	out[0] = (unsigned char)(value >> 24);
+	out[1] = (unsigned char)(value >> 16);
+	out[2] = (unsigned char)(value >> 8);
+	out[3] = (unsigned char)value;
+}
+
+static bool writePNGChunk(FILE* file, const char* type, const unsigned char* data, size_t size) {
+	unsigned char header[8];
+	putPNGUInt(header, (unsigned int)size);
+	memcpy(header + 4, type, 4);
+	unsigned char crc[4];
+	putPNGUInt(crc, updatePNGCRC(updatePNGCRC(0xFFFFFFFFU, header + 4, 4), data, size) ^ 0xFFFFFFFFU);
+	return fwrite(header, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) && fwrite(crc, 1, 4, file) == 4;
+}
+
+// Appends bits LSB-first, the order deflate packs everything but Huffman codes in.
+static void putPNGBits(PNGWriter& writer, unsigned int value, int count) {
+	writer.bitBuf |= value << writer.bitCount;
+	writer.bitCount += count;
+	while (writer.bitCount >= 8) {
+		writer.idat.push_back((unsigned char)writer.bitBuf);
+		writer.bitBuf >>= 8;
+		writer.bitCount -= 8;
+	}
+}
+
+// Huffman codes go in starting from their most significant bit.
+static void putPNGHuffman(PNGWriter& writer, unsigned int code, int count) {
+	unsigned int reversed = 0;
+	for (int i = 0; i < count; ++i) {
+		reversed = reversed << 1 | ((code >> i) & 1);
+	}
+	putPNGBits(writer, reversed, count);
+}
+
+// Writes a literal/length symbol with the fixed Huffman code from the deflate spec.
+static void putPNGSymbol(PNGWriter& writer, int symbol) {
+	if (symbol < 144) putPNGHuffman(writer, 0x30 + symbol, 8);
+	else if (symbol < 256) putPNGHuffman(writer, 0x190 + symbol - 144, 9);
+	else if (symbol < 280) putPNGHuffman(writer, symbol - 256, 7);
+	else putPNGHuffman(writer, 0xC0 + symbol - 280, 8);
+}
+
+static const short pngLengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short pngLengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int pngDistBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const short pngDistExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Writes a match of 3 to 258 bytes at a distance of 1 to 32768.
+static void putPNGMatch(PNGWriter& writer, int length, int distance) {
+	int code = 28;
+	while (pngLengthBase[code] > length) --code;
+	putPNGSymbol(writer, 257 + code);
+	putPNGBits(writer, length - pngLengthBase[code], pngLengthExtra[code]);
+	code = 29;
+	while (pngDistBase[code] > distance) --code;
+	putPNGHuffman(writer, code, 5);
+	putPNGBits(writer, distance - pngDistBase[code], pngDistExtra[code]);
+}
+
+static bool flushPNGData(PNGWriter& writer, bool all) {
+	if (writer.idat.size() < PNG_WRITE_IDAT_SIZE && !all) return true;
+	bool written = writePNGChunk(writer.file, "IDAT", writer.idat.data(), writer.idat.size());
+	writer.idat.clear();
+	return written;
+}
+
+/**
+* Function writes the PNG signature, the IHDR chunk (8-bit RGBA, not interlaced) and the start of the zlib stream.
+* Returns false on write error.
+*/
+bool beginPNG(PNGWriter& writer, FILE* file, int width, int height)
+{
+	writer.file = file;
+	writer.width = width;
+	writer.height = height;
+	writer.rowsWritten = 0;
+	writer.adler = 1;
+	writer.bitBuf = 0;
+	writer.bitCount = 0;
+	writer.idat.clear();
+	writer.window.clear();
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	unsigned char ihdr[13];
+	putPNGUInt(ihdr, (unsigned int)width);
+	putPNGUInt(ihdr + 4, (unsigned int)height);
+	ihdr[8] = 8; // bit depth
+	ihdr[9] = 6; // RGBA
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+	writer.idat.push_back(0x78); // zlib header: deflate, 32K window
+	writer.idat.push_back(0x01);
+	return fwrite(signature, 1, 8, file) == 8 && writePNGChunk(file, "IHDR", ihdr, sizeof(ihdr));
+}
+
+/**
+* Function compresses the next rows, each one width pixels packed as R | G << 8 | B << 16 | A << 24.
+* Each call writes one deflate block. Returns false on write error.
+*/
+bool writePNGRows(PNGWriter& writer, const unsigned int* pixels, int rowCount)
+{
+	const size_t stride = (size_t)writer.width * 4 + 1;
+	// matches with the row above are only possible if it's within deflate's 32 KB window
+	const bool matchAbove = stride <= 32768;
+	putPNGBits(writer, 2, 3); // not the final block, fixed Huffman codes
+	unsigned int a = writer.adler & 0xFFFF;
+	unsigned int b = writer.adler >> 16;
+	for (int r = 0; r < rowCount; ++r) {
+		// the window holds the row above (if there is one) followed by this row
+		if (writer.window.size() >= 2 * stride) {
+			writer.window.erase(writer.window.begin(), writer.window.begin() + stride);
+		}
+		const size_t rowStart = writer.window.size();
+		writer.window.push_back(0); // filter type: none
+		const unsigned int* row = pixels + (size_t)r * writer.width;
+		for (int x = 0; x < writer.width; ++x) {
+			writer.window.push_back((unsigned char)row[x]);
+			writer.window.push_back((unsigned char)(row[x] >> 8));
+			writer.window.push_back((unsigned char)(row[x] >> 16));
+			writer.window.push_back((unsigned char)(row[x] >> 24));
+		}
+		const unsigned char* data = writer.window.data();
+		const size_t end = writer.window.size();
+		for (size_t i = rowStart; i < end; ++i) {
+			a = (a + data[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		for (size_t i = rowStart; i < end; ) {
+			size_t bestLength = 0;
+			size_t bestDistance = 0;
+			const size_t maxLength = end - i < 258 ? end - i : 258;
+			if (i >= rowStart + 5) {
+				size_t length = 0;
+				while (length < maxLength && data[i + length] == data[i + length - 4]) ++length;
+				bestLength = length;
+				bestDistance = 4;
+			}
+			if (matchAbove && rowStart >= stride) {
+				size_t length = 0;
+				while (length < maxLength && data[i + length] == data[i + length - stride]) ++length;
+				if (length > bestLength) {
+					bestLength = length;
+					bestDistance = stride;
+				}
+			}
+			if (bestLength >= 3) {
+				putPNGMatch(writer, (int)bestLength, (int)bestDistance);
+				i += bestLength;
+			}
+			else {
+				putPNGSymbol(writer, data[i]);
+				++i;
+			}
+		}
+		++writer.rowsWritten;
+	}
+	writer.adler = b << 16 | a;
+	putPNGSymbol(writer, 256); // end of block
+	return flushPNGData(writer, false);
+}
+
+/**
+* Function ends the zlib stream and writes the last IDAT chunk and the IEND chunk. Returns false on write error.
+*/
+bool finishPNG(PNGWriter& writer)
+{
+	putPNGBits(writer, 3, 3); // final block, fixed Huffman codes
+	putPNGSymbol(writer, 256);
+	if (writer.bitCount > 0) {
+		putPNGBits(writer, 0, 8 - writer.bitCount);
+	}
+	unsigned char adler[4];
+	putPNGUInt(adler, writer.adler);
+	writer.idat.insert(writer.idat.end(), adler, adler + 4);
+	return flushPNGData(writer, true) && writePNGChunk(writer.file, "IEND", NULL, 0) && fflush(writer.file) == 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+/**
+* Writes an RGBA PNG a few rows at a time, so the image never has to be in memory as a whole.
+* Compression is a simple deflate: fixed Huffman codes, with repeats of the previous pixel and of the row above
+* as the only matches. That's most of what flat GIF graphics have to offer.
+*/
+struct PNGWriter {
+	FILE* file;
+	int width;
+	int height;
+	int rowsWritten;
+	unsigned int adler; // Adler-32 of the uncompressed data, for the zlib stream
+	unsigned int bitBuf;
+	int bitCount;
+	std::vector<unsigned char> idat; // compressed data not written yet, goes out as an IDAT chunk when big enough
+	std::vector<unsigned char> window; // the row above, then the current row, each with its filter type byte
+};
+
+bool beginPNG(PNGWriter& writer, FILE* file, int width, int height);
+
+bool writePNGRows(PNGWriter& writer, const unsigned int* pixels, int rowCount);
+
+bool finishPNG(PNGWriter& writer);
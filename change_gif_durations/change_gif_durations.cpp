@@ -6,10 +6,20 @@
 #else
 #include <fstream>
 #include <string.h>
+#include <sys/stat.h>
 #endif
 #include "CrossPlatformDefs.h"
 #include "GIF_parse.h"
+#include "GIF_edit.h"
+#include "GIF_tree.h"
+#include "GIF_fingerprint.h"
+#include "GIF_decode.h"
+#include "PNG_write.h"
+#include "ToolStats.h"
+#include "ToolTrace.h"
 #include <vector>
+#include <functional>
+#include <thread>
 
 #ifndef FOR_LINUX
 #define CrossPlatformMainName wmain
@@ -47,6 +57,28 @@ void trim(std::string& str) {
     str.resize(it - str.begin() + 1);
 }
 
+bool crossPlatformCreateFile(FILE** file, const CrossPlatformString& path) {
+#ifndef FOR_LINUX
+    if (_wfopen_s(file, path.c_str(), CrossPlatformText("wb")) || !*file) {
+        CrossPlatformPerror(path.c_str());
+        if (*file) {
+            fclose(*file);
+        }
+        return false;
+    }
+    countToolStats(toolStats.files);
+    return true;
+#else
+    *file = fopen(path.c_str(), "wb");
+    if (!*file) {
+        CrossPlatformPerror(path.c_str());
+        return false;
+    }
+    countToolStats(toolStats.files);
+    return true;
+#endif
+}
+
 bool crossPlatformOpenFile(FILE** file, const CrossPlatformString& path) {
 #ifndef FOR_LINUX
     if (_wfopen_s(file, path.c_str(), CrossPlatformText("r+b")) || !*file) {
@@ -56,6 +88,7 @@ bool crossPlatformOpenFile(FILE** file, const CrossPlatformString& path) {
         }
         return false;
     }
+    countToolStats(toolStats.files);
     return true;
 #else
     * file = fopen(path.c_str(), "r+b");
@@ -63,10 +96,68 @@ bool crossPlatformOpenFile(FILE** file, const CrossPlatformString& path) {
         CrossPlatformPerror(path.c_str());
         return false;
     }
+    countToolStats(toolStats.files);
+    return true;
+#endif
+}
+
+bool crossPlatformOpenFileForReading(FILE** file, const CrossPlatformString& path) {
+#ifndef FOR_LINUX
+    if (_wfopen_s(file, path.c_str(), CrossPlatformText("rb")) || !*file) {
+        CrossPlatformPerror(path.c_str());
+        if (*file) {
+            fclose(*file);
+        }
+        return false;
+    }
+    countToolStats(toolStats.files);
+    return true;
+#else
+    *file = fopen(path.c_str(), "rb");
+    if (!*file) {
+        CrossPlatformPerror(path.c_str());
+        return false;
+    }
+    countToolStats(toolStats.files);
     return true;
 #endif
 }
 
+/**
+ * Function tells if two paths lead to the same existing file, also through different spellings or links.
+ * Used to refuse an output path that would truncate one of the inputs before it gets read.
+ * @param pathA First path
+ * @param pathB Second path. If it doesn't exist, the answer is false
+*/
+bool isSameFile(const CrossPlatformString& pathA, const CrossPlatformString& pathB) {
+    if (pathA == pathB) {
+        return true;
+    }
+#ifndef FOR_LINUX
+    BY_HANDLE_FILE_INFORMATION info[2];
+    const CrossPlatformString* paths[2] = { &pathA, &pathB };
+    for (int i = 0; i < 2; ++i) {
+        HANDLE handle = CreateFileW(paths[i]->c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        BOOL gotInfo = GetFileInformationByHandle(handle, &info[i]);
+        CloseHandle(handle);
+        if (!gotInfo) {
+            return false;
+        }
+    }
+    return info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber
+        && info[0].nFileIndexHigh == info[1].nFileIndexHigh && info[0].nFileIndexLow == info[1].nFileIndexLow;
+#else
+    struct stat statA, statB;
+    if (stat(pathA.c_str(), &statA) != 0 || stat(pathB.c_str(), &statB) != 0) {
+        return false;
+    }
+    return statA.st_dev == statB.st_dev && statA.st_ino == statB.st_ino;
+#endif
+}
+
 void crossPlatformCopyFile(const CrossPlatformString& pathSource, const CrossPlatformString& pathDestination) {
     #ifdef FOR_LINUX
     std::ifstream src(pathSource, std::ios::binary);
@@ -140,6 +231,123 @@ int findChar(const CrossPlatformString& buf, CrossPlatformChar c) {
     return -1;
 }
 
+/**
+ * Function finds an argument in format 0-20 among the arguments, parses it and removes it from them.
+ * Returns false if there's no such argument.
+*/
+bool takeFrameRange(std::vector<CrossPlatformString>& args, int& startInt, int& endInt) {
+    for (auto it = args.begin(); it != args.end(); ++it) {
+        int pos = findChar(*it, CrossPlatformText('-'));
+        if (pos != -1) {
+            std::vector<CrossPlatformString> parts = split(*it, CrossPlatformText('-'));
+            if (parts.size() != 2) {
+                continue;
+            }
+            if (!parseInteger(parts[0], startInt)) {
+                continue;
+            }
+            if (!parseInteger(parts[1], endInt)) {
+                continue;
+            }
+            args.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Function runs one of the modes that read a GIF and write a modified copy of it, and reports the result.
+ * Returns the exit code.
+ * @param inputPath GIF file to read. Not modified
+ * @param outputPath GIF file to create or overwrite. Must not be the input file
+ * @param edit The function from GIF_edit.h that does the work
+ * @param doneMessage The start of the message that gets printed on success, followed by the frame count
+*/
+int runGIFEdit(const CrossPlatformString& inputPath, const CrossPlatformString& outputPath,
+        const std::function<struct GIFEdit_response(FILE*, FILE*)>& edit, const CrossPlatformChar* doneMessage) {
+    if (isSameFile(inputPath, outputPath)) {
+        CrossPlatformCerr << CrossPlatformText("The output file can't be the input file ") << inputPath << CrossPlatformText(", it would get overwritten before it is read.\n");
+        return -1;
+    }
+    FILE* file = nullptr;
+    if (!crossPlatformOpenFileForReading(&file, inputPath)) {
+        return -1;
+    }
+    FILE* outputFile = nullptr;
+    if (!crossPlatformCreateFile(&outputFile, outputPath)) {
+        fclose(file);
+        return -1;
+    }
+    beginToolStatsPhase(TOOL_STATS_EXECUTE);
+    struct GIFEdit_response response;
+    {
+        ToolTraceSpan span("file", "file", inputPath.c_str());
+        response = edit(file, outputFile);
+    }
+    fclose(file);
+    fclose(outputFile);
+    if (response.error == -1) {
+        CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+        return -1;
+    }
+    if (response.error == -3) {
+        CrossPlatformCerr << CrossPlatformText("Input range outside of GIF length-1 (") << (int)(response.framesIn - 1) << CrossPlatformText(").\n");
+        return -1;
+    }
+    if (response.error != 0) {
+        CrossPlatformCerr << CrossPlatformText("Operation failed. Failed to write the output file.\n");
+        return -1;
+    }
+    CrossPlatformCout << doneMessage << CrossPlatformText(" ") << response.framesOut << CrossPlatformText(" of ") << response.framesIn
+        << CrossPlatformText(" frames: ") << response.bytesIn << CrossPlatformText(" bytes -> ") << response.bytesOut << CrossPlatformText(" bytes");
+    if (response.extensionsRemoved) {
+        CrossPlatformCout << CrossPlatformText(", removed ") << response.extensionsRemoved << CrossPlatformText(" extension blocks");
+    }
+    if (response.framesRecompressed) {
+        CrossPlatformCout << CrossPlatformText(", recompressed ") << response.framesRecompressed << CrossPlatformText(" frames");
+    }
+    if (response.framesShrunk) {
+        CrossPlatformCout << CrossPlatformText(", made ") << response.framesShrunk << CrossPlatformText(" frames smaller");
+    }
+    if (response.colorTablesRemoved) {
+        CrossPlatformCout << CrossPlatformText(", removed ") << response.colorTablesRemoved << CrossPlatformText(" local color tables");
+    }
+    if (response.bytesOut < response.bytesIn) {
+        CrossPlatformCout << CrossPlatformText(" (") << response.bytesIn - response.bytesOut << CrossPlatformText(" bytes saved)");
+    }
+    CrossPlatformCout << CrossPlatformText(".\n");
+    return 0;
+}
+
+/**
+* Function parses a -resize size: WIDTHxHEIGHT, or just WIDTH, in which case the height keeps the source's aspect ratio.
+* Returns false if it's not a valid size.
+*/
+bool parseResizeSize(const CrossPlatformString& text, int sourceWidth, int sourceHeight, int& width, int& height) {
+    const size_t separator = text.find_first_of(CrossPlatformText("xX"));
+    if (!parseInteger(text.substr(0, separator), width) || width <= 0 || width > 65535) {
+        return false;
+    }
+    if (separator == CrossPlatformString::npos) {
+        height = (int)(((long long)sourceHeight * width * 2 + sourceWidth) / (sourceWidth * 2LL));
+        if (height < 1) height = 1;
+    }
+    else if (!parseInteger(text.substr(separator + 1), height) || height <= 0) {
+        return false;
+    }
+    return height <= 65535;
+}
+
+// How many of the 256 fingerprint bits may differ for -similar and -groups to count GIFs as alike, unless -distance says otherwise
+#define FINGERPRINT_DISTANCE 32
+
+// How many files -tree opens and starts loading ahead of the ones being parsed, unless -readahead says otherwise
+#define TREE_READ_AHEAD_FILES 16
+
+// How much of the frame -render keeps in memory at once, unless -band says otherwise
+#define RENDER_BAND_BYTES (16 * 1024 * 1024)
+
 #define PARAMETERS_FORMAT_HELP CrossPlatformText("1 - input/output file name (file will be read and modified);\n")\
 	CrossPlatformText("2 - frame range in format 0-20, frame numbers starting from 0. This parameter must not be present when using -durations.\n")\
 	CrossPlatformText("3 - -duration ## or -fps ##. -duration specifies time in ms between frames. -fps specifies frames per second.\n")\
@@ -151,10 +359,94 @@ int findChar(const CrossPlatformString& buf, CrossPlatformChar c) {
 	CrossPlatformText("1 - filename\n")\
 	CrossPlatformText("2 - -f. A flag (which means \"show framerate\") (don't type \"show framerate\", type the -f flag)\n")\
     CrossPlatformText("3 - -u. A flag (which means \"user-friendly\") which changes the format of the output")\
-    CrossPlatformText(" because without it the default format is the same format that program expects in a file in a -durations option.\n")
+    CrossPlatformText(" because without it the default format is the same format that program expects in a file in a -durations option.\n")\
+	CrossPlatformText("\nAlternative mode: shows what takes up space in the GIF. Expects 2 arguments:\n")\
+	CrossPlatformText("1 - filename\n")\
+	CrossPlatformText("2 - -profile. A flag. Prints the size of each frame's image data, color table and extension blocks,")\
+	CrossPlatformText(" then totals, a histogram of frame sizes and the largest frames.\n")\
+	CrossPlatformText("3 - -top ##. Optional. How many of the largest frames to list, 10 by default.\n")\
+	CrossPlatformText("\nAlternative mode: shows framerates of all GIFs in a directory and its subdirectories. Expects 2 or more arguments:\n")\
+	CrossPlatformText("1 - directory path\n")\
+	CrossPlatformText("2 - -tree. A flag. Prints a CSV row for each GIF: frame count, total duration, average framerate, shortest delay")\
+	CrossPlatformText(" and how many frames are shorter than 20 ms (most browsers slow those down), followed by totals.\n")\
+	CrossPlatformText("Optional: -json. Prints JSON instead of CSV.\n")\
+	CrossPlatformText("Optional: -cache \"path\". Keeps results in the \"path\" file, so that the next run only reads GIFs that changed.\n")\
+	CrossPlatformText("Optional: -threads ##. How many GIFs get read at once. The default is the number of CPU cores.\n")\
+	CrossPlatformText("Optional: -readahead ##. How many GIFs get opened and start loading ahead of the ones being read. 16 by default, 0 turns it off.\n")\
+	CrossPlatformText("\nAlternative mode: fingerprints all GIFs in a directory and its subdirectories, to find ones that look alike. Expects 3 arguments:\n")\
+	CrossPlatformText("1 - directory path\n")\
+	CrossPlatformText("2, 3 - -fingerprint \"path\". Writes the fingerprints into the \"path\" index file. If it already exists, GIFs that")\
+	CrossPlatformText(" didn't change since are not read again.\n")\
+	CrossPlatformText("Optional: -threads ##. How many GIFs get read at once. The default is the number of CPU cores.\n")\
+	CrossPlatformText("\nAlternative mode: lists GIFs in a fingerprint index that look like a GIF. Expects 3 arguments:\n")\
+	CrossPlatformText("1 - filename\n")\
+	CrossPlatformText("2, 3 - -similar \"path\". The index file made with -fingerprint.\n")\
+	CrossPlatformText("Optional: -distance ##. How many of the 256 fingerprint bits may differ, from 0 to 64. 32 by default.\n")\
+	CrossPlatformText("\nAlternative mode: lists groups of GIFs in a fingerprint index that look alike. Expects 2 arguments:\n")\
+	CrossPlatformText("1 - the index file made with -fingerprint\n")\
+	CrossPlatformText("2 - -groups. A flag.\n")\
+	CrossPlatformText("Optional: -distance ##. How many of the 256 fingerprint bits may differ, from 0 to 64. 32 by default.\n")\
+	CrossPlatformText("Optional: -threads ##. How many GIFs get looked up at once. The default is the number of CPU cores.\n")\
+	CrossPlatformText("\nAlternative mode: optimizes the GIF. Expects 2 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -optimize \"path\". Writes a copy of the GIF to \"path\" where each frame only stores the rectangle")\
+	CrossPlatformText(" that changed since the previous frame, and unchanged pixels inside it are transparent. Looks the same, but smaller.\n")\
+	CrossPlatformText("Optional: -lossless. Instead, only re-encodes each frame's compressed data with a better LZW code table reset strategy and")\
+	CrossPlatformText(" code size, keeping it where it's smaller. Pixels, timing and all other blocks stay exactly as they were.\n")\
+	CrossPlatformText("Optional: -lossy ##. Like -lossless, but pixels may change by up to ## (RGB distance, 1 to 441) when that makes")\
+	CrossPlatformText(" the compressed data smaller. Prints the bytes saved and the mean error of each frame.\n")\
+	CrossPlatformText("Optional: -threads ##. With -lossless or -lossy, how many frames get re-encoded at once. The default is the number of CPU cores.\n")\
+	CrossPlatformText("\nAlternative mode: saves a frame as a PNG. Expects 3 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -render \"path\". Writes the frame the way it's shown (with the frames before it underneath) into a PNG file at \"path\".")\
+	CrossPlatformText(" Only a band of rows is kept in memory at a time, so it works on canvases too big to fit in memory whole.\n")\
+	CrossPlatformText("3 - frame number, starting from 0.\n")\
+	CrossPlatformText("Optional: -band ##. How many rows are rendered at a time. The default is as many as fit in 16 MB.\n")\
+	CrossPlatformText("\nAlternative mode: resizes the GIF to one or more sizes. Expects 3 or more arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2, 3 and so on - -resize WIDTHxHEIGHT \"path\". Writes the GIF at that size into \"path\". Give just WIDTH to keep")\
+	CrossPlatformText(" the aspect ratio. Repeat it for more sizes: they're all made from one decode of the input.\n")\
+	CrossPlatformText("Optional: -filter box, -filter bilinear or -filter lanczos. How pixels are resampled. The default is lanczos.\n")\
+	CrossPlatformText("Optional: -threads ##. How many frames get resized at once. The default is the number of CPU cores.\n")\
+	CrossPlatformText("\nAlternative mode: merges duplicate frames. Expects 2 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -dedup \"path\". Writes a copy of the GIF to \"path\" where consecutive frames that are exactly the same")\
+	CrossPlatformText(" are merged into one frame that lasts as long as all of them together.\n")\
+	CrossPlatformText("\nAlternative mode: drops frames. Expects 3 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -decimate \"path\". Writes a copy of the GIF to \"path\" with fewer frames. Durations of dropped frames are added to the frames before them.\n")\
+	CrossPlatformText("3 - -every ## or -fps ##. -every 2 keeps every second frame, -every 3 every third and so on.")\
+	CrossPlatformText(" -fps keeps only as many frames as needed to play at most ## frames per second.\n")\
+	CrossPlatformText("\nAlternative mode: cuts out a range of frames. Expects 3 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -trim \"path\". Writes the frames in the range into a new GIF at \"path\".\n")\
+	CrossPlatformText("3 - frame range in format 0-20, frame numbers starting from 0.\n")\
+	CrossPlatformText("\nAlternative mode: joins GIFs. Expects 2 or more arguments:\n")\
+	CrossPlatformText("1, 2 and so on - input file names (not modified), in the order they play.\n")\
+	CrossPlatformText("Last - -concat \"path\". Writes all frames of the inputs, one after another, into a new GIF at \"path\".\n")\
+	CrossPlatformText("\nAlternative mode: plays the GIF backward. Expects 2 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -reverse \"path\" to write the frames in reverse order into a new GIF at \"path\",")\
+	CrossPlatformText(" or -pingpong \"path\" to write them forward and then backward.\n")\
+	CrossPlatformText("\nAlternative mode: removes metadata. Expects 2 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -strip \"path\". Writes a copy of the GIF to \"path\" without comments, plain text and application extension blocks")\
+	CrossPlatformText(" (such as XMP metadata or ICC color profiles). Looping is kept.\n")\
+	CrossPlatformText("\nAlternative mode: removes repeated color tables. Expects 2 arguments:\n")\
+	CrossPlatformText("1 - input file name (not modified)\n")\
+	CrossPlatformText("2 - -unifypalette \"path\". Writes a copy of the GIF to \"path\" where the color table most frames repeat")\
+	CrossPlatformText(" is stored once, as the global one.\n")\
+	CrossPlatformText("\nAny mode: --stats - when the program exits, print a line of JSON to stderr with the time spent")\
+	CrossPlatformText(" and the amount of I/O done.\n")\
+	CrossPlatformText("Any mode: --trace \"path\" - write a timeline of the work done, down to each frame decoded or encoded, into \"path\"")\
+	CrossPlatformText(" in Chrome's trace format (open it in chrome://tracing or ui.perfetto.dev).\n")
 
 int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar* envp[])
 {
+    if (!takeToolStatsOptions("change_gif_durations", argc, argv)) {
+        CrossPlatformCerr << CrossPlatformText("A file path for the trace must be provided after the --trace option. Add --help or /? option for help.\n");
+        exit(-1);
+    }
     if (argc == 2 && (
             CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("-help")) == 0
             || CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("--help")) == 0
@@ -171,6 +463,46 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
     bool metDurationsFlag = false;
     CrossPlatformString argumentWhichIsAfterDurations;
     bool needToCaptureArgumentWhichIsAfterDurations = false;
+    bool metOptimizeFlag = false;
+    bool metLosslessFlag = false;
+    bool metLossyFlag = false;
+    bool metDedupFlag = false;
+    bool metDecimateFlag = false;
+    bool metEveryFlag = false;
+    bool metTrimFlag = false;
+    bool metConcatFlag = false;
+    bool metReverseFlag = false;
+    bool metPingPongFlag = false;
+    bool metStripFlag = false;
+    bool metUnifyPaletteFlag = false;
+    bool metProfileFlag = false;
+    bool metTopFlag = false;
+    bool metTreeFlag = false;
+    bool metJSONFlag = false;
+    bool metRenderFlag = false;
+    std::vector<CrossPlatformString> resizeSizes;
+    std::vector<CrossPlatformString> resizePaths;
+    bool needToCaptureResizeSize = false;
+    bool needToCaptureResizePath = false;
+    CrossPlatformString filterValue;
+    bool needToCaptureFilter = false;
+    CrossPlatformString bandValue;
+    bool needToCaptureBand = false;
+    CrossPlatformString readAheadValue;
+    bool needToCaptureReadAhead = false;
+    CrossPlatformString indexPath;
+    bool needToCaptureIndexPath = false;
+    bool metFingerprintFlag = false;
+    bool metSimilarFlag = false;
+    bool metGroupsFlag = false;
+    CrossPlatformString distanceValue;
+    bool needToCaptureDistance = false;
+    CrossPlatformString cachePath;
+    bool needToCaptureCachePath = false;
+    CrossPlatformString threadsValue;
+    bool needToCaptureThreads = false;
+    CrossPlatformString outputFilename;
+    bool needToCaptureOutputFilename = false;
     std::vector<CrossPlatformString> unparsedArgs;
     CrossPlatformString filename;
     for (int i = 1; i < argc; ++i) {
@@ -188,13 +520,597 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         }
         else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-fps")) == 0) {
             metFPSFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-optimize")) == 0) {
+            metOptimizeFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-lossless")) == 0) {
+            metLosslessFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-lossy")) == 0) {
+            metLossyFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-dedup")) == 0) {
+            metDedupFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-decimate")) == 0) {
+            metDecimateFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-trim")) == 0) {
+            metTrimFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-concat")) == 0) {
+            metConcatFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-reverse")) == 0) {
+            metReverseFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-pingpong")) == 0) {
+            metPingPongFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-strip")) == 0) {
+            metStripFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-unifypalette")) == 0) {
+            metUnifyPaletteFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-profile")) == 0) {
+            metProfileFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-top")) == 0) {
+            metTopFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-every")) == 0) {
+            metEveryFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-tree")) == 0) {
+            metTreeFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-json")) == 0) {
+            metJSONFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-render")) == 0) {
+            metRenderFlag = true;
+            needToCaptureOutputFilename = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-band")) == 0) {
+            needToCaptureBand = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-resize")) == 0) {
+            needToCaptureResizeSize = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-filter")) == 0) {
+            needToCaptureFilter = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-cache")) == 0) {
+            needToCaptureCachePath = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-readahead")) == 0) {
+            needToCaptureReadAhead = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-fingerprint")) == 0) {
+            metFingerprintFlag = true;
+            needToCaptureIndexPath = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-similar")) == 0) {
+            metSimilarFlag = true;
+            needToCaptureIndexPath = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-groups")) == 0) {
+            metGroupsFlag = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-distance")) == 0) {
+            needToCaptureDistance = true;
+        }
+        else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-threads")) == 0) {
+            needToCaptureThreads = true;
+        } else if (needToCaptureCachePath) {
+            cachePath = argv[i];
+            needToCaptureCachePath = false;
+        } else if (needToCaptureThreads) {
+            threadsValue = argv[i];
+            needToCaptureThreads = false;
+        } else if (needToCaptureBand) {
+            bandValue = argv[i];
+            needToCaptureBand = false;
+        } else if (needToCaptureReadAhead) {
+            readAheadValue = argv[i];
+            needToCaptureReadAhead = false;
+        } else if (needToCaptureIndexPath) {
+            indexPath = argv[i];
+            needToCaptureIndexPath = false;
+        } else if (needToCaptureDistance) {
+            distanceValue = argv[i];
+            needToCaptureDistance = false;
+        } else if (needToCaptureResizeSize) {
+            resizeSizes.push_back(argv[i]);
+            needToCaptureResizeSize = false;
+            needToCaptureResizePath = true;
+        } else if (needToCaptureResizePath) {
+            resizePaths.push_back(argv[i]);
+            needToCaptureResizePath = false;
+        } else if (needToCaptureFilter) {
+            filterValue = argv[i];
+            needToCaptureFilter = false;
         } else if (needToCaptureArgumentWhichIsAfterDurations) {
             argumentWhichIsAfterDurations = argv[i];
             needToCaptureArgumentWhichIsAfterDurations = false;
+        } else if (needToCaptureOutputFilename) {
+            outputFilename = argv[i];
+            needToCaptureOutputFilename = false;
         } else {
             unparsedArgs.push_back(argv[i]);
         }
     }
+    beginToolStatsPhase(TOOL_STATS_PLAN);
+    if ((metLosslessFlag || metLossyFlag) && !metOptimizeFlag) {
+        CrossPlatformCerr << CrossPlatformText("The -lossless and -lossy options can only be used together with -optimize. Add --help or /? option for help.\n");
+        return -1;
+    }
+    if (metLosslessFlag && metLossyFlag) {
+        CrossPlatformCerr << CrossPlatformText("Must provide only one of either -lossless or -lossy. Add --help or /? option for help.\n");
+        return -1;
+    }
+    if (!resizeSizes.empty()) {
+        if (metRenderFlag || metOptimizeFlag || metDedupFlag || metDecimateFlag || metTrimFlag || metConcatFlag || metReverseFlag || metPingPongFlag
+                || metStripFlag || metUnifyPaletteFlag) {
+            CrossPlatformCerr << CrossPlatformText("The -resize option can't be used together with -render, -optimize, -dedup, -decimate, -trim, -concat, -reverse, -pingpong, -strip or -unifypalette.")
+                << CrossPlatformText(" Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (needToCaptureResizePath || resizePaths.size() != resizeSizes.size()) {
+            CrossPlatformCerr << CrossPlatformText("A size and a filename or filepath for the output GIF must be provided after each -resize option. Add --help or /? option for help.\n");
+            return -1;
+        }
+        GIFResizeFilter filter = GIF_RESIZE_LANCZOS;
+        if (needToCaptureFilter) {
+            CrossPlatformCerr << CrossPlatformText("A filter name must be provided after the -filter option. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (!filterValue.empty()) {
+            if (CrossPlatformCaseInsensitiveTextCompare(filterValue.c_str(), CrossPlatformText("box")) == 0) filter = GIF_RESIZE_BOX;
+            else if (CrossPlatformCaseInsensitiveTextCompare(filterValue.c_str(), CrossPlatformText("bilinear")) == 0) filter = GIF_RESIZE_BILINEAR;
+            else if (CrossPlatformCaseInsensitiveTextCompare(filterValue.c_str(), CrossPlatformText("lanczos")) == 0) filter = GIF_RESIZE_LANCZOS;
+            else {
+                CrossPlatformCerr << CrossPlatformText("Unknown filter ") << filterValue << CrossPlatformText(". Must be box, bilinear or lanczos. Add --help or /? option for help.\n");
+                return -1;
+            }
+        }
+        int threadCount = (int)std::thread::hardware_concurrency();
+        if (threadCount <= 0) threadCount = 1;
+        if (needToCaptureThreads || (!threadsValue.empty() && (!parseInteger(threadsValue, threadCount) || threadCount <= 0))) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -threads option. Must be a positive number. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (unparsedArgs.size() != 1) {
+            CrossPlatformCerr << CrossPlatformText("Can't understand where the filename or file path to the GIF file is - there are some unparsed arguments. Add --help or /? option for help.\n");
+            return -1;
+        }
+        for (const CrossPlatformString& resizePath : resizePaths) {
+            if (isSameFile(unparsedArgs.front(), resizePath)) {
+                CrossPlatformCerr << CrossPlatformText("The output file can't be the input file ") << resizePath << CrossPlatformText(", it would get overwritten before it is read.\n");
+                return -1;
+            }
+        }
+        FILE* file = nullptr;
+        if (!crossPlatformOpenFileForReading(&file, unparsedArgs.front())) {
+            exit(-1);
+        }
+        GIFIndex index;
+        if (buildGIFIndex(file, index) != 0 || index.width == 0 || index.height == 0) {
+            CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+            fclose(file);
+            exit(-1);
+        }
+        std::vector<GIFResizeOutput> outputs(resizeSizes.size());
+        for (size_t i = 0; i < resizeSizes.size(); ++i) {
+            if (!parseResizeSize(resizeSizes[i], index.width, index.height, outputs[i].width, outputs[i].height)) {
+                CrossPlatformCerr << CrossPlatformText("Failed to parse the size ") << resizeSizes[i]
+                    << CrossPlatformText(" after -resize. Must be WIDTHxHEIGHT, or just WIDTH to keep the aspect ratio, up to 65535. Add --help or /? option for help.\n");
+                fclose(file);
+                return -1;
+            }
+        }
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            outputs[i].file = nullptr;
+            if (!crossPlatformCreateFile(&outputs[i].file, resizePaths[i])) {
+                for (size_t j = 0; j < i; ++j) fclose(outputs[j].file);
+                fclose(file);
+                exit(-1);
+            }
+        }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        struct GIFEdit_response response = resizeGIF(file, outputs, filter, threadCount);
+        fclose(file);
+        for (GIFResizeOutput& output : outputs) fclose(output.file);
+        if (response.error == -1) {
+            CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+            exit(-1);
+        }
+        if (response.error != 0) {
+            CrossPlatformCerr << CrossPlatformText("Operation failed. Failed to write the output file.\n");
+            exit(-1);
+        }
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            CrossPlatformCout << CrossPlatformText("Resized to ") << outputs[i].width << CrossPlatformText("x") << outputs[i].height
+                << CrossPlatformText(": ") << resizePaths[i] << CrossPlatformText(", ") << response.framesOut << CrossPlatformText(" frames, ")
+                << outputs[i].bytesOut << CrossPlatformText(" bytes.\n");
+        }
+        return 0;
+    }
+    if (metRenderFlag) {
+        if (metOptimizeFlag || metDedupFlag || metDecimateFlag || metTrimFlag || metConcatFlag || metReverseFlag || metPingPongFlag || metStripFlag
+                || metUnifyPaletteFlag) {
+            CrossPlatformCerr << CrossPlatformText("The -render option can't be used together with -optimize, -dedup, -decimate, -trim, -concat, -reverse, -pingpong, -strip or -unifypalette.")
+                << CrossPlatformText(" Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (needToCaptureOutputFilename || outputFilename.empty()) {
+            CrossPlatformCerr << CrossPlatformText("A filename or filepath for the output PNG must be provided after a -render option. Add --help or /? option for help.\n");
+            return -1;
+        }
+        int frameNumber = 0;
+        bool parsedValue = false;
+        for (auto it = unparsedArgs.begin(); it != unparsedArgs.end(); ++it) {
+            if (!parseInteger(*it, frameNumber)) {
+                continue;
+            }
+            parsedValue = true;
+            unparsedArgs.erase(it);
+            break;
+        }
+        if (!parsedValue || frameNumber < 0) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the frame number for the -render option. Frame numbers start from 0. Add --help or /? option for help.\n");
+            return -1;
+        }
+        int bandHeight = 0;
+        if (needToCaptureBand || (!bandValue.empty() && (!parseInteger(bandValue, bandHeight) || bandHeight <= 0))) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -band option. Must be a positive number. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (unparsedArgs.size() != 1) {
+            CrossPlatformCerr << CrossPlatformText("Can't understand where the filename or file path to the GIF file is - there are some unparsed arguments. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (isSameFile(unparsedArgs.front(), outputFilename)) {
+            CrossPlatformCerr << CrossPlatformText("The output file can't be the input file ") << outputFilename << CrossPlatformText(", it would get overwritten before it is read.\n");
+            return -1;
+        }
+        FILE* file = nullptr;
+        if (!crossPlatformOpenFileForReading(&file, unparsedArgs.front())) {
+            exit(-1);
+        }
+        GIFIndex index;
+        if (buildGIFIndex(file, index) != 0 || index.width == 0 || index.height == 0) {
+            CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+            fclose(file);
+            exit(-1);
+        }
+        if (frameNumber >= (int)index.frames.size()) {
+            CrossPlatformCerr << CrossPlatformText("The GIF only has ") << index.frames.size() << CrossPlatformText(" frames. Frame numbers start from 0.\n");
+            fclose(file);
+            return -1;
+        }
+        if (bandHeight == 0) {
+            bandHeight = (int)(RENDER_BAND_BYTES / ((size_t)index.width * 4));
+            if (bandHeight < 1) bandHeight = 1;
+        }
+        FILE* outputFile = nullptr;
+        if (!crossPlatformCreateFile(&outputFile, outputFilename)) {
+            fclose(file);
+            exit(-1);
+        }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        PNGWriter writer;
+        bool written = beginPNG(writer, outputFile, index.width, index.height);
+        int err = written ? renderGIFBands(file, index, frameNumber, bandHeight, [&writer, &written](int /*firstRow*/, int rowCount, const unsigned int* pixels) {
+            written = writePNGRows(writer, pixels, rowCount);
+            return written;
+        }) : -2;
+        if (err == 0) {
+            written = finishPNG(writer);
+        }
+        fclose(file);
+        fclose(outputFile);
+        if (err == -1) {
+            CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+            exit(-1);
+        }
+        if (!written) {
+            CrossPlatformCerr << CrossPlatformText("Operation failed. Failed to write the output file.\n");
+            exit(-1);
+        }
+        CrossPlatformCout << CrossPlatformText("Rendered frame ") << frameNumber << CrossPlatformText(" (") << index.width << CrossPlatformText("x") << index.height
+            << CrossPlatformText(") in bands of ") << (bandHeight < index.height ? bandHeight : index.height) << CrossPlatformText(" rows.\n");
+        return 0;
+    }
+    if (metOptimizeFlag || metDedupFlag || metDecimateFlag || metTrimFlag || metConcatFlag || metReverseFlag || metPingPongFlag || metStripFlag
+            || metUnifyPaletteFlag) {
+        if ((unsigned int)metOptimizeFlag + (unsigned int)metDedupFlag + (unsigned int)metDecimateFlag + (unsigned int)metTrimFlag
+                + (unsigned int)metConcatFlag + (unsigned int)metReverseFlag + (unsigned int)metPingPongFlag + (unsigned int)metStripFlag + (unsigned int)metUnifyPaletteFlag > 1) {
+            CrossPlatformCerr << CrossPlatformText("Must provide only one of either -optimize, -dedup, -decimate, -trim, -concat, -reverse, -pingpong, -strip or -unifypalette.")
+                << CrossPlatformText(" Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (needToCaptureOutputFilename || outputFilename.empty()) {
+            CrossPlatformCerr << CrossPlatformText("A filename or filepath for the output GIF must be provided after a -optimize, -dedup, -decimate, -trim, -concat, -reverse, -pingpong, -strip or -unifypalette option.")
+                << CrossPlatformText(" Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (metConcatFlag) {
+            if (unparsedArgs.size() < 2) {
+                CrossPlatformCerr << CrossPlatformText("At least 2 GIF files must be provided with -concat. Add --help or /? option for help.\n");
+                return -1;
+            }
+            for (auto it = unparsedArgs.begin(); it != unparsedArgs.end(); ++it) {
+                if (isSameFile(*it, outputFilename)) {
+                    CrossPlatformCerr << CrossPlatformText("The output file can't be one of the input files ") << *it << CrossPlatformText(", it would get overwritten before it is read.\n");
+                    return -1;
+                }
+            }
+            std::vector<FILE*> inputs;
+            for (auto it = unparsedArgs.begin(); it != unparsedArgs.end(); ++it) {
+                FILE* file = nullptr;
+                if (!crossPlatformOpenFileForReading(&file, *it)) {
+                    for (FILE* input : inputs) fclose(input);
+                    exit(-1);
+                }
+                inputs.push_back(file);
+            }
+            FILE* outputFile = nullptr;
+            if (!crossPlatformCreateFile(&outputFile, outputFilename)) {
+                for (FILE* input : inputs) fclose(input);
+                exit(-1);
+            }
+            beginToolStatsPhase(TOOL_STATS_EXECUTE);
+            struct GIFEdit_response response = concatGIFs(inputs, outputFile);
+            for (FILE* input : inputs) fclose(input);
+            fclose(outputFile);
+            if (response.error == -1) {
+                CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+                exit(-1);
+            }
+            if (response.error != 0) {
+                CrossPlatformCerr << CrossPlatformText("Operation failed. Failed to write the output file.\n");
+                exit(-1);
+            }
+            CrossPlatformCout << CrossPlatformText("Joined ") << response.framesOut << CrossPlatformText(" frames: ") << response.bytesIn
+                << CrossPlatformText(" bytes -> ") << response.bytesOut << CrossPlatformText(" bytes.\n");
+            return 0;
+        }
+        if (metTrimFlag) {
+            int startInt = 0;
+            int endInt = 0;
+            if (!takeFrameRange(unparsedArgs, startInt, endInt)) {
+                CrossPlatformCerr << CrossPlatformText("Failed to parse start-end frame range. Add --help or /? option for help.\n");
+                return -1;
+            }
+            if (startInt < 0 || endInt < 0 || endInt < startInt) {
+                CrossPlatformCerr << CrossPlatformText("Parsed start-end frame range is invalid. Add --help or /? option for help.\n");
+                CrossPlatformCerr << CrossPlatformText("Start: ") << startInt << CrossPlatformText("; End: ") << endInt << std::endl;
+                return -1;
+            }
+            if (unparsedArgs.size() != 1) {
+                CrossPlatformCerr << CrossPlatformText("Can't understand where the filename or file path to the GIF file is - there are some unparsed arguments. Add --help or /? option for help.\n");
+                return -1;
+            }
+            return runGIFEdit(unparsedArgs.front(), outputFilename, [startInt, endInt](FILE* input, FILE* output) {
+                return trimGIF(input, output, startInt, endInt);
+            }, CrossPlatformText("Trimmed, kept"));
+        }
+        if (metDecimateFlag) {
+            if ((unsigned int)metEveryFlag + (unsigned int)metFPSFlag != 1) {
+                CrossPlatformCerr << CrossPlatformText("Must provide exactly one of either -every or -fps with -decimate. Add --help or /? option for help.\n");
+                return -1;
+            }
+            int value = 0;
+            bool parsedValue = false;
+            for (auto it = unparsedArgs.begin(); it != unparsedArgs.end(); ++it) {
+                if (!parseInteger(*it, value)) {
+                    continue;
+                }
+                parsedValue = true;
+                unparsedArgs.erase(it);
+                break;
+            }
+            if (!parsedValue || value <= 0) {
+                CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the ") << (metEveryFlag ? CrossPlatformText("-every") : CrossPlatformText("-fps"))
+                    << CrossPlatformText(" option. Must be a positive number. Add --help or /? option for help.\n");
+                return -1;
+            }
+            if (unparsedArgs.size() != 1) {
+                CrossPlatformCerr << CrossPlatformText("Can't understand where the filename or file path to the GIF file is - there are some unparsed arguments. Add --help or /? option for help.\n");
+                return -1;
+            }
+            const int keepEvery = metEveryFlag ? value : 1;
+            const int fps = metFPSFlag ? value : 0;
+            return runGIFEdit(unparsedArgs.front(), outputFilename, [keepEvery, fps](FILE* input, FILE* output) {
+                return decimateGIF(input, output, keepEvery, fps);
+            }, CrossPlatformText("Decimated, kept"));
+        }
+        int lossyBudget = 0;
+        if (metLossyFlag) {
+            bool parsedValue = false;
+            for (auto it = unparsedArgs.begin(); it != unparsedArgs.end(); ++it) {
+                if (!parseInteger(*it, lossyBudget)) {
+                    continue;
+                }
+                parsedValue = true;
+                unparsedArgs.erase(it);
+                break;
+            }
+            if (!parsedValue || lossyBudget <= 0 || lossyBudget > 441) {
+                CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -lossy option. Must be a number from 1 to 441. Add --help or /? option for help.\n");
+                return -1;
+            }
+        }
+        if (unparsedArgs.size() != 1) {
+            CrossPlatformCerr << CrossPlatformText("Can't understand where the filename or file path to the GIF file is - there are some unparsed arguments. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (metOptimizeFlag && (metLosslessFlag || metLossyFlag)) {
+            int threadCount = (int)std::thread::hardware_concurrency();
+            if (threadCount <= 0) threadCount = 1;
+            if (needToCaptureThreads || (!threadsValue.empty() && (!parseInteger(threadsValue, threadCount) || threadCount <= 0))) {
+                CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -threads option. Must be a positive number. Add --help or /? option for help.\n");
+                return -1;
+            }
+            return runGIFEdit(unparsedArgs.front(), outputFilename, [threadCount, lossyBudget](FILE* input, FILE* output) {
+                return recompressGIF(input, output, threadCount, lossyBudget);
+            }, CrossPlatformText("Recompressed, kept"));
+        }
+        if (metOptimizeFlag) {
+            return runGIFEdit(unparsedArgs.front(), outputFilename, optimizeGIF, CrossPlatformText("Optimized, wrote"));
+        }
+        if (metUnifyPaletteFlag) {
+            return runGIFEdit(unparsedArgs.front(), outputFilename, unifyGIFPalette, CrossPlatformText("Unified palettes, kept"));
+        }
+        if (metStripFlag) {
+            return runGIFEdit(unparsedArgs.front(), outputFilename, stripGIF, CrossPlatformText("Stripped, kept"));
+        }
+        if (metReverseFlag || metPingPongFlag) {
+            const bool pingPong = metPingPongFlag;
+            return runGIFEdit(unparsedArgs.front(), outputFilename, [pingPong](FILE* input, FILE* output) {
+                return reverseGIF(input, output, pingPong);
+            }, pingPong ? CrossPlatformText("Ping-pong, wrote") : CrossPlatformText("Reversed, wrote"));
+        }
+        return runGIFEdit(unparsedArgs.front(), outputFilename, dedupGIF, CrossPlatformText("Merged duplicates, kept"));
+    }
+    if (metFingerprintFlag || metSimilarFlag || metGroupsFlag) {
+        if ((int)metFingerprintFlag + (int)metSimilarFlag + (int)metGroupsFlag > 1 || metTreeFlag) {
+            CrossPlatformCerr << CrossPlatformText("Only one of -fingerprint, -similar, -groups and -tree can be used at a time. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (needToCaptureIndexPath) {
+            CrossPlatformCerr << CrossPlatformText("A file path for the fingerprint index must be provided after the -fingerprint or -similar option.")
+                << CrossPlatformText(" Add --help or /? option for help.\n");
+            return -1;
+        }
+        int threadCount = (int)std::thread::hardware_concurrency();
+        if (threadCount <= 0) threadCount = 1;
+        if (needToCaptureThreads || (!threadsValue.empty() && (!parseInteger(threadsValue, threadCount) || threadCount <= 0))) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -threads option. Must be a positive number. Add --help or /? option for help.\n");
+            return -1;
+        }
+        int maxDistance = FINGERPRINT_DISTANCE;
+        if (needToCaptureDistance || (!distanceValue.empty()
+                && (!parseInteger(distanceValue, maxDistance) || maxDistance < 0 || maxDistance > GIF_FINGERPRINT_MAX_DISTANCE))) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -distance option. Must be a number from 0 to ")
+                << GIF_FINGERPRINT_MAX_DISTANCE << CrossPlatformText(". Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (unparsedArgs.size() != 1) {
+            CrossPlatformCerr << CrossPlatformText("Can't understand where the path is - there are some unparsed arguments. Add --help or /? option for help.\n");
+            return -1;
+        }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        int result;
+        if (metFingerprintFlag) {
+            result = fingerprintGIFTree(unparsedArgs.front(), indexPath, threadCount);
+            if (result == -1) {
+                CrossPlatformPerror(unparsedArgs.front().c_str());
+                CrossPlatformCerr << CrossPlatformText("Failed to read the directory.\n");
+            }
+            else if (result == -2) {
+                CrossPlatformPerror(indexPath.c_str());
+                CrossPlatformCerr << CrossPlatformText("Failed to write the fingerprint index.\n");
+            }
+        }
+        else if (metSimilarFlag) {
+            result = findSimilarGIFs(unparsedArgs.front(), indexPath, maxDistance);
+            if (result == -1) {
+                CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+            }
+            else if (result == -2) {
+                CrossPlatformCerr << CrossPlatformText("Failed to read the GIF or the fingerprint index.\n");
+            }
+        }
+        else {
+            result = groupSimilarGIFs(unparsedArgs.front(), maxDistance, threadCount);
+            if (result != 0) {
+                CrossPlatformPerror(unparsedArgs.front().c_str());
+                CrossPlatformCerr << CrossPlatformText("Failed to read the fingerprint index.\n");
+            }
+        }
+        if (result != 0) {
+            exit(-1);
+        }
+        return 0;
+    }
+    if (metTreeFlag) {
+        GIFTreeOptions options;
+        options.json = metJSONFlag;
+        options.cachePath = cachePath;
+        options.threadCount = (int)std::thread::hardware_concurrency();
+        if (options.threadCount <= 0) options.threadCount = 1;
+        options.readAhead = TREE_READ_AHEAD_FILES;
+        if (needToCaptureCachePath) {
+            CrossPlatformCerr << CrossPlatformText("A file path for the cache must be provided after the -cache option. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (needToCaptureThreads || (!threadsValue.empty() && (!parseInteger(threadsValue, options.threadCount) || options.threadCount <= 0))) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -threads option. Must be a positive number. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (needToCaptureReadAhead || (!readAheadValue.empty() && (!parseInteger(readAheadValue, options.readAhead) || options.readAhead < 0))) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -readahead option. Must be 0 or a positive number. Add --help or /? option for help.\n");
+            return -1;
+        }
+        if (unparsedArgs.size() != 1) {
+            CrossPlatformCerr << CrossPlatformText("A directory path must be provided with -tree option.\n");
+            return -1;
+        }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        if (analyzeGIFTree(unparsedArgs.front(), options) != 0) {
+            CrossPlatformPerror(unparsedArgs.front().c_str());
+            CrossPlatformCerr << CrossPlatformText("Failed to read the directory.\n");
+            exit(-1);
+        }
+        return 0;
+    }
+    if (metProfileFlag) {
+        int topCount = 10;
+        if (metTopFlag) {
+            bool parsedValue = false;
+            for (auto it = unparsedArgs.begin(); it != unparsedArgs.end(); ++it) {
+                if (!parseInteger(*it, topCount)) {
+                    continue;
+                }
+                parsedValue = true;
+                unparsedArgs.erase(it);
+                break;
+            }
+            if (!parsedValue) {
+                CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -top option. Add --help or /? option for help.\n");
+                return -1;
+            }
+        }
+        if (unparsedArgs.size() != 1) {
+            CrossPlatformCerr << CrossPlatformText("Filename or file path must be provided with -profile option.\n");
+            return -1;
+        }
+        FILE* file = nullptr;
+        if (!crossPlatformOpenFileForReading(&file, unparsedArgs.front())) {
+            exit(-1);
+        }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        if (reportGIFProfile(file, topCount) != 0) {
+            CrossPlatformCerr << CrossPlatformText("Reading failed. Invalid GIF format.\n");
+            fclose(file);
+            exit(-1);
+        }
+        fclose(file);
+        return 0;
+    }
     if (metFFlag) {
         if (unparsedArgs.size() != 1) {
             CrossPlatformCerr << CrossPlatformText("Filename or file path must be provided with -f option.\n");
@@ -205,6 +1121,7 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         if (!crossPlatformOpenFile(&file, filename)) {
             exit(-1);
         }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
         int err;
         if (!metUFlag) {
             err = reportGIFDurationDurationsFormat(file);
@@ -247,6 +1164,7 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
             fclose(file);
             exit(-1);
         }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
         struct GIFDuration_response response = changeGIFDurationFile(file, durationsFile);
         if (response.error != 0) {
             CrossPlatformCerr << CrossPlatformText("Operation failed.\n");
@@ -273,27 +1191,7 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         }
         int startInt = 0;
         int endInt = 0;
-        bool startEndParsedSuccessfully = false;
-        for (auto it = unparsedArgs.begin(); it != unparsedArgs.end(); ++it) {
-            int pos = findChar(*it, CrossPlatformText('-'));
-            if (pos != -1) {
-                std::vector<CrossPlatformString> parts = split(*it, CrossPlatformText('-'));
-                bool successParsing = true;
-                if (parts.size() != 2) {
-                    continue;
-                }
-                if (!parseInteger(parts[0], startInt)) {
-                    continue;
-                }
-                if (!parseInteger(parts[1], endInt)) {
-                    continue;
-                }
-                startEndParsedSuccessfully = true;
-                unparsedArgs.erase(it);
-                break;
-            }
-        }
-        if (!startEndParsedSuccessfully) {
+        if (!takeFrameRange(unparsedArgs, startInt, endInt)) {
             CrossPlatformCerr << CrossPlatformText("Failed to parse start-end frame range. Add --help or /? option for help.\n");
             exit(-1);
         }
@@ -332,6 +1230,7 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         if (!crossPlatformOpenFile(&file, unparsedArgs.front())) {
             exit(-1);
         }
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
         struct GIFDuration_response response = changeGIFDurationRange(file, start, end, valueToSet);
         int returnCode = 0;
         if (response.error != 0) {
@@ -0,0 +1,92 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+/**
+* A queue connecting two pipeline stages. push() blocks while the queue holds maxSize items,
+* pop() blocks while it's empty. After close() is called pop() drains what's left and then returns false.
+* Items are kept in a ring buffer allocated once, so pushing and popping never allocates.
+*/
+template<typename T>
+class BoundedQueue {
+public:
+	BoundedQueue(size_t maxSize) : items(maxSize), maxSize(maxSize) { }
+
+	// Returns false if the queue got closed and the item was not added.
+	bool push(T&& item) {
+		std::unique_lock<std::mutex> guard(mutex);
+		notFull.wait(guard, [this]{ return closed || count < maxSize; });
+		if (closed) return false;
+		items[(first + count) % maxSize] = std::move(item);
+		++count;
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// Returns false if the queue is closed and there's nothing left in it.
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> guard(mutex);
+		notEmpty.wait(guard, [this]{ return closed || count > 0; });
+		if (count == 0) return false;
+		item = std::move(items[first]);
+		first = (first + 1) % maxSize;
+		--count;
+		notFull.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::unique_lock<std::mutex> guard(mutex);
+		closed = true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	std::vector<T> items;
+	size_t first = 0; // where the oldest item is
+	size_t count = 0;
+	size_t maxSize;
+	bool closed = false;
+};
+
+/**
+* Limits how many frames are in flight across all stages at once. The first stage acquire()s a slot before
+* loading a frame and the last stage release()s it once the frame is written out, so memory stays proportional to
+* the slot count no matter how long the sequence is.
+*/
+class InFlightLimiter {
+public:
+	InFlightLimiter(size_t maxInFlight) : available(maxInFlight) { }
+
+	// Returns false if cancel() was called.
+	bool acquire() {
+		std::unique_lock<std::mutex> guard(mutex);
+		slotFreed.wait(guard, [this]{ return cancelled || available > 0; });
+		if (cancelled) return false;
+		--available;
+		return true;
+	}
+
+	void release() {
+		std::unique_lock<std::mutex> guard(mutex);
+		++available;
+		slotFreed.notify_one();
+	}
+
+	void cancel() {
+		std::unique_lock<std::mutex> guard(mutex);
+		cancelled = true;
+		slotFreed.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable slotFreed;
+	size_t available;
+	bool cancelled = false;
+};
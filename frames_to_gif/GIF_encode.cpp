@@ -0,0 +1,446 @@
+#include "GIF_encode.h"
+#include <string.h>
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GIF_ENCODE_SSE2
+#endif
+
+// This file is copy-pasted between the frames_to_gif and change_gif_durations projects. Keep the copies identical.
+
+/**
+* Fills the palette with a 6x7x6 RGB cube (252 colors), three extra grays and reserves index 255 for transparency.
+*/
+void makeDefaultGIFPalette(GIFPalette& palette)
+{
+	memset(palette.colors, 0, sizeof(palette.colors));
+	int index = 0;
+	for (int r = 0; r < 6; ++r) {
+		for (int g = 0; g < 7; ++g) {
+			for (int b = 0; b < 6; ++b) {
+				palette.colors[index * 3] = (unsigned char)(r * 255 / 5);
+				palette.colors[index * 3 + 1] = (unsigned char)(g * 255 / 6);
+				palette.colors[index * 3 + 2] = (unsigned char)(b * 255 / 5);
+				++index;
+			}
+		}
+	}
+	for (int gray = 64; gray < 256; gray += 64) {
+		palette.colors[index * 3] = palette.colors[index * 3 + 1] = palette.colors[index * 3 + 2] = (unsigned char)gray;
+		++index;
+	}
+	palette.bitsPerPixel = 8;
+	palette.transparentIndex = 255;
+}
+
+/**
+* Function finds the nearest palette color to each cell of the lookup cache.
+* Runs once per palette: 65536 cells against up to 256 colors, 4 colors at a time with SSE2 when available.
+* The transparent index is never picked.
+*/
+void buildGIFPaletteLookup(const GIFPalette& palette, GIFPaletteLookup& lookup)
+{
+	// structure-of-arrays copy of the palette, padded to a multiple of 4 with colors too far away to ever win
+	alignas(16) float paletteR[256];
+	alignas(16) float paletteG[256];
+	alignas(16) float paletteB[256];
+	const int colorCount = 1 << palette.bitsPerPixel;
+	const int paddedCount = (colorCount + 3) & ~3;
+	for (int c = 0; c < paddedCount; ++c) {
+		if (c >= colorCount || c == palette.transparentIndex) {
+			paletteR[c] = paletteG[c] = paletteB[c] = 100000.F;
+			continue;
+		}
+		paletteR[c] = palette.colors[c * 3];
+		paletteG[c] = palette.colors[c * 3 + 1];
+		paletteB[c] = palette.colors[c * 3 + 2];
+	}
+
+	for (int cell = 0; cell < (1 << 16); ++cell) {
+		float r = (float)(((cell >> 11) << 3) | 4);
+		float g = (float)((((cell >> 5) & 0x3F) << 2) | 2);
+		float b = (float)(((cell & 0x1F) << 3) | 4);
+		int bestIndex = 0;
+#ifdef GIF_ENCODE_SSE2
+		__m128 cr = _mm_set1_ps(r);
+		__m128 cg = _mm_set1_ps(g);
+		__m128 cb = _mm_set1_ps(b);
+		__m128 bestDistance = _mm_set1_ps(1e30F);
+		__m128i bestIndices = _mm_setzero_si128();
+		__m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+		const __m128i four = _mm_set1_epi32(4);
+		for (int c = 0; c < paddedCount; c += 4) {
+			__m128 dr = _mm_sub_ps(_mm_load_ps(paletteR + c), cr);
+			__m128 dg = _mm_sub_ps(_mm_load_ps(paletteG + c), cg);
+			__m128 db = _mm_sub_ps(_mm_load_ps(paletteB + c), cb);
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, bestDistance));
+			bestDistance = _mm_min_ps(distance, bestDistance);
+			bestIndices = _mm_or_si128(_mm_and_si128(closer, indices), _mm_andnot_si128(closer, bestIndices));
+			indices = _mm_add_epi32(indices, four);
+		}
+		alignas(16) float laneDistance[4];
+		alignas(16) int laneIndex[4];
+		_mm_store_ps(laneDistance, bestDistance);
+		_mm_store_si128((__m128i*)laneIndex, bestIndices);
+		float best = laneDistance[0];
+		bestIndex = laneIndex[0];
+		for (int lane = 1; lane < 4; ++lane) {
+			if (laneDistance[lane] < best || (laneDistance[lane] == best && laneIndex[lane] < bestIndex)) {
+				best = laneDistance[lane];
+				bestIndex = laneIndex[lane];
+			}
+		}
+#else
+		float best = 1e30F;
+		for (int c = 0; c < paddedCount; ++c) {
+			float dr = paletteR[c] - r;
+			float dg = paletteG[c] - g;
+			float db = paletteB[c] - b;
+			float distance = dr * dr + dg * dg + db * db;
+			if (distance < best) {
+				best = distance;
+				bestIndex = c;
+			}
+		}
+#endif
+		lookup.cells[cell] = (unsigned char)bestIndex;
+	}
+}
+
+/**
+* Function converts RGBA pixels to palette indices through the lookup cache.
+* Pixels with alpha below 128 get the palette's transparent index, if it has one.
+* Cache keys and the alpha test are computed for 4 pixels at a time with SSE2 when available.
+* Returns true if at least one pixel got mapped to the transparent index.
+*/
+bool mapRGBAToGIFPalette(const unsigned char* rgba, size_t pixelCount, const GIFPalette& palette, const GIFPaletteLookup& lookup, unsigned char* indices)
+{
+	const bool canBeTransparent = palette.transparentIndex != -1;
+	const unsigned char transparentIndex = (unsigned char)palette.transparentIndex;
+	bool hasTransparency = false;
+	size_t i = 0;
+#ifdef GIF_ENCODE_SSE2
+	const __m128i mask5 = _mm_set1_epi32(0x1F);
+	const __m128i mask6 = _mm_set1_epi32(0x3F);
+	const __m128i alphaThreshold = _mm_set1_epi32(128);
+	alignas(16) int keys[4];
+	alignas(16) int transparent[4];
+	for (; i + 4 <= pixelCount; i += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(rgba + i * 4));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 3), mask5);
+		__m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 10), mask6);
+		__m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 19), mask5);
+		__m128i key = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 11), _mm_slli_epi32(g, 5)), b);
+		_mm_store_si128((__m128i*)keys, key);
+		indices[i] = lookup.cells[keys[0]];
+		indices[i + 1] = lookup.cells[keys[1]];
+		indices[i + 2] = lookup.cells[keys[2]];
+		indices[i + 3] = lookup.cells[keys[3]];
+		if (canBeTransparent) {
+			__m128i isTransparent = _mm_cmplt_epi32(_mm_srli_epi32(pixels, 24), alphaThreshold);
+			if (_mm_movemask_epi8(isTransparent) != 0) {
+				_mm_store_si128((__m128i*)transparent, isTransparent);
+				for (int lane = 0; lane < 4; ++lane) {
+					if (transparent[lane]) indices[i + lane] = transparentIndex;
+				}
+				hasTransparency = true;
+			}
+		}
+	}
+#endif
+	for (; i < pixelCount; ++i) {
+		const unsigned char* pixel = rgba + i * 4;
+		if (canBeTransparent && pixel[3] < 128) {
+			indices[i] = transparentIndex;
+			hasTransparency = true;
+			continue;
+		}
+		indices[i] = lookup.cells[(pixel[0] >> 3) << 11 | (pixel[1] >> 2) << 5 | pixel[2] >> 3];
+	}
+	return hasTransparency;
+}
+
+// Packs variable-length codes LSB-first straight into the output as data sub-blocks.
+// Each sub-block's length byte is reserved up front and filled in once the block is full or the data ends.
+struct GIFCodeWriter {
+	std::vector<unsigned char>& out;
+	size_t blockStart; // position of the current sub-block's length byte
+	unsigned int bitBuf;
+	int bitCount;
+
+	GIFCodeWriter(std::vector<unsigned char>& out) : out(out), blockStart(out.size()), bitBuf(0), bitCount(0) {
+		out.push_back(0);
+	}
+
+	void put(int code, int codeSize) {
+		bitBuf |= (unsigned int)code << bitCount;
+		bitCount += codeSize;
+		while (bitCount >= 8) {
+			pushByte((unsigned char)(bitBuf & 0xFF));
+			bitBuf >>= 8;
+			bitCount -= 8;
+		}
+	}
+
+	void pushByte(unsigned char byte) {
+		out.push_back(byte);
+		if (out.size() - blockStart == 256) {
+			out[blockStart] = 255;
+			blockStart = out.size();
+			out.push_back(0);
+		}
+	}
+
+	void finish() {
+		if (bitCount > 0) pushByte((unsigned char)(bitBuf & 0xFF));
+		bitBuf = 0;
+		bitCount = 0;
+		size_t blockSize = out.size() - blockStart - 1;
+		if (blockSize != 0) {
+			out[blockStart] = (unsigned char)blockSize;
+			out.push_back(0); // block terminator
+		}
+		// otherwise the reserved length byte, left at 0, is the block terminator
+	}
+};
+
+/**
+* Function fills the tables lossy encoding looks colors up in: the distance between every two colors of the palette
+* and, for each color, the closest other colors that are at most budget away.
+* The transparent index is never near any other color, so transparency never changes.
+* @param colors colorCount RGB triplets
+* @param transparentIndex -1 if none
+* @param budget Largest RGB distance (0 to 441) a pixel may be changed by
+*/
+void buildGIFLossyPalette(const unsigned char* colors, int colorCount, int transparentIndex, int budget, GIFLossyPalette& lossy)
+{
+	for (int a = 0; a < 256; ++a) {
+		lossy.nearCount[a] = 0;
+		for (int b = 0; b < 256; ++b) {
+			if (a == b) {
+				lossy.distance[a][b] = 0;
+				continue;
+			}
+			if (a >= colorCount || b >= colorCount || a == transparentIndex || b == transparentIndex) {
+				lossy.distance[a][b] = GIF_LOSSY_FAR;
+				continue;
+			}
+			const int dr = colors[a * 3] - colors[b * 3];
+			const int dg = colors[a * 3 + 1] - colors[b * 3 + 1];
+			const int db = colors[a * 3 + 2] - colors[b * 3 + 2];
+			lossy.distance[a][b] = (unsigned int)(dr * dr + dg * dg + db * db);
+		}
+	}
+	const unsigned int squaredBudget = (unsigned int)budget * (unsigned int)budget;
+	for (int a = 0; a < colorCount && a < 256; ++a) {
+		// insertion into a short list sorted by distance, the farthest candidate drops off the end
+		int count = 0;
+		for (int b = 0; b < colorCount && b < 256; ++b) {
+			const unsigned int distance = lossy.distance[a][b];
+			if (b == a || distance > squaredBudget) continue;
+			int position = count < GIF_LOSSY_CANDIDATES ? count++ : GIF_LOSSY_CANDIDATES;
+			while (position > 0 && lossy.distance[a][lossy.near[a][position - 1]] > distance) {
+				if (position < GIF_LOSSY_CANDIDATES) lossy.near[a][position] = lossy.near[a][position - 1];
+				--position;
+			}
+			if (position < GIF_LOSSY_CANDIDATES) lossy.near[a][position] = (unsigned char)b;
+		}
+		lossy.nearCount[a] = (unsigned char)count;
+	}
+}
+
+// With GIF_CLEAR_DEFERRED, how many pixels go between checks whether the full table still compresses well enough
+#define GIF_LZW_DEFERRED_CHECK_PIXELS 4096
+
+/**
+* Function LZW-compresses palette indices into GIF Table Based Image Data:
+* the LZW Minimum Code Size byte followed by data sub-blocks and the block terminator, appended to out.
+* When the code table fills up, what happens depends on clearStrategy. Wiping the table is a single 32 KB memset.
+* With lossy, a string that can't be extended with the next pixel is extended with a color near it instead, if the table has
+* such a string, so strings get longer and there are fewer codes. Each pixel changes by at most the budget lossy was built with.
+* @param minCodeSize LZW Minimum Code Size, 2 to 8. All indices must be less than 1 << minCodeSize
+* @param out Gets appended to. Pass the same vector for every frame to avoid reallocating it
+* @param lossy NULL to keep every pixel exact
+*/
+void encodeGIFImageData(GIFEncoder& encoder, const unsigned char* indices, size_t pixelCount, int minCodeSize, std::vector<unsigned char>& out,
+	GIFClearStrategy clearStrategy, const GIFLossyPalette* lossy)
+{
+	out.push_back((unsigned char)minCodeSize);
+	GIFCodeWriter writer(out);
+	unsigned int* const table = encoder.lzwTable;
+	const int clearCode = 1 << minCodeSize;
+	const int endCode = clearCode + 1;
+	int codeSize = minCodeSize + 1;
+	int nextCode = clearCode + 2;
+	memset(table, 0, sizeof(encoder.lzwTable));
+	// for GIF_CLEAR_DEFERRED: bits written and pixels coded since the last clear, and the same counts at the moment the table filled up
+	unsigned long long bits = 0;
+	size_t pixels = 0;
+	unsigned long long bitsWhenFull = 0;
+	size_t pixelsWhenFull = 0;
+	size_t nextCheck = 0;
+
+	writer.put(clearCode, codeSize);
+	if (pixelCount != 0) {
+		unsigned int prefix = indices[0];
+		size_t prefixStart = 0;
+		for (size_t i = 1; i < pixelCount; ++i) {
+			unsigned int key = prefix << 8 | indices[i];
+			unsigned int slot = (key * 2654435761U) >> (32 - GIF_LZW_HASH_BITS);
+			unsigned int entry;
+			while ((entry = table[slot]) != 0) {
+				if (entry >> 12 == key) break;
+				slot = (slot + 1) & (GIF_LZW_HASH_SIZE - 1);
+			}
+			if (entry != 0) {
+				prefix = entry & 0xFFF;
+				continue;
+			}
+			if (lossy) {
+				const unsigned char* near = lossy->near[indices[i]];
+				const int nearCount = lossy->nearCount[indices[i]];
+				unsigned int nearEntry = 0;
+				for (int k = 0; k < nearCount && nearEntry == 0; ++k) {
+					unsigned int nearKey = prefix << 8 | near[k];
+					unsigned int nearSlot = (nearKey * 2654435761U) >> (32 - GIF_LZW_HASH_BITS);
+					while ((nearEntry = table[nearSlot]) != 0) {
+						if (nearEntry >> 12 == nearKey) break;
+						nearSlot = (nearSlot + 1) & (GIF_LZW_HASH_SIZE - 1);
+					}
+				}
+				if (nearEntry != 0) {
+					prefix = nearEntry & 0xFFF;
+					continue;
+				}
+			}
+			writer.put(prefix, codeSize);
+			if (clearStrategy == GIF_CLEAR_WHEN_FULL) {
+				int newCode = nextCode++;
+				if (newCode == 4095) {
+					writer.put(clearCode, codeSize);
+					memset(table, 0, sizeof(encoder.lzwTable));
+					codeSize = minCodeSize + 1;
+					nextCode = clearCode + 2;
+				}
+				else {
+					table[slot] = key << 12 | newCode;
+					if (newCode >= (1 << codeSize)) ++codeSize;
+				}
+			}
+			else {
+				bits += codeSize;
+				pixels += i - prefixStart;
+				prefixStart = i;
+				if (nextCode < 4096) {
+					int newCode = nextCode++;
+					table[slot] = key << 12 | newCode;
+					if (newCode >= (1 << codeSize) && codeSize < 12) ++codeSize;
+					if (nextCode == 4096) {
+						bitsWhenFull = bits;
+						pixelsWhenFull = pixels;
+						nextCheck = pixels + GIF_LZW_DEFERRED_CHECK_PIXELS;
+					}
+				}
+				else if (pixels >= nextCheck) {
+					// bits per pixel since the table filled up, against bits per pixel while it was filling up
+					if ((bits - bitsWhenFull) * pixelsWhenFull > bitsWhenFull * (pixels - pixelsWhenFull)) {
+						writer.put(clearCode, codeSize);
+						memset(table, 0, sizeof(encoder.lzwTable));
+						codeSize = minCodeSize + 1;
+						nextCode = clearCode + 2;
+						bits = 0;
+						pixels = 0;
+					}
+					else {
+						nextCheck = pixels + GIF_LZW_DEFERRED_CHECK_PIXELS;
+					}
+				}
+			}
+			prefix = indices[i];
+		}
+		writer.put(prefix, codeSize);
+	}
+	writer.put(endCode, codeSize);
+	writer.finish();
+}
+
+static void writeLittleEndian16(std::vector<unsigned char>& out, int value) {
+	out.push_back((unsigned char)(value & 0xFF));
+	out.push_back((unsigned char)((value >> 8) & 0xFF));
+}
+
+/**
+* Function writes the GIF89a header, the Screen Descriptor, the Global Color Map if there is one
+* and the NETSCAPE2.0 looping extension.
+* @param loopCount 0 to loop forever, -1 to not write the looping extension at all (plays once)
+*/
+void writeGIFHeader(std::vector<unsigned char>& out, int width, int height, const GIFPalette* globalPalette, int loopCount)
+{
+	static const char signature[6] = { 'G', 'I', 'F', '8', '9', 'a' };
+	out.insert(out.end(), signature, signature + 6);
+	writeLittleEndian16(out, width);
+	writeLittleEndian16(out, height);
+	if (globalPalette) {
+		int bits = globalPalette->bitsPerPixel - 1;
+		out.push_back((unsigned char)(0x80 | (bits << 4) | bits));
+	}
+	else {
+		out.push_back(0x70);
+	}
+	out.push_back(0); // background color index
+	out.push_back(0); // pixel aspect ratio
+	if (globalPalette) {
+		out.insert(out.end(), globalPalette->colors, globalPalette->colors + (1 << globalPalette->bitsPerPixel) * 3);
+	}
+	if (loopCount >= 0) {
+		static const char netscape[11] = { 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0' };
+		out.push_back(0x21);
+		out.push_back(0xFF);
+		out.push_back(11);
+		out.insert(out.end(), netscape, netscape + 11);
+		out.push_back(3);
+		out.push_back(1);
+		writeLittleEndian16(out, loopCount);
+		out.push_back(0);
+	}
+}
+
+/**
+* Function writes one frame: the Graphic Control Extension, the Image Descriptor, the local color table
+* if there is one and the compressed image data.
+* @param indices params.width * params.height palette indices
+*/
+void writeGIFFrame(GIFEncoder& encoder, std::vector<unsigned char>& out, const GIFFrameParams& params, const unsigned char* indices)
+{
+	out.push_back(0x21);
+	out.push_back(0xF9);
+	out.push_back(4);
+	out.push_back((unsigned char)((params.disposal & 0x07) << 2 | (params.transparentIndex != -1 ? 1 : 0)));
+	writeLittleEndian16(out, params.delay);
+	out.push_back((unsigned char)(params.transparentIndex != -1 ? params.transparentIndex : 0));
+	out.push_back(0);
+
+	out.push_back(0x2C);
+	writeLittleEndian16(out, params.left);
+	writeLittleEndian16(out, params.top);
+	writeLittleEndian16(out, params.width);
+	writeLittleEndian16(out, params.height);
+	int bitsPerPixel = params.globalBitsPerPixel;
+	if (params.localPalette) {
+		bitsPerPixel = params.localPalette->bitsPerPixel;
+		out.push_back((unsigned char)(0x80 | (bitsPerPixel - 1)));
+		out.insert(out.end(), params.localPalette->colors, params.localPalette->colors + (1 << bitsPerPixel) * 3);
+	}
+	else {
+		out.push_back(0);
+	}
+
+	int minCodeSize = bitsPerPixel < 2 ? 2 : bitsPerPixel;
+	encodeGIFImageData(encoder, indices, (size_t)params.width * params.height, minCodeSize, out);
+}
+
+void writeGIFTrailer(std::vector<unsigned char>& out)
+{
+	out.push_back(0x3B);
+}
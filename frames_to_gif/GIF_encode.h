@@ -0,0 +1,85 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+// This file is copy-pasted between the frames_to_gif and change_gif_durations projects. Keep the copies identical.
+
+struct GIFPalette {
+	unsigned char colors[256 * 3];
+	int bitsPerPixel; // the table holds 1 << bitsPerPixel colors, 1 to 8
+	int transparentIndex; // -1 if none
+};
+
+#define GIF_LZW_HASH_BITS 13
+#define GIF_LZW_HASH_SIZE (1 << GIF_LZW_HASH_BITS)
+
+/**
+* Per-thread encoder state, reused for every frame the thread encodes.
+* lzwTable is an open-addressing hash table mapping (prefix code, next index) to the code of that string.
+* Each entry is (prefix << 8 | index) << 12 | code, 0 means the slot is empty.
+* GIF never has more than 4096 codes, so an 8192-slot table stays at most half full and probe chains stay short,
+* and at 32 KB it fits in L2 (usually even L1) cache, unlike a 4096x256 child table.
+*/
+struct GIFEncoder {
+	unsigned int lzwTable[GIF_LZW_HASH_SIZE];
+};
+
+// What encodeGIFImageData does when the code table fills up
+enum GIFClearStrategy {
+	GIF_CLEAR_WHEN_FULL, // emit a clear code and start over. Does well when the image keeps changing
+	GIF_CLEAR_DEFERRED // keep coding with the full table, and clear only once it compresses worse than it did while it was filling up.
+	                   // Does well on repetitive images
+};
+
+// With lossy encoding, how many near-enough colors are tried for each color, nearest first
+#define GIF_LOSSY_CANDIDATES 16
+
+/**
+* Per-palette tables for lossy encoding, built by buildGIFLossyPalette.
+* distance[a][b] is the squared RGB distance between colors a and b, or GIF_LOSSY_FAR if either is transparent or outside the palette.
+* Squared, so that it's exact and compares against the squared budget without rounding letting a pixel go over it.
+* near[i] lists the nearCount[i] other colors within the error budget of color i, nearest first.
+*/
+#define GIF_LOSSY_FAR 0xFFFFFFFFU
+struct GIFLossyPalette {
+	unsigned int distance[256][256];
+	unsigned char near[256][GIF_LOSSY_CANDIDATES];
+	unsigned char nearCount[256];
+};
+
+/**
+* Maps colors to palette indices at 5-6-5 bits per channel precision.
+* cells[r >> 3 << 11 | g >> 2 << 5 | b >> 3] is the palette index nearest to the center of that cell.
+*/
+struct GIFPaletteLookup {
+	unsigned char cells[1 << 16];
+};
+
+struct GIFFrameParams {
+	int left;
+	int top;
+	int width;
+	int height;
+	int delay; // in 1/100 of a second, as stored in the Graphic Control Extension
+	int disposal; // 0-3, see GIF89a spec
+	int transparentIndex; // -1 if none
+	const GIFPalette* localPalette; // NULL to use the Global Color Map
+	int globalBitsPerPixel; // bits per pixel of the Global Color Map, used when localPalette is NULL
+};
+
+void makeDefaultGIFPalette(GIFPalette& palette);
+
+void buildGIFPaletteLookup(const GIFPalette& palette, GIFPaletteLookup& lookup);
+
+bool mapRGBAToGIFPalette(const unsigned char* rgba, size_t pixelCount, const GIFPalette& palette, const GIFPaletteLookup& lookup, unsigned char* indices);
+
+void buildGIFLossyPalette(const unsigned char* colors, int colorCount, int transparentIndex, int budget, GIFLossyPalette& lossy);
+
+void encodeGIFImageData(GIFEncoder& encoder, const unsigned char* indices, size_t pixelCount, int minCodeSize, std::vector<unsigned char>& out,
+	GIFClearStrategy clearStrategy = GIF_CLEAR_WHEN_FULL, const GIFLossyPalette* lossy = NULL);
+
+void writeGIFHeader(std::vector<unsigned char>& out, int width, int height, const GIFPalette* globalPalette, int loopCount);
+
+void writeGIFFrame(GIFEncoder& encoder, std::vector<unsigned char>& out, const GIFFrameParams& params, const unsigned char* indices);
+
+void writeGIFTrailer(std::vector<unsigned char>& out);
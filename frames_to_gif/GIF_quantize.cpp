@@ -0,0 +1,300 @@
+#include "GIF_quantize.h"
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GIF_QUANTIZE_SSE2
+#endif
+
+// below this many cells a k-means pass takes less time than starting threads for it
+#define GIF_QUANTIZE_CELLS_PER_THREAD 4096
+
+void clearGIFColorHistogram(GIFColorHistogram& histogram)
+{
+	if (histogram.cells.empty()) {
+		histogram.cells.assign(1 << 16, GIFColorCell());
+	} else {
+		for (int cell : histogram.occupied) {
+			histogram.cells[cell] = GIFColorCell();
+		}
+	}
+	histogram.occupied.clear();
+}
+
+/**
+* Function counts the opaque pixels (alpha 128 or more, same as mapRGBAToGIFPalette) into the histogram.
+* The histogram must have been cleared at least once.
+*/
+void addRGBAToGIFColorHistogram(const unsigned char* rgba, size_t pixelCount, GIFColorHistogram& histogram)
+{
+	GIFColorCell* cells = histogram.cells.data();
+	for (size_t i = 0; i < pixelCount; ++i) {
+		const unsigned char* pixel = rgba + i * 4;
+		if (pixel[3] < 128) continue;
+		const int key = (pixel[0] >> 3) << 11 | (pixel[1] >> 2) << 5 | pixel[2] >> 3;
+		GIFColorCell& cell = cells[key];
+		if (cell.count == 0) histogram.occupied.push_back(key);
+		++cell.count;
+		cell.r += pixel[0];
+		cell.g += pixel[1];
+		cell.b += pixel[2];
+	}
+}
+
+/**
+* Function adds all the histograms into the first one.
+* Each thread merges its own range of cells from every histogram, so no two threads write the same cell.
+*/
+void mergeGIFColorHistograms(std::vector<GIFColorHistogram>& histograms, int threadCount)
+{
+	GIFColorHistogram& total = histograms[0];
+	auto mergeRange = [&histograms, &total](int from, int to) {
+		for (size_t h = 1; h < histograms.size(); ++h) {
+			const GIFColorCell* cells = histograms[h].cells.data();
+			for (int cell = from; cell < to; ++cell) {
+				total.cells[cell].count += cells[cell].count;
+				total.cells[cell].r += cells[cell].r;
+				total.cells[cell].g += cells[cell].g;
+				total.cells[cell].b += cells[cell].b;
+			}
+		}
+	};
+	if (threadCount < 1) threadCount = 1;
+	std::vector<std::thread> threads;
+	for (int t = 1; t < threadCount; ++t) {
+		threads.emplace_back(mergeRange, (1 << 16) * t / threadCount, (1 << 16) * (t + 1) / threadCount);
+	}
+	mergeRange(0, (1 << 16) / threadCount);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	total.occupied.clear();
+	for (int cell = 0; cell < (1 << 16); ++cell) {
+		if (total.cells[cell].count != 0) total.occupied.push_back(cell);
+	}
+}
+
+static void measureGIFQuantizeBox(const std::vector<GIFQuantizeEntry>& entries, GIFQuantizeBox& box)
+{
+	double weight = 0.;
+	double sum[3] = { 0., 0., 0. };
+	double squares[3] = { 0., 0., 0. };
+	for (int i = box.begin; i < box.end; ++i) {
+		const GIFQuantizeEntry& entry = entries[i];
+		weight += entry.weight;
+		for (int c = 0; c < 3; ++c) {
+			sum[c] += (double)entry.weight * entry.color[c];
+			squares[c] += (double)entry.weight * entry.color[c] * entry.color[c];
+		}
+	}
+	box.error = 0.;
+	box.axis = 0;
+	double largest = -1.;
+	for (int c = 0; c < 3; ++c) {
+		box.mean[c] = (float)(sum[c] / weight);
+		double error = squares[c] - sum[c] * sum[c] / weight;
+		if (error < 0.) error = 0.;
+		box.error += error;
+		if (error > largest) {
+			largest = error;
+			box.axis = c;
+		}
+	}
+}
+
+/**
+* Function finds the nearest of paddedCount colors, stored as structure of arrays padded to a multiple of 4,
+* 4 colors at a time with SSE2 when available. Ties go to the lower index.
+*/
+static int findNearestGIFQuantizeColor(const float* paletteR, const float* paletteG, const float* paletteB, int paddedCount, const float* color)
+{
+#ifdef GIF_QUANTIZE_SSE2
+	__m128 cr = _mm_set1_ps(color[0]);
+	__m128 cg = _mm_set1_ps(color[1]);
+	__m128 cb = _mm_set1_ps(color[2]);
+	__m128 bestDistance = _mm_set1_ps(1e30F);
+	__m128i bestIndices = _mm_setzero_si128();
+	__m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i four = _mm_set1_epi32(4);
+	for (int c = 0; c < paddedCount; c += 4) {
+		__m128 dr = _mm_sub_ps(_mm_load_ps(paletteR + c), cr);
+		__m128 dg = _mm_sub_ps(_mm_load_ps(paletteG + c), cg);
+		__m128 db = _mm_sub_ps(_mm_load_ps(paletteB + c), cb);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+		__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, bestDistance));
+		bestDistance = _mm_min_ps(distance, bestDistance);
+		bestIndices = _mm_or_si128(_mm_and_si128(closer, indices), _mm_andnot_si128(closer, bestIndices));
+		indices = _mm_add_epi32(indices, four);
+	}
+	alignas(16) float laneDistance[4];
+	alignas(16) int laneIndex[4];
+	_mm_store_ps(laneDistance, bestDistance);
+	_mm_store_si128((__m128i*)laneIndex, bestIndices);
+	float best = laneDistance[0];
+	int bestIndex = laneIndex[0];
+	for (int lane = 1; lane < 4; ++lane) {
+		if (laneDistance[lane] < best || (laneDistance[lane] == best && laneIndex[lane] < bestIndex)) {
+			best = laneDistance[lane];
+			bestIndex = laneIndex[lane];
+		}
+	}
+	return bestIndex;
+#else
+	float best = 1e30F;
+	int bestIndex = 0;
+	for (int c = 0; c < paddedCount; ++c) {
+		float dr = paletteR[c] - color[0];
+		float dg = paletteG[c] - color[1];
+		float db = paletteB[c] - color[2];
+		float distance = dr * dr + dg * dg + db * db;
+		if (distance < best) {
+			best = distance;
+			bestIndex = c;
+		}
+	}
+	return bestIndex;
+#endif
+}
+
+/**
+* Function makes a palette of up to maxColors colors (at most GIF_QUANTIZE_MAX_COLORS) for the pixels in the histogram,
+* with the transparent index right after the last color, and fills the lookup cells of the occupied histogram cells.
+* Median cut splits the cell that adds the most squared error along its widest channel at the weighted median,
+* then a few k-means passes move each color to the mean of the cells nearest to it.
+* The k-means passes split the cells between threadCount threads, each adding into its own sums, merged after.
+* The sums are whole numbers, so the palette comes out the same whatever threadCount is.
+*/
+void quantizeGIFColorHistogram(GIFColorHistogram& histogram, int maxColors, int threadCount, GIFPalette& palette, GIFPaletteLookup& lookup)
+{
+	if (maxColors > GIF_QUANTIZE_MAX_COLORS) maxColors = GIF_QUANTIZE_MAX_COLORS;
+	if (maxColors < 1) maxColors = 1;
+	std::vector<int>& occupied = histogram.occupied;
+	std::sort(occupied.begin(), occupied.end());
+	std::vector<GIFQuantizeEntry>& entries = histogram.entries;
+	entries.resize(occupied.size());
+	for (size_t i = 0; i < occupied.size(); ++i) {
+		const GIFColorCell& cell = histogram.cells[occupied[i]];
+		entries[i].color[0] = (float)((double)cell.r / cell.count);
+		entries[i].color[1] = (float)((double)cell.g / cell.count);
+		entries[i].color[2] = (float)((double)cell.b / cell.count);
+		entries[i].weight = (float)cell.count;
+		entries[i].cell = occupied[i];
+		entries[i].sums = &cell;
+	}
+
+	std::vector<GIFQuantizeBox>& boxes = histogram.boxes;
+	boxes.clear();
+	if (!entries.empty()) {
+		GIFQuantizeBox box;
+		box.begin = 0;
+		box.end = (int)entries.size();
+		measureGIFQuantizeBox(entries, box);
+		boxes.push_back(box);
+	}
+	while ((int)boxes.size() < maxColors) {
+		int worst = -1;
+		for (size_t b = 0; b < boxes.size(); ++b) {
+			if (boxes[b].end - boxes[b].begin > 1 && boxes[b].error > 0. && (worst == -1 || boxes[b].error > boxes[worst].error)) {
+				worst = (int)b;
+			}
+		}
+		if (worst == -1) break;
+		GIFQuantizeBox& box = boxes[worst];
+		const int axis = box.axis;
+		std::sort(entries.begin() + box.begin, entries.begin() + box.end, [axis](const GIFQuantizeEntry& a, const GIFQuantizeEntry& b) {
+			return a.color[axis] < b.color[axis] || (a.color[axis] == b.color[axis] && a.cell < b.cell);
+		});
+		double total = 0.;
+		for (int i = box.begin; i < box.end; ++i) total += entries[i].weight;
+		double below = 0.;
+		int split = box.begin + 1;
+		for (int i = box.begin; i < box.end - 1; ++i) {
+			below += entries[i].weight;
+			split = i + 1;
+			if (below * 2. >= total) break;
+		}
+		GIFQuantizeBox upper;
+		upper.begin = split;
+		upper.end = box.end;
+		box.end = split;
+		measureGIFQuantizeBox(entries, box);
+		measureGIFQuantizeBox(entries, upper);
+		boxes.push_back(upper);
+	}
+
+	const int colorCount = boxes.empty() ? 1 : (int)boxes.size();
+	const int paddedCount = (colorCount + 3) & ~3;
+	alignas(16) float paletteR[256];
+	alignas(16) float paletteG[256];
+	alignas(16) float paletteB[256];
+	for (int c = 0; c < paddedCount; ++c) {
+		paletteR[c] = paletteG[c] = paletteB[c] = 100000.F;
+	}
+	for (int c = 0; c < colorCount; ++c) {
+		paletteR[c] = boxes.empty() ? 0.F : boxes[c].mean[0];
+		paletteG[c] = boxes.empty() ? 0.F : boxes[c].mean[1];
+		paletteB[c] = boxes.empty() ? 0.F : boxes[c].mean[2];
+	}
+
+	if (threadCount < 1) threadCount = 1;
+	if (threadCount > (int)entries.size() / GIF_QUANTIZE_CELLS_PER_THREAD) threadCount = (int)entries.size() / GIF_QUANTIZE_CELLS_PER_THREAD;
+	if (threadCount < 1) threadCount = 1;
+	std::vector<GIFQuantizeSums>& sums = histogram.sums;
+	sums.resize(threadCount);
+	auto assignRange = [&entries, &paletteR, &paletteG, &paletteB, paddedCount](size_t from, size_t to, GIFQuantizeSums& threadSums) {
+		memset(&threadSums, 0, sizeof(threadSums));
+		for (size_t i = from; i < to; ++i) {
+			const GIFQuantizeEntry& entry = entries[i];
+			const int nearest = findNearestGIFQuantizeColor(paletteR, paletteG, paletteB, paddedCount, entry.color);
+			GIFColorCell& sum = threadSums.colors[nearest];
+			sum.count += entry.sums->count;
+			sum.r += entry.sums->r;
+			sum.g += entry.sums->g;
+			sum.b += entry.sums->b;
+		}
+	};
+	// when every cell got a color of its own there's nothing for k-means to move
+	for (int iteration = 0; iteration < GIF_QUANTIZE_ITERATIONS && colorCount > 1 && colorCount < (int)entries.size(); ++iteration) {
+		std::vector<std::thread> threads;
+		for (int t = 1; t < threadCount; ++t) {
+			threads.emplace_back(assignRange, entries.size() * t / threadCount, entries.size() * (t + 1) / threadCount, std::ref(sums[t]));
+		}
+		assignRange(0, entries.size() / threadCount, sums[0]);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		for (int c = 0; c < colorCount; ++c) {
+			GIFColorCell total = GIFColorCell();
+			for (const GIFQuantizeSums& threadSums : sums) {
+				total.count += threadSums.colors[c].count;
+				total.r += threadSums.colors[c].r;
+				total.g += threadSums.colors[c].g;
+				total.b += threadSums.colors[c].b;
+			}
+			if (total.count == 0) continue; // no cell is nearest to this color, keep it where it is
+			paletteR[c] = (float)((double)total.r / total.count);
+			paletteG[c] = (float)((double)total.g / total.count);
+			paletteB[c] = (float)((double)total.b / total.count);
+		}
+	}
+
+	memset(palette.colors, 0, sizeof(palette.colors));
+	for (int c = 0; c < colorCount; ++c) {
+		palette.colors[c * 3] = (unsigned char)(paletteR[c] + 0.5F);
+		palette.colors[c * 3 + 1] = (unsigned char)(paletteG[c] + 0.5F);
+		palette.colors[c * 3 + 2] = (unsigned char)(paletteB[c] + 0.5F);
+		paletteR[c] = palette.colors[c * 3];
+		paletteG[c] = palette.colors[c * 3 + 1];
+		paletteB[c] = palette.colors[c * 3 + 2];
+	}
+	palette.transparentIndex = colorCount;
+	palette.bitsPerPixel = 1;
+	while ((1 << palette.bitsPerPixel) <= colorCount) ++palette.bitsPerPixel;
+
+	// only the occupied cells ever get looked up, since the frames being mapped are the ones in the histogram
+	memset(lookup.cells, 0, sizeof(lookup.cells));
+	for (const GIFQuantizeEntry& entry : entries) {
+		lookup.cells[entry.cell] = (unsigned char)findNearestGIFQuantizeColor(paletteR, paletteG, paletteB, paddedCount, entry.color);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include "GIF_encode.h"
+
+#define GIF_QUANTIZE_MAX_COLORS 255 // one of the 256 GIF colors is kept for transparency
+#define GIF_QUANTIZE_ITERATIONS 4 // k-means passes after median cut
+
+// Opaque pixels falling into one cell of the 5-6-5 grid GIFPaletteLookup uses, and the sum of their exact colors
+struct GIFColorCell {
+	unsigned long long count;
+	unsigned long long r;
+	unsigned long long g;
+	unsigned long long b;
+};
+
+// One occupied histogram cell, as the mean of its colors
+struct GIFQuantizeEntry {
+	float color[3];
+	float weight;
+	int cell;
+	const GIFColorCell* sums;
+};
+
+// A range of entries that median cut ends up giving one palette color
+struct GIFQuantizeBox {
+	int begin;
+	int end;
+	double error; // sum of weighted squared distances to the mean
+	int axis; // channel with the largest variance, the one to split along
+	float mean[3];
+};
+
+// Per-thread sums of the pixels each palette color got in a k-means pass. Integers, so the order they're added in doesn't matter
+struct GIFQuantizeSums {
+	GIFColorCell colors[GIF_QUANTIZE_MAX_COLORS];
+};
+
+/**
+* Color histogram of one or more frames, cells indexed like GIFPaletteLookup::cells.
+* occupied lists the cells with a non-zero count, so that clearing and quantizing only touch those.
+* Reused between frames along with the scratch memory of quantizeGIFColorHistogram, so that after the first one
+* neither adding pixels nor quantizing allocates.
+*/
+struct GIFColorHistogram {
+	std::vector<GIFColorCell> cells;
+	std::vector<int> occupied;
+	std::vector<GIFQuantizeEntry> entries;
+	std::vector<GIFQuantizeBox> boxes;
+	std::vector<GIFQuantizeSums> sums;
+};
+
+void clearGIFColorHistogram(GIFColorHistogram& histogram);
+
+void addRGBAToGIFColorHistogram(const unsigned char* rgba, size_t pixelCount, GIFColorHistogram& histogram);
+
+void mergeGIFColorHistograms(std::vector<GIFColorHistogram>& histograms, int threadCount);
+
+void quantizeGIFColorHistogram(GIFColorHistogram& histogram, int maxColors, int threadCount, GIFPalette& palette, GIFPaletteLookup& lookup);
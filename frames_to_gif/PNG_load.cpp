@@ -0,0 +1,626 @@
+#include "PNG_load.h"
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+#include "ToolStats.h"
+
+// Deflate (RFC 1951) decoder. Only what's needed to read PNG IDAT streams.
+
+#define INFLATE_MAXBITS 15
+#define INFLATE_FASTBITS 9
+#define INFLATE_MAX_RATIO 1032 // the most a deflate stream can expand: 258 bytes out of 2 bits
+
+struct InflateHuffman {
+	short count[INFLATE_MAXBITS + 1]; // number of codes of each length
+	short symbol[288]; // symbols ordered by code
+	unsigned short fast[1 << INFLATE_FASTBITS]; // (length << 9) | symbol for codes no longer than INFLATE_FASTBITS. 0 if none
+};
+
+struct InflateState {
+	const unsigned char* in;
+	size_t inSize;
+	size_t inPos;
+	unsigned int bitBuf;
+	int bitCount;
+	std::vector<unsigned char>* out;
+	size_t outLimit; // the stream is rejected if it decompresses to more than this
+};
+
+static void inflate_fill(InflateState& s) {
+	while (s.bitCount <= 24) {
+		if (s.inPos >= s.inSize) return;
+		s.bitBuf |= (unsigned int)s.in[s.inPos++] << s.bitCount;
+		s.bitCount += 8;
+	}
+}
+
+// Returns -1 if ran out of input.
+static int inflate_bits(InflateState& s, int count) {
+	if (s.bitCount < count) {
+		inflate_fill(s);
+		if (s.bitCount < count) return -1;
+	}
+	int value = (int)(s.bitBuf & ((1u << count) - 1));
+	s.bitBuf >>= count;
+	s.bitCount -= count;
+	return value;
+}
+
+// Returns 0 on success, -1 if the lengths describe an over-subscribed code.
+static int inflate_buildHuffman(InflateHuffman& h, const short* lengths, int n) {
+	memset(h.count, 0, sizeof(h.count));
+	memset(h.fast, 0, sizeof(h.fast));
+	for (int i = 0; i < n; ++i) {
+		++h.count[lengths[i]];
+	}
+	if (h.count[0] == n) return 0; // no codes. Legal, decoding anything with it fails later
+	int left = 1;
+	for (int len = 1; len <= INFLATE_MAXBITS; ++len) {
+		left <<= 1;
+		left -= h.count[len];
+		if (left < 0) return -1;
+	}
+	short offsets[INFLATE_MAXBITS + 1];
+	offsets[1] = 0;
+	for (int len = 1; len < INFLATE_MAXBITS; ++len) {
+		offsets[len + 1] = offsets[len] + h.count[len];
+	}
+	for (int i = 0; i < n; ++i) {
+		if (lengths[i] != 0) {
+			h.symbol[offsets[lengths[i]]++] = (short)i;
+		}
+	}
+
+	int code = 0;
+	int index = 0;
+	for (int len = 1; len <= INFLATE_FASTBITS; ++len) {
+		for (int i = 0; i < h.count[len]; ++i) {
+			int reversed = 0;
+			for (int bit = 0; bit < len; ++bit) {
+				if (code & (1 << bit)) reversed |= 1 << (len - 1 - bit);
+			}
+			for (int fill = reversed; fill < (1 << INFLATE_FASTBITS); fill += 1 << len) {
+				h.fast[fill] = (unsigned short)((len << 9) | h.symbol[index]);
+			}
+			++code;
+			++index;
+		}
+		code <<= 1;
+	}
+	return 0;
+}
+
+// Returns the decoded symbol or -1 on error.
+static int inflate_decode(InflateState& s, const InflateHuffman& h) {
+	inflate_fill(s);
+	unsigned short entry = h.fast[s.bitBuf & ((1 << INFLATE_FASTBITS) - 1)];
+	if (entry != 0) {
+		int len = entry >> 9;
+		if (len > s.bitCount) return -1;
+		s.bitBuf >>= len;
+		s.bitCount -= len;
+		return entry & 0x1FF;
+	}
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int len = 1; len <= INFLATE_MAXBITS; ++len) {
+		int bit = inflate_bits(s, 1);
+		if (bit < 0) return -1;
+		code |= bit;
+		int count = h.count[len];
+		if (code - count < first) {
+			return h.symbol[index + (code - first)];
+		}
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+static const short inflate_lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short inflate_lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short inflate_distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const short inflate_distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static int inflate_codes(InflateState& s, const InflateHuffman& lengthCodes, const InflateHuffman& distCodes) {
+	std::vector<unsigned char>& out = *s.out;
+	while (true) {
+		int symbol = inflate_decode(s, lengthCodes);
+		if (symbol < 0) return -1;
+		if (symbol < 256) {
+			if (out.size() >= s.outLimit) return -1;
+			out.push_back((unsigned char)symbol);
+			continue;
+		}
+		if (symbol == 256) return 0;
+		symbol -= 257;
+		if (symbol >= 29) return -1;
+		int extra = inflate_bits(s, inflate_lengthExtra[symbol]);
+		if (extra < 0) return -1;
+		int length = inflate_lengthBase[symbol] + extra;
+
+		symbol = inflate_decode(s, distCodes);
+		if (symbol < 0 || symbol >= 30) return -1;
+		extra = inflate_bits(s, inflate_distExtra[symbol]);
+		if (extra < 0) return -1;
+		size_t dist = inflate_distBase[symbol] + extra;
+		if (dist > out.size() || out.size() + length > s.outLimit) return -1;
+
+		size_t from = out.size() - dist;
+		for (int i = 0; i < length; ++i) {
+			out.push_back(out[from + i]);
+		}
+	}
+}
+
+static int inflate_stored(InflateState& s) {
+	// discard the rest of the current byte
+	s.bitBuf >>= s.bitCount & 7;
+	s.bitCount -= s.bitCount & 7;
+	int len = inflate_bits(s, 16);
+	int nlen = inflate_bits(s, 16);
+	if (len < 0 || nlen < 0 || len != (~nlen & 0xFFFF)) return -1;
+	if (s.out->size() + len > s.outLimit) return -1;
+	while (len-- > 0) {
+		int c = inflate_bits(s, 8);
+		if (c < 0) return -1;
+		s.out->push_back((unsigned char)c);
+	}
+	return 0;
+}
+
+struct InflateFixedCodes {
+	InflateHuffman lengthCodes;
+	InflateHuffman distCodes;
+	InflateFixedCodes() {
+		short lengths[288];
+		int i = 0;
+		for (; i < 144; ++i) lengths[i] = 8;
+		for (; i < 256; ++i) lengths[i] = 9;
+		for (; i < 280; ++i) lengths[i] = 7;
+		for (; i < 288; ++i) lengths[i] = 8;
+		inflate_buildHuffman(lengthCodes, lengths, 288);
+		for (i = 0; i < 30; ++i) lengths[i] = 5;
+		inflate_buildHuffman(distCodes, lengths, 30);
+	}
+};
+
+static int inflate_fixed(InflateState& s) {
+	static const InflateFixedCodes fixedCodes; // built once, thread-safe since C++11
+	return inflate_codes(s, fixedCodes.lengthCodes, fixedCodes.distCodes);
+}
+
+static int inflate_dynamic(InflateState& s) {
+	static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	int nlen = inflate_bits(s, 5);
+	int ndist = inflate_bits(s, 5);
+	int ncode = inflate_bits(s, 4);
+	if (nlen < 0 || ndist < 0 || ncode < 0) return -1;
+	nlen += 257;
+	ndist += 1;
+	ncode += 4;
+	if (nlen > 286 || ndist > 30) return -1;
+
+	short lengths[288 + 30];
+	int index;
+	for (index = 0; index < ncode; ++index) {
+		int len = inflate_bits(s, 3);
+		if (len < 0) return -1;
+		lengths[order[index]] = (short)len;
+	}
+	for (; index < 19; ++index) {
+		lengths[order[index]] = 0;
+	}
+	InflateHuffman lengthCodes;
+	InflateHuffman distCodes;
+	if (inflate_buildHuffman(lengthCodes, lengths, 19) != 0) return -1;
+
+	index = 0;
+	while (index < nlen + ndist) {
+		int symbol = inflate_decode(s, lengthCodes);
+		if (symbol < 0) return -1;
+		if (symbol < 16) {
+			lengths[index++] = (short)symbol;
+			continue;
+		}
+		short len = 0;
+		int repeat;
+		if (symbol == 16) {
+			if (index == 0) return -1;
+			len = lengths[index - 1];
+			repeat = inflate_bits(s, 2);
+			if (repeat < 0) return -1;
+			repeat += 3;
+		}
+		else if (symbol == 17) {
+			repeat = inflate_bits(s, 3);
+			if (repeat < 0) return -1;
+			repeat += 3;
+		}
+		else {
+			repeat = inflate_bits(s, 7);
+			if (repeat < 0) return -1;
+			repeat += 11;
+		}
+		if (index + repeat > nlen + ndist) return -1;
+		while (repeat-- > 0) {
+			lengths[index++] = len;
+		}
+	}
+	if (lengths[256] == 0) return -1; // no end of block code
+
+	if (inflate_buildHuffman(lengthCodes, lengths, nlen) != 0) return -1;
+	if (inflate_buildHuffman(distCodes, lengths + nlen, ndist) != 0) return -1;
+	return inflate_codes(s, lengthCodes, distCodes);
+}
+
+/**
+ * Decompresses a zlib stream (RFC 1950). Returns 0 on success, -1 if it's corrupt or decompresses to more than outLimit bytes.
+ * The Adler-32 checksum at the end is not checked.
+*/
+static int inflateZlib(const unsigned char* in, size_t inSize, std::vector<unsigned char>& out, size_t outLimit) {
+	if (inSize < 2) return -1;
+	if ((in[0] & 0x0F) != 8 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20) != 0) return -1;
+	InflateState s;
+	s.in = in;
+	s.inSize = inSize;
+	s.inPos = 2;
+	s.bitBuf = 0;
+	s.bitCount = 0;
+	s.out = &out;
+	s.outLimit = outLimit;
+	int last;
+	do {
+		last = inflate_bits(s, 1);
+		int type = inflate_bits(s, 2);
+		if (last < 0 || type < 0) return -1;
+		int err;
+		if (type == 0) err = inflate_stored(s);
+		else if (type == 1) err = inflate_fixed(s);
+		else if (type == 2) err = inflate_dynamic(s);
+		else err = -1;
+		if (err != 0) return -1;
+	} while (!last);
+	return 0;
+}
+
+static unsigned int readBigEndian32(const unsigned char* ptr) {
+	return ((unsigned int)ptr[0] << 24) | ((unsigned int)ptr[1] << 16) | ((unsigned int)ptr[2] << 8) | (unsigned int)ptr[3];
+}
+
+static unsigned char paethPredictor(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return (unsigned char)a;
+	if (pb <= pc) return (unsigned char)b;
+	return (unsigned char)c;
+}
+
+// Reverses the PNG scanline filter in place. prevRow is NULL for the first row of a pass.
+static int unfilterRow(unsigned char filter, unsigned char* row, const unsigned char* prevRow, size_t rowBytes, size_t bpp) {
+	switch (filter) {
+	case 0:
+		break;
+	case 1:
+		for (size_t i = bpp; i < rowBytes; ++i) row[i] += row[i - bpp];
+		break;
+	case 2:
+		if (prevRow) for (size_t i = 0; i < rowBytes; ++i) row[i] += prevRow[i];
+		break;
+	case 3:
+		for (size_t i = 0; i < rowBytes; ++i) {
+			int left = i >= bpp ? row[i - bpp] : 0;
+			int up = prevRow ? prevRow[i] : 0;
+			row[i] += (unsigned char)((left + up) >> 1);
+		}
+		break;
+	case 4:
+		for (size_t i = 0; i < rowBytes; ++i) {
+			int left = i >= bpp ? row[i - bpp] : 0;
+			int up = prevRow ? prevRow[i] : 0;
+			int upLeft = prevRow && i >= bpp ? prevRow[i - bpp] : 0;
+			row[i] += paethPredictor(left, up, upLeft);
+		}
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+struct PNGHeader {
+	int width;
+	int height;
+	int bitDepth;
+	int colorType;
+	int interlace;
+	int channels;
+	unsigned char palette[256 * 4];
+	int paletteSize;
+	bool hasTransparentKey;
+	unsigned short transparentKey[3]; // for color types 0 and 2
+};
+
+// Reads one sample of the given bit depth at sample index i of the row. 16-bit samples are returned whole.
+static unsigned int readSample(const unsigned char* row, size_t i, int bitDepth) {
+	if (bitDepth == 8) return row[i];
+	if (bitDepth == 16) return ((unsigned int)row[i * 2] << 8) | row[i * 2 + 1];
+	size_t bitPos = i * bitDepth;
+	return (row[bitPos >> 3] >> (8 - bitDepth - (bitPos & 7))) & ((1 << bitDepth) - 1);
+}
+
+static unsigned char scaleSample(unsigned int value, int bitDepth) {
+	if (bitDepth == 8) return (unsigned char)value;
+	if (bitDepth == 16) return (unsigned char)(value >> 8);
+	return (unsigned char)(value * 255 / ((1 << bitDepth) - 1));
+}
+
+static void convertRow(const PNGHeader& header, const unsigned char* row, int pixelCount, unsigned char* rgba, size_t rgbaStride) {
+	for (int x = 0; x < pixelCount; ++x, rgba += rgbaStride) {
+		size_t sample = (size_t)x * header.channels;
+		switch (header.colorType) {
+		case 0: {
+			unsigned int gray = readSample(row, sample, header.bitDepth);
+			rgba[0] = rgba[1] = rgba[2] = scaleSample(gray, header.bitDepth);
+			rgba[3] = header.hasTransparentKey && gray == header.transparentKey[0] ? 0 : 255;
+			break;
+		}
+		case 2: {
+			unsigned int r = readSample(row, sample, header.bitDepth);
+			unsigned int g = readSample(row, sample + 1, header.bitDepth);
+			unsigned int b = readSample(row, sample + 2, header.bitDepth);
+			rgba[0] = scaleSample(r, header.bitDepth);
+			rgba[1] = scaleSample(g, header.bitDepth);
+			rgba[2] = scaleSample(b, header.bitDepth);
+			rgba[3] = header.hasTransparentKey
+				&& r == header.transparentKey[0] && g == header.transparentKey[1] && b == header.transparentKey[2] ? 0 : 255;
+			break;
+		}
+		case 3: {
+			unsigned int index = readSample(row, sample, header.bitDepth);
+			if ((int)index < header.paletteSize) {
+				memcpy(rgba, header.palette + index * 4, 4);
+			}
+			else {
+				rgba[0] = rgba[1] = rgba[2] = 0;
+				rgba[3] = 255;
+			}
+			break;
+		}
+		case 4:
+			rgba[0] = rgba[1] = rgba[2] = scaleSample(readSample(row, sample, header.bitDepth), header.bitDepth);
+			rgba[3] = scaleSample(readSample(row, sample + 1, header.bitDepth), header.bitDepth);
+			break;
+		case 6:
+			rgba[0] = scaleSample(readSample(row, sample, header.bitDepth), header.bitDepth);
+			rgba[1] = scaleSample(readSample(row, sample + 1, header.bitDepth), header.bitDepth);
+			rgba[2] = scaleSample(readSample(row, sample + 2, header.bitDepth), header.bitDepth);
+			rgba[3] = scaleSample(readSample(row, sample + 3, header.bitDepth), header.bitDepth);
+			break;
+		}
+	}
+}
+
+#define PNG_LOAD_READ_PIECE (1 << 20) // chunk data is read in pieces of this size, so that a wrong chunk length can't allocate more than the file holds
+
+static int decodePNG(FILE* file, PNGImage& image, const char** error, PNGLoadBuffers* buffers);
+
+/**
+ * Function reads a whole PNG file and converts it to 8-bit RGBA.
+ * Supports all color types, bit depths and Adam7 interlacing. Ancillary chunks other than tRNS are ignored.
+ * CRCs are not checked.
+ * Returns 0 on success, -1 on error, in which case *error is set to a description of the problem.
+ * @param file PNG file opened for reading in binary mode
+ * @param image Receives the decoded pixels. Its rgba buffer is reused if it's big enough
+ * @param buffers Scratch memory to reuse from an earlier call, NULL to use temporary memory
+*/
+int loadPNG(FILE* file, PNGImage& image, const char** error, PNGLoadBuffers* buffers)
+{
+	// the sizes are checked before anything gets allocated for them, but an image within the limits can still not fit in memory.
+	// The loader runs on worker threads, where an exception would end the program instead of the pipeline
+	try {
+		return decodePNG(file, image, error, buffers);
+	}
+	catch (const std::bad_alloc&) {
+		*error = "not enough memory for the image";
+		return -1;
+	}
+}
+
+static int decodePNG(FILE* file, PNGImage& image, const char** error, PNGLoadBuffers* buffers)
+{
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	unsigned char buf[8];
+	if (fread(buf, 1, 8, file) != 8 || memcmp(buf, signature, 8) != 0) {
+		*error = "not a PNG file";
+		return -1;
+	}
+
+	PNGHeader header;
+	memset(&header, 0, sizeof(header));
+	bool metHeader = false;
+	PNGLoadBuffers temporaryBuffers;
+	if (!buffers) buffers = &temporaryBuffers;
+	std::vector<unsigned char>& compressed = buffers->compressed;
+	std::vector<unsigned char>& chunk = buffers->chunk;
+	compressed.clear();
+	while (true) {
+		if (fread(buf, 1, 8, file) != 8) {
+			*error = "unexpected end of file";
+			return -1;
+		}
+		unsigned int length = readBigEndian32(buf);
+		if (length > 0x7FFFFFFF) {
+			*error = "invalid chunk length";
+			return -1;
+		}
+		bool isData = memcmp(buf + 4, "IDAT", 4) == 0;
+		std::vector<unsigned char>& destination = isData ? compressed : chunk;
+		size_t offset = isData ? compressed.size() : 0;
+		destination.resize(offset);
+		for (size_t done = 0; done < length; ) {
+			size_t piece = length - done < PNG_LOAD_READ_PIECE ? length - done : PNG_LOAD_READ_PIECE;
+			destination.resize(offset + done + piece);
+			if (fread(destination.data() + offset + done, 1, piece, file) != piece) {
+				*error = "unexpected end of file";
+				return -1;
+			}
+			done += piece;
+		}
+		toolStatsSeek(file, 4, SEEK_CUR); // CRC
+
+		if (memcmp(buf + 4, "IHDR", 4) == 0) {
+			if (length != 13) {
+				*error = "invalid IHDR chunk";
+				return -1;
+			}
+			header.width = (int)readBigEndian32(chunk.data());
+			header.height = (int)readBigEndian32(chunk.data() + 4);
+			header.bitDepth = chunk[8];
+			header.colorType = chunk[9];
+			header.interlace = chunk[12];
+			if (header.width <= 0 || header.height <= 0 || chunk[10] != 0 || chunk[11] != 0 || header.interlace > 1) {
+				*error = "invalid IHDR chunk";
+				return -1;
+			}
+			switch (header.colorType) {
+			case 0: header.channels = 1; break;
+			case 2: header.channels = 3; break;
+			case 3: header.channels = 1; break;
+			case 4: header.channels = 2; break;
+			case 6: header.channels = 4; break;
+			default:
+				*error = "invalid color type";
+				return -1;
+			}
+			int bd = header.bitDepth;
+			bool validDepth = bd == 8 || bd == 16
+				|| ((bd == 1 || bd == 2 || bd == 4) && (header.colorType == 0 || header.colorType == 3));
+			if (!validDepth || (header.colorType == 3 && bd == 16)) {
+				*error = "invalid bit depth";
+				return -1;
+			}
+			metHeader = true;
+		}
+		else if (memcmp(buf + 4, "PLTE", 4) == 0) {
+			if (length % 3 != 0 || length > 768) {
+				*error = "invalid PLTE chunk";
+				return -1;
+			}
+			header.paletteSize = length / 3;
+			for (int i = 0; i < header.paletteSize; ++i) {
+				header.palette[i * 4] = chunk[i * 3];
+				header.palette[i * 4 + 1] = chunk[i * 3 + 1];
+				header.palette[i * 4 + 2] = chunk[i * 3 + 2];
+				header.palette[i * 4 + 3] = 255;
+			}
+		}
+		else if (memcmp(buf + 4, "tRNS", 4) == 0) {
+			if (header.colorType == 3) {
+				for (unsigned int i = 0; i < length && i < 256; ++i) {
+					header.palette[i * 4 + 3] = chunk[i];
+				}
+			}
+			else if (header.colorType == 0 && length >= 2) {
+				header.hasTransparentKey = true;
+				header.transparentKey[0] = (unsigned short)((chunk[0] << 8) | chunk[1]);
+			}
+			else if (header.colorType == 2 && length >= 6) {
+				header.hasTransparentKey = true;
+				for (int i = 0; i < 3; ++i) {
+					header.transparentKey[i] = (unsigned short)((chunk[i * 2] << 8) | chunk[i * 2 + 1]);
+				}
+			}
+		}
+		else if (memcmp(buf + 4, "IEND", 4) == 0) {
+			break;
+		}
+	}
+	if (!metHeader) {
+		*error = "missing IHDR chunk";
+		return -1;
+	}
+	if (header.colorType == 3 && header.paletteSize == 0) {
+		*error = "missing PLTE chunk";
+		return -1;
+	}
+
+	if ((long long)header.width * header.height > PNG_LOAD_MAX_PIXELS) {
+		*error = "image too large";
+		return -1;
+	}
+
+	static const int adam7[7][4] = { // x start, y start, x step, y step
+		{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+	static const int noInterlace[1][4] = { { 0, 0, 1, 1 } };
+	const int (*passes)[4] = header.interlace ? adam7 : noInterlace;
+	int passCount = header.interlace ? 7 : 1;
+	size_t bitsPerPixel = (size_t)header.channels * header.bitDepth;
+	size_t bpp = bitsPerPixel < 8 ? 1 : bitsPerPixel / 8;
+
+	// the filtered rows of every pass, each with its filter type byte
+	size_t rawSize = 0;
+	for (int pass = 0; pass < passCount; ++pass) {
+		if (passes[pass][0] >= header.width || passes[pass][1] >= header.height) continue;
+		size_t passWidth = (size_t)(header.width - passes[pass][0] + passes[pass][2] - 1) / passes[pass][2];
+		size_t passHeight = (size_t)(header.height - passes[pass][1] + passes[pass][3] - 1) / passes[pass][3];
+		rawSize += passHeight * (1 + (passWidth * bitsPerPixel + 7) / 8);
+	}
+	if (rawSize / INFLATE_MAX_RATIO > compressed.size()) {
+		*error = "image data too short";
+		return -1;
+	}
+	std::vector<unsigned char>& raw = buffers->raw;
+	raw.clear();
+	raw.reserve(rawSize);
+	if (inflateZlib(compressed.data(), compressed.size(), raw, rawSize) != 0) {
+		*error = "corrupt image data";
+		return -1;
+	}
+
+	image.width = header.width;
+	image.height = header.height;
+	image.rgba.resize((size_t)header.width * header.height * 4);
+
+	size_t rawPos = 0;
+	for (int pass = 0; pass < passCount; ++pass) {
+		int xStart = passes[pass][0];
+		int yStart = passes[pass][1];
+		int xStep = passes[pass][2];
+		int yStep = passes[pass][3];
+		if (xStart >= header.width || yStart >= header.height) continue;
+		int passWidth = (header.width - xStart + xStep - 1) / xStep;
+		int passHeight = (header.height - yStart + yStep - 1) / yStep;
+		size_t rowBytes = (passWidth * bitsPerPixel + 7) / 8;
+		unsigned char* prevRow = NULL;
+		for (int y = 0; y < passHeight; ++y) {
+			if (rawPos + 1 + rowBytes > raw.size()) {
+				*error = "image data too short";
+				return -1;
+			}
+			unsigned char* row = raw.data() + rawPos + 1;
+			if (unfilterRow(raw[rawPos], row, prevRow, rowBytes, bpp) != 0) {
+				*error = "invalid filter type";
+				return -1;
+			}
+			size_t pixelOffset = ((size_t)(yStart + y * yStep) * header.width + xStart) * 4;
+			convertRow(header, row, passWidth, image.rgba.data() + pixelOffset, (size_t)xStep * 4);
+			prevRow = row;
+			rawPos += 1 + rowBytes;
+		}
+	}
+	return 0;
+}
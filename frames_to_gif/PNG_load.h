@@ -0,0 +1,23 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+#define PNG_LOAD_MAX_PIXELS (1 << 28) // bigger images are rejected before anything gets allocated for them. 16384x16384, 1 GB as RGBA
+
+struct PNGImage {
+	int width;
+	int height;
+	std::vector<unsigned char> rgba; // width * height pixels, 4 bytes each (R, G, B, A), rows top to bottom
+};
+
+/**
+* Scratch memory for loadPNG. A thread that loads many PNGs can pass the same one to every call,
+* so that once it has grown to the size of the biggest file, loading doesn't allocate.
+*/
+struct PNGLoadBuffers {
+	std::vector<unsigned char> compressed; // the IDAT chunks joined together
+	std::vector<unsigned char> chunk; // the other chunks, one at a time
+	std::vector<unsigned char> raw; // decompressed, filtered rows
+};
+
+int loadPNG(FILE* file, PNGImage& image, const char** error, PNGLoadBuffers* buffers = NULL);
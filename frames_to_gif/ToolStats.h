@@ -0,0 +1,63 @@
+#pragma once
+#include <stdio.h>
+#include <atomic>
+#include "CrossPlatformDefs.h"
+
+// This file is copy-pasted between all the projects. Keep the copies identical.
+
+enum ToolStatsPhase {
+	TOOL_STATS_PARSE, // parsing arguments
+	TOOL_STATS_PLAN, // checking and opening files, figuring out what to do
+	TOOL_STATS_EXECUTE, // doing it
+	TOOL_STATS_PHASE_COUNT
+};
+
+/**
+* What the --stats option reports, as one JSON line on stderr when the program exits.
+* Reads and writes, and the bytes they moved, aren't counted here: they're taken from the operating system's
+* per-process I/O counters at exit, so they cost nothing and include everything the C library did behind the scenes.
+* The rest are counted all the time, with relaxed atomic increments, whether --stats was given or not.
+* Heap allocations are counted by replacing the global operator new, so they include the ones made by the standard library.
+*/
+struct ToolStats {
+	bool enabled;
+	const char* toolName;
+	int phase; // the current ToolStatsPhase, -1 if none started yet
+	double phaseWallSeconds[TOOL_STATS_PHASE_COUNT];
+	double phaseCpuSeconds[TOOL_STATS_PHASE_COUNT];
+	double phaseStartWall;
+	double phaseStartCpu;
+	long long phaseStartTrace; // from toolTraceNow()
+	long long phaseAllocations[TOOL_STATS_PHASE_COUNT];
+	long long phaseStartAllocations;
+	std::atomic<long long> seeks;
+	std::atomic<long long> renames;
+	std::atomic<long long> unlinks;
+	std::atomic<long long> syncs; // fsync and FlushFileBuffers calls, of files and directories
+	std::atomic<long long> frames;
+	std::atomic<long long> files;
+	std::atomic<long long> allocations;
+	std::atomic<long long> allocatedBytes;
+};
+
+extern struct ToolStats toolStats;
+
+bool takeToolStatsOptions(const char* toolName, int& argc, CrossPlatformChar* argv[]);
+
+void beginToolStatsPhase(enum ToolStatsPhase phase);
+
+void printToolStats();
+
+inline void countToolStats(std::atomic<long long>& counter, long long count = 1) {
+	counter.fetch_add(count, std::memory_order_relaxed);
+}
+
+// fseek that counts toward the seeks in --stats. Takes 64-bit offsets, long is 32-bit on Windows.
+inline int toolStatsSeek(FILE* file, long long offset, int origin) {
+	countToolStats(toolStats.seeks);
+#ifndef FOR_LINUX
+	return _fseeki64(file, offset, origin);
+#else
+	return fseeko(file, (off_t)offset, origin);
+#endif
+}
@@ -0,0 +1,166 @@
+#include "ToolTrace.h"
+#include <string.h>
+
+// This file is copy-pasted between all the projects. Keep the copies identical.
+
+struct ToolTrace toolTrace;
+
+static thread_local struct ToolTraceBuffer* toolTraceThreadBuffer = NULL;
+
+static struct ToolTraceBuffer* getToolTraceBuffer();
+
+/**
+* Function turns tracing on. Must be called before any threads get started.
+* @param path The JSON file to write at exit
+*/
+void startToolTrace(const CrossPlatformString& path) {
+	toolTrace.enabled = true;
+	toolTrace.path = path;
+	toolTrace.start = std::chrono::steady_clock::now();
+	getToolTraceBuffer(); // so that allocating it doesn't land inside the first event
+}
+
+// Returns microseconds since tracing started.
+long long toolTraceNow() {
+	return (long long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - toolTrace.start).count();
+}
+
+static struct ToolTraceBuffer* getToolTraceBuffer() {
+	if (toolTraceThreadBuffer) {
+		return toolTraceThreadBuffer;
+	}
+	struct ToolTraceBuffer* buffer = new struct ToolTraceBuffer; // not zeroed, events get filled in as they're added
+	buffer->written.store(0, std::memory_order_relaxed);
+	buffer->threadIndex = ++toolTrace.threadCount;
+	buffer->threadName = NULL;
+	// push onto the list of all buffers, it only ever grows
+	buffer->next = toolTrace.buffers.load(std::memory_order_relaxed);
+	while (!toolTrace.buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) {}
+	toolTraceThreadBuffer = buffer;
+	return buffer;
+}
+
+/**
+* Function adds a complete event that started at the given time and ends now, into the calling thread's buffer.
+* Does nothing if tracing is off.
+* @param name Must be a string literal
+* @param category Must be a string literal
+* @param start From toolTraceNow()
+* @param number A frame number or a count to attach, -1 for none
+* @param detail A text to attach, such as a file path, NULL for none. Gets copied
+*/
+void addToolTraceEvent(const char* name, const char* category, long long start, long long number, const CrossPlatformChar* detail) {
+	if (!toolTrace.enabled) {
+		return;
+	}
+	const long long end = toolTraceNow();
+	struct ToolTraceBuffer* buffer = getToolTraceBuffer();
+	const unsigned long long written = buffer->written.load(std::memory_order_relaxed);
+	struct ToolTraceEvent& event = buffer->events[written % TOOL_TRACE_BUFFER_EVENTS];
+	event.name = name;
+	event.category = category;
+	event.start = start;
+	event.duration = end - start;
+	event.number = number;
+	size_t length = 0;
+	if (detail) {
+		for (; detail[length] != 0 && length + 1 < TOOL_TRACE_DETAIL_LENGTH; ++length) {
+			// wide characters outside of ASCII are not worth converting here
+			event.detail[length] = (unsigned)detail[length] < 128 ? (char)detail[length] : '?';
+		}
+	}
+	event.detail[length] = '\0';
+	buffer->written.store(written + 1, std::memory_order_release);
+}
+
+// Names the calling thread in the trace. name must be a string literal.
+// Call it when the thread starts, that also allocates the thread's buffer outside of any event.
+void setToolTraceThreadName(const char* name) {
+	if (!toolTrace.enabled) {
+		return;
+	}
+	getToolTraceBuffer()->threadName = name;
+}
+
+static void writeToolTraceString(FILE* file, const char* str) {
+	fputc('"', file);
+	for (; *str; ++str) {
+		const unsigned char c = (unsigned char)*str;
+		if (c == '"' || c == '\\') {
+			fputc('\\', file);
+			fputc(c, file);
+		}
+		else if (c < 0x20) {
+			fprintf(file, "\\u%04x", c);
+		}
+		else {
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+/**
+* Function writes all buffered events into the file given to startToolTrace, in Trace Event Format.
+* Meant to be called at exit, after the other threads are done.
+* Returns false if the file couldn't be written.
+* @param toolName Name of the program, goes into the trace's metadata
+*/
+bool writeToolTrace(const char* toolName) {
+	if (!toolTrace.enabled) {
+		return true;
+	}
+	FILE* file = NULL;
+#ifndef FOR_LINUX
+	if (_wfopen_s(&file, toolTrace.path.c_str(), CrossPlatformText("wb")) || !file) {
+		CrossPlatformPerror(toolTrace.path.c_str());
+		return false;
+	}
+#else
+	file = fopen(toolTrace.path.c_str(), "wb");
+	if (!file) {
+		CrossPlatformPerror(toolTrace.path.c_str());
+		return false;
+	}
+#endif
+	unsigned long long dropped = 0;
+	bool first = true;
+	fputs("{\"traceEvents\":[\n", file);
+	for (struct ToolTraceBuffer* buffer = toolTrace.buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+		const unsigned long long written = buffer->written.load(std::memory_order_acquire);
+		const unsigned long long kept = written < TOOL_TRACE_BUFFER_EVENTS ? written : TOOL_TRACE_BUFFER_EVENTS;
+		dropped += written - kept;
+		if (buffer->threadName) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->threadIndex);
+			writeToolTraceString(file, buffer->threadName);
+			fputs("}}", file);
+			first = false;
+		}
+		for (unsigned long long i = written - kept; i < written; ++i) {
+			const struct ToolTraceEvent& event = buffer->events[i % TOOL_TRACE_BUFFER_EVENTS];
+			fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+			writeToolTraceString(file, event.name);
+			fputs(",\"cat\":", file);
+			writeToolTraceString(file, event.category);
+			fprintf(file, ",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d", event.start, event.duration, buffer->threadIndex);
+			if (event.number >= 0 || event.detail[0]) {
+				fputs(",\"args\":{", file);
+				if (event.number >= 0) {
+					fprintf(file, "\"n\":%lld%s", event.number, event.detail[0] ? "," : "");
+				}
+				if (event.detail[0]) {
+					fputs("\"detail\":", file);
+					writeToolTraceString(file, event.detail);
+				}
+				fputc('}', file);
+			}
+			fputc('}', file);
+			first = false;
+		}
+	}
+	fputs("\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"tool\":", file);
+	writeToolTraceString(file, toolName);
+	fprintf(file, ",\"droppedEvents\":%llu}}\n", dropped);
+	const bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
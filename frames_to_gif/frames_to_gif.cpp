@@ -0,0 +1,671 @@
+#include <iostream>
+#include <string>
+#ifndef FOR_LINUX
+#include <Windows.h>
+#else
+#include <string.h>
+#include <stdio.h>
+#endif
+#include "CrossPlatformDefs.h"
+#include "PNG_load.h"
+#include "GIF_encode.h"
+#include "GIF_quantize.h"
+#include "BoundedQueue.h"
+#include "ToolStats.h"
+#include "ToolTrace.h"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#ifndef FOR_LINUX
+#define CrossPlatformMainName wmain
+#else
+#define CrossPlatformMainName main
+#endif
+
+bool crossPlatformOpenFile(FILE** file, const CrossPlatformString& path, const CrossPlatformChar* mode) {
+#ifndef FOR_LINUX
+    if (_wfopen_s(file, path.c_str(), mode) || !*file) {
+        CrossPlatformPerror(path.c_str());
+        if (*file) {
+            fclose(*file);
+        }
+        return false;
+    }
+    return true;
+#else
+    * file = fopen(path.c_str(), mode);
+    if (!*file) {
+        CrossPlatformPerror(path.c_str());
+        return false;
+    }
+    return true;
+#endif
+}
+
+std::string wideStringToString(const std::wstring& str) {
+    std::string result;
+    result.reserve(str.size());
+    for (auto it = str.cbegin(); it != str.cend(); ++it) {
+        result.push_back((char)*it);
+    }
+    return result;
+}
+
+bool parseInteger(const CrossPlatformString& value, int& integer) {
+    int result;
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        if (!(*it >= CrossPlatformText('0') && *it <= CrossPlatformText('9'))) return false;  // apparently atoi doesn't do this check
+    }
+#ifndef FOR_LINUX
+    result = std::atoi(wideStringToString(value).c_str());
+#else
+    result = std::atoi(value.c_str());
+#endif
+    if (result == 0 && value != CrossPlatformText("0")) return false;
+    integer = result;
+    return true;
+}
+
+int findChar(const CrossPlatformString& buf, CrossPlatformChar c) {
+    for (auto it = buf.cbegin(); it != buf.cend(); ++it) {
+        if (*it == c) {
+            return it - buf.cbegin();
+        }
+    }
+    return -1;
+}
+
+CrossPlatformString numberToStringAndPadArena;
+
+CrossPlatformString& numberToStringAndPad(int numberToBeConverted, size_t totalCountReqChars) {
+    numberToStringAndPadArena.reserve(totalCountReqChars);
+    numberToStringAndPadArena = CrossPlatformNumberToString(numberToBeConverted);
+    while (numberToStringAndPadArena.size() < totalCountReqChars) {
+        numberToStringAndPadArena.insert(numberToStringAndPadArena.begin(), CrossPlatformText('0'));
+    }
+    return numberToStringAndPadArena;
+}
+
+/**
+ * Reads the next line of a durations file, in the same format change_gif_durations -durations expects:
+ * duration in ms on each line, only numbers and newlines allowed. An empty line means "use the default duration".
+ * Returns false on error, after printing it.
+*/
+bool readDurationsFileLine(FILE* durationsFile, int frameNumber, int defaultDuration, int& duration) {
+#define SETTINGS_PROPERTY_LENGTH 8
+    char textline[SETTINGS_PROPERTY_LENGTH];
+    if (fgets(textline, SETTINGS_PROPERTY_LENGTH, durationsFile) == NULL) {
+        if (feof(durationsFile) != 0) {
+            CrossPlatformCerr << CrossPlatformText("Reached end of durations file before reaching end of the frame sequence.\n");
+        } else {
+            CrossPlatformPerror(NULL);
+            CrossPlatformCerr << CrossPlatformText("Failed to read text from durations file on frame ") << frameNumber << std::endl;
+        }
+        return false;
+    }
+    size_t str_size = strlen(textline);
+    if (str_size == SETTINGS_PROPERTY_LENGTH - 1 && feof(durationsFile) == 0 && textline[str_size - 1] != '\n') {
+        CrossPlatformCerr << CrossPlatformText("String on line ") << frameNumber + 1
+            << CrossPlatformText(" exceeds ") << SETTINGS_PROPERTY_LENGTH - 2 << CrossPlatformText(" characters in durations file.\n");
+        return false;
+    }
+    if (str_size > 0 && textline[str_size - 1] == '\n') {
+        textline[--str_size] = '\0';
+    }
+    if (str_size > 0 && textline[str_size - 1] == '\r') {
+        textline[--str_size] = '\0';
+    }
+    if (str_size == 0) {
+        duration = defaultDuration;
+        return true;
+    }
+    for (char* cptr = textline; *cptr != '\0'; ++cptr) {
+        if (!(*cptr >= '0' && *cptr <= '9')) {
+            CrossPlatformCerr << CrossPlatformText("Durations file contains invalid characters on frame ") << frameNumber << std::endl;
+            return false;
+        }
+    }
+    duration = atoi(textline);
+    return true;
+#undef SETTINGS_PROPERTY_LENGTH
+}
+
+struct FrameJob {
+    int index; // position in the output GIF, starting from 0
+    int number; // the number in the frame's file name
+    int delay; // in 1/100 of a second
+    int width;
+    int height;
+    bool hasTransparency;
+    // Jobs get reused for later frames once written, and these keep their capacity, so that after the first
+    // few frames no stage allocates
+    std::vector<unsigned char> rgba; // filled by the loading stage
+    std::vector<unsigned char> indices; // filled by the mapping stage
+    std::vector<unsigned char> encoded; // Graphic Control Extension + Image Descriptor + image data
+    GIFPalette palette; // the frame's own palette with -palette local
+    GIFPaletteLookup paletteLookup;
+};
+
+typedef BoundedQueue<std::unique_ptr<FrameJob>> FrameQueue;
+
+enum PaletteMode {
+    PALETTE_FIXED, // the same 6x7x6 color cube for every GIF, the fastest
+    PALETTE_GLOBAL, // one palette made from the colors of all frames, stored once as the Global Color Map
+    PALETTE_LOCAL // a palette made for each frame, stored in the frame as a Local Color Map
+};
+
+struct AssembleSettings {
+    CrossPlatformString pathBeforePercents;
+    CrossPlatformString pathAfterPercents;
+    size_t numberOfPercentSigns;
+    int start;
+    int end;
+    int duration; // in ms
+    FILE* durationsFile; // NULL if not provided
+    int threadCount;
+    int queueDepth;
+    PaletteMode paletteMode;
+    int colors; // most colors a made palette can have, not counting the transparent one
+};
+
+/**
+ * Pipeline state shared by all stages. Each stage runs on its own thread(s) and they're connected by bounded queues:
+ * load -> map to palette -> LZW encode -> ordered write.
+ * The loader must acquire an in-flight slot per frame, which the writer releases once the frame is written,
+ * so the number of frames held in memory at once never exceeds queueDepth.
+*/
+struct AssemblePipeline {
+    const AssembleSettings& settings;
+    GIFPalette palette;
+    GIFPaletteLookup paletteLookup;
+    FrameQueue mapQueue;
+    FrameQueue encodeQueue;
+    FrameQueue writeQueue;
+    InFlightLimiter inFlight;
+    std::atomic<bool> failed;
+    std::atomic<int> mappersLeft;
+    std::atomic<int> encodersLeft;
+
+    // palette and paletteLookup are the Global Color Map, unless paletteMode is PALETTE_LOCAL
+    AssemblePipeline(const AssembleSettings& settings)
+        : settings(settings),
+        mapQueue(settings.queueDepth),
+        encodeQueue(settings.queueDepth),
+        writeQueue(settings.queueDepth),
+        inFlight(settings.queueDepth),
+        failed(false),
+        mappersLeft(settings.threadCount),
+        encodersLeft(settings.threadCount) {
+        makeDefaultGIFPalette(palette);
+        if (settings.paletteMode == PALETTE_FIXED) {
+            buildGIFPaletteLookup(palette, paletteLookup);
+        }
+        spareJobs.reserve(settings.queueDepth + 1);
+    }
+
+    // Jobs go back here once written, so that the loader reuses them and their buffers instead of allocating.
+    // There are never more than queueDepth + 1 jobs: one per in-flight slot, and the one the writer holds back.
+    std::mutex spareJobsMutex;
+    std::vector<std::unique_ptr<FrameJob>> spareJobs;
+
+    std::unique_ptr<FrameJob> takeSpareJob() {
+        std::unique_lock<std::mutex> guard(spareJobsMutex);
+        if (spareJobs.empty()) return std::unique_ptr<FrameJob>(new FrameJob());
+        std::unique_ptr<FrameJob> job = std::move(spareJobs.back());
+        spareJobs.pop_back();
+        return job;
+    }
+
+    void returnSpareJob(std::unique_ptr<FrameJob>& job) {
+        std::unique_lock<std::mutex> guard(spareJobsMutex);
+        spareJobs.push_back(std::move(job));
+    }
+
+    void fail() {
+        failed = true;
+        inFlight.cancel();
+        mapQueue.close();
+        encodeQueue.close();
+        writeQueue.close();
+    }
+};
+
+void loadStage(AssemblePipeline* pipeline) {
+    setToolTraceThreadName("load");
+    const AssembleSettings& settings = pipeline->settings;
+    int durationRemainder = 0;
+    int width = 0;
+    int height = 0;
+    CrossPlatformString path;
+    PNGLoadBuffers buffers;
+    PNGImage image;
+    for (int number = settings.start; number <= settings.end; ++number) {
+        if (!pipeline->inFlight.acquire()) break;
+        std::unique_ptr<FrameJob> job = pipeline->takeSpareJob();
+        job->index = number - settings.start;
+        job->number = number;
+
+        int duration = settings.duration;
+        if (settings.durationsFile && !readDurationsFileLine(settings.durationsFile, job->index, settings.duration, duration)) {
+            pipeline->fail();
+            break;
+        }
+        // same rounding as change_gif_durations: carry the remainder so that the total length is preserved
+        job->delay = duration / 10;
+        durationRemainder += duration % 10;
+        if (durationRemainder >= 10) {
+            ++job->delay;
+            durationRemainder -= 10;
+        }
+
+        path = settings.pathBeforePercents;
+        path += numberToStringAndPad(number, settings.numberOfPercentSigns);
+        path += settings.pathAfterPercents;
+        FILE* file = nullptr;
+        if (!crossPlatformOpenFile(&file, path, CrossPlatformText("rb"))) {
+            pipeline->fail();
+            break;
+        }
+        const char* error = nullptr;
+        int err;
+        image.rgba.swap(job->rgba);
+        {
+            ToolTraceSpan span("load PNG", "file", path.c_str());
+            err = loadPNG(file, image, &error, &buffers);
+        }
+        fclose(file);
+        countToolStats(toolStats.files);
+        if (err != 0) {
+            CrossPlatformCerr << CrossPlatformText("Failed to load ") << path.c_str() << CrossPlatformText(": ") << error << std::endl;
+            pipeline->fail();
+            break;
+        }
+        if (job->index == 0) {
+            width = image.width;
+            height = image.height;
+        } else if (image.width != width || image.height != height) {
+            CrossPlatformCerr << CrossPlatformText("Frame ") << path.c_str() << CrossPlatformText(" is ") << image.width << CrossPlatformText("x")
+                << image.height << CrossPlatformText(" while the first frame is ") << width << CrossPlatformText("x") << height
+                << CrossPlatformText(". All frames must have the same size.\n");
+            pipeline->fail();
+            break;
+        }
+        job->width = image.width;
+        job->height = image.height;
+        job->rgba.swap(image.rgba);
+        if (!pipeline->mapQueue.push(std::move(job))) break;
+    }
+    pipeline->mapQueue.close();
+}
+
+void mapStage(AssemblePipeline* pipeline) {
+    setToolTraceThreadName("map");
+    const bool localPalette = pipeline->settings.paletteMode == PALETTE_LOCAL;
+    GIFColorHistogram histogram;
+    std::unique_ptr<FrameJob> job;
+    while (pipeline->mapQueue.pop(job)) {
+        const size_t pixelCount = (size_t)job->width * job->height;
+        if (localPalette) {
+            ToolTraceSpan span("quantize", "frame", (long long)job->index);
+            clearGIFColorHistogram(histogram);
+            addRGBAToGIFColorHistogram(job->rgba.data(), pixelCount, histogram);
+            // frames are already quantized in parallel, one per map thread
+            quantizeGIFColorHistogram(histogram, pipeline->settings.colors, 1, job->palette, job->paletteLookup);
+        }
+        ToolTraceSpan span("map to palette", "frame", (long long)job->index);
+        const GIFPalette& palette = localPalette ? job->palette : pipeline->palette;
+        const GIFPaletteLookup& paletteLookup = localPalette ? job->paletteLookup : pipeline->paletteLookup;
+        job->indices.resize(pixelCount);
+        job->hasTransparency = mapRGBAToGIFPalette(job->rgba.data(), pixelCount, palette, paletteLookup, job->indices.data());
+        if (!pipeline->encodeQueue.push(std::move(job))) break;
+    }
+    if (--pipeline->mappersLeft == 0) {
+        pipeline->encodeQueue.close();
+    }
+}
+
+void encodeStage(AssemblePipeline* pipeline) {
+    setToolTraceThreadName("encode");
+    std::unique_ptr<GIFEncoder> encoder(new GIFEncoder());
+    std::unique_ptr<FrameJob> job;
+    while (pipeline->encodeQueue.pop(job)) {
+        ToolTraceSpan span("encode", "frame", (long long)job->index);
+        GIFFrameParams params;
+        params.left = 0;
+        params.top = 0;
+        params.width = job->width;
+        params.height = job->height;
+        params.delay = job->delay;
+        params.disposal = 1; // do not dispose. The writer changes it to 2 if the next frame has transparent pixels
+        params.localPalette = pipeline->settings.paletteMode == PALETTE_LOCAL ? &job->palette : NULL;
+        params.transparentIndex = job->hasTransparency ? (params.localPalette ? job->palette.transparentIndex : pipeline->palette.transparentIndex) : -1;
+        params.globalBitsPerPixel = pipeline->palette.bitsPerPixel;
+        job->encoded.clear();
+        writeGIFFrame(*encoder, job->encoded, params, job->indices.data());
+        if (!pipeline->writeQueue.push(std::move(job))) break;
+    }
+    if (--pipeline->encodersLeft == 0) {
+        pipeline->writeQueue.close();
+    }
+}
+
+/**
+ * Runs the ordered writing stage on the calling thread. Frames arrive from the encoders out of order
+ * and are written strictly in sequence order.
+ * Each frame is held back until the next one is known, because if the next frame has transparent pixels,
+ * this frame's disposal must be "restore to background", otherwise the next frame would show it through.
+ * Returns the number of frames written.
+*/
+int writeStage(AssemblePipeline* pipeline, FILE* output) {
+    // frames waiting for the ones before them. Each holds an in-flight slot, so they're all less than queueDepth
+    // after nextIndex, and frame n can go into pending[n % queueDepth]
+    const int slots = pipeline->settings.queueDepth;
+    std::vector<std::unique_ptr<FrameJob>> pending(slots);
+    std::unique_ptr<FrameJob> held;
+    std::unique_ptr<FrameJob> job;
+    std::vector<unsigned char> header;
+    int nextIndex = 0;
+    int written = 0;
+    while (pipeline->writeQueue.pop(job)) {
+        int index = job->index;
+        pending[index % slots] = std::move(job);
+        while (pending[nextIndex % slots]) {
+            std::unique_ptr<FrameJob> current = std::move(pending[nextIndex % slots]);
+            if (nextIndex == 0) {
+                writeGIFHeader(header, current->width, current->height, pipeline->settings.paletteMode == PALETTE_LOCAL ? NULL : &pipeline->palette, 0);
+                fwrite(header.data(), 1, header.size(), output);
+            }
+            if (held) {
+                if (current->hasTransparency) {
+                    held->encoded[3] = (unsigned char)((held->encoded[3] & ~0x1C) | (2 << 2));
+                }
+                {
+                    ToolTraceSpan span("write", "frame", (long long)held->index);
+                    fwrite(held->encoded.data(), 1, held->encoded.size(), output);
+                }
+                pipeline->returnSpareJob(held);
+                ++written;
+                countToolStats(toolStats.frames);
+            }
+            held = std::move(current);
+            pipeline->inFlight.release();
+            ++nextIndex;
+        }
+    }
+    if (held && !pipeline->failed) {
+        ToolTraceSpan span("write", "frame", (long long)held->index);
+        fwrite(held->encoded.data(), 1, held->encoded.size(), output);
+        ++written;
+        countToolStats(toolStats.frames);
+        header.clear();
+        writeGIFTrailer(header);
+        fwrite(header.data(), 1, header.size(), output);
+    }
+    return written;
+}
+
+/**
+ * Makes the palette for -palette global: a pass over all frames before the pipeline starts, in which
+ * settings.threadCount threads each load frames and count their colors into their own histogram.
+ * The histograms get merged and quantized into one palette for the whole GIF.
+ * Returns false on error, after printing it.
+*/
+bool buildGlobalPalette(const AssembleSettings& settings, GIFPalette& palette, GIFPaletteLookup& paletteLookup) {
+    std::vector<GIFColorHistogram> histograms(settings.threadCount);
+    std::atomic<int> nextNumber(settings.start);
+    std::atomic<bool> failed(false);
+    auto countColors = [&settings, &histograms, &nextNumber, &failed](int threadIndex) {
+        setToolTraceThreadName("histogram");
+        GIFColorHistogram& histogram = histograms[threadIndex];
+        clearGIFColorHistogram(histogram);
+        CrossPlatformString path;
+        CrossPlatformString digits;
+        PNGLoadBuffers buffers;
+        PNGImage image;
+        for (int number = nextNumber++; number <= settings.end && !failed; number = nextNumber++) {
+            // not numberToStringAndPad, its result is shared by all threads
+            digits = CrossPlatformNumberToString(number);
+            path = settings.pathBeforePercents;
+            if (digits.size() < settings.numberOfPercentSigns) path.append(settings.numberOfPercentSigns - digits.size(), CrossPlatformText('0'));
+            path += digits;
+            path += settings.pathAfterPercents;
+            FILE* file = nullptr;
+            if (!crossPlatformOpenFile(&file, path, CrossPlatformText("rb"))) {
+                failed = true;
+                break;
+            }
+            const char* error = nullptr;
+            int err;
+            {
+                ToolTraceSpan span("load PNG", "file", path.c_str());
+                err = loadPNG(file, image, &error, &buffers);
+            }
+            fclose(file);
+            countToolStats(toolStats.files);
+            if (err != 0) {
+                CrossPlatformCerr << CrossPlatformText("Failed to load ") << path.c_str() << CrossPlatformText(": ") << error << std::endl;
+                failed = true;
+                break;
+            }
+            ToolTraceSpan span("histogram", "frame", (long long)(number - settings.start));
+            addRGBAToGIFColorHistogram(image.rgba.data(), (size_t)image.width * image.height, histogram);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < settings.threadCount; ++i) {
+        threads.emplace_back(countColors, i);
+    }
+    countColors(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (failed) return false;
+    ToolTraceSpan span("quantize", "frames", (long long)(settings.end - settings.start + 1));
+    mergeGIFColorHistograms(histograms, settings.threadCount);
+    quantizeGIFColorHistogram(histograms[0], settings.colors, settings.threadCount, palette, paletteLookup);
+    return true;
+}
+
+#define PARAMETERS_FORMAT_HELP CrossPlatformText("1 - input file path points to PNG files with names like")\
+    CrossPlatformText(" image1.png, image2.png, image3.png, where the 1, 2, 3, etc part is replaced with a % sign.\n")\
+    CrossPlatformText("Use multiple % signs if the number is 0-padded on the left.\n")\
+	CrossPlatformText("2 - frame range in format 0-20. This specifies the range of frames to put into the GIF.\n")\
+	CrossPlatformText("3 - output GIF file path. The file will be overwritten.\n")\
+	CrossPlatformText("Optional: -duration ## or -fps ##. -duration specifies time in ms between frames. -fps specifies frames per second.")\
+	CrossPlatformText(" The default is -duration 50.\n")\
+	CrossPlatformText("Optional: -durations \"path\" pointing to a file which contains durations in ms for each frame on each new line.")\
+	CrossPlatformText(" Same format as the one change_gif_durations -durations expects and -f outputs. Empty lines use -duration or -fps.\n")\
+	CrossPlatformText("Optional: -threads ## - how many frames get palette-mapped and encoded in parallel. The default is the number of CPU cores.\n")\
+	CrossPlatformText("Optional: -queue ## - maximum number of frames held in memory at once. The default is twice the number of threads.\n")\
+	CrossPlatformText("Optional: -palette fixed|global|local - fixed maps every frame to the same built-in 255 colors, the default and the fastest.")\
+	CrossPlatformText(" global makes one palette out of the colors of all frames, reading them twice. local makes a palette for each frame.\n")\
+	CrossPlatformText("Optional: -colors ## - most colors a global or local palette can have, 1 to 255. The default is 255.\n")\
+	CrossPlatformText("Optional: --stats - when the program exits, print a line of JSON to stderr with the time spent and the amount of I/O done.\n")\
+	CrossPlatformText("Optional: --trace \"path\" - write a timeline of each file load and each frame's mapping, encoding and writing into \"path\"")\
+	CrossPlatformText(" in Chrome's trace format (open it in chrome://tracing or ui.perfetto.dev).\n")
+
+int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar* envp[])
+{
+    if (!takeToolStatsOptions("frames_to_gif", argc, argv)) {
+        CrossPlatformCerr << CrossPlatformText("A file path for the trace must be provided after the --trace option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (argc == 2 && (
+        CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("-help")) == 0
+        || CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("--help")) == 0
+        || CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("/?")) == 0
+        )) {
+        CrossPlatformCout << CrossPlatformText("The program assembles a sequence of numbered PNG files into an animated GIF. Expects arguments:\n") PARAMETERS_FORMAT_HELP;
+        exit(0);
+    }
+
+    bool metDurationFlag = false;
+    bool metFPSFlag = false;
+    CrossPlatformString durationValue;
+    CrossPlatformString durationsPath;
+    CrossPlatformString threadsValue;
+    CrossPlatformString queueValue;
+    CrossPlatformString paletteValue;
+    CrossPlatformString colorsValue;
+    CrossPlatformString* captureNextArgumentInto = nullptr;
+    const CrossPlatformChar* capturedOption = nullptr;
+    std::vector<CrossPlatformString> unparsedArgs;
+    for (int i = 1; i < argc; ++i) {
+        if (captureNextArgumentInto) {
+            *captureNextArgumentInto = argv[i];
+            captureNextArgumentInto = nullptr;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-duration")) == 0) {
+            metDurationFlag = true;
+            captureNextArgumentInto = &durationValue;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-fps")) == 0) {
+            metFPSFlag = true;
+            captureNextArgumentInto = &durationValue;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-durations")) == 0) {
+            captureNextArgumentInto = &durationsPath;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-threads")) == 0) {
+            captureNextArgumentInto = &threadsValue;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-queue")) == 0) {
+            captureNextArgumentInto = &queueValue;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-palette")) == 0) {
+            captureNextArgumentInto = &paletteValue;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-colors")) == 0) {
+            captureNextArgumentInto = &colorsValue;
+        } else {
+            unparsedArgs.push_back(argv[i]);
+        }
+        if (captureNextArgumentInto) capturedOption = argv[i];
+    }
+    if (captureNextArgumentInto) {
+        CrossPlatformCerr << CrossPlatformText("A value must be provided after the ") << capturedOption << CrossPlatformText(" option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (metDurationFlag && metFPSFlag) {
+        CrossPlatformCerr << CrossPlatformText("Must provide only one of either -duration or -fps. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (unparsedArgs.size() != 3) {
+        CrossPlatformCerr << CrossPlatformText("Wrong number of argument. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+
+    AssembleSettings settings;
+    CrossPlatformString path = unparsedArgs[0];
+    int pos = findChar(path, CrossPlatformText('%'));
+    if (pos == -1) {
+        CrossPlatformCerr << CrossPlatformText("Error: provided file does not contain a % character which is supposed to mean the number part of the file name.")
+            CrossPlatformText(" Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    settings.numberOfPercentSigns = 1;
+    int posPtr = pos + 1;
+    while ((size_t)posPtr < path.size() && path[posPtr] == CrossPlatformText('%')) {
+        ++settings.numberOfPercentSigns;
+        ++posPtr;
+    }
+    settings.pathBeforePercents = CrossPlatformString{ path.begin(), path.begin() + pos };
+    settings.pathAfterPercents = CrossPlatformString{ path.begin() + pos + settings.numberOfPercentSigns, path.end() };
+
+    const CrossPlatformString& range = unparsedArgs[1];
+    pos = findChar(range, CrossPlatformText('-'));
+    if (pos == -1) {
+        CrossPlatformCerr << CrossPlatformText("Error: provided frame range does not contain a - character which is supposed to separate the start")
+            CrossPlatformText(" and end frame range values. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (!parseInteger(CrossPlatformString{ range.begin(), range.begin() + pos }, settings.start)) {
+        CrossPlatformCerr << CrossPlatformText("Error: failed to parse the starting frame of the frame range argument. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (!parseInteger(CrossPlatformString{ range.begin() + pos + 1, range.end() }, settings.end)) {
+        CrossPlatformCerr << CrossPlatformText("Error: failed to parse the ending frame of the frame range argument. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (settings.start < 0 || settings.end < 0 || settings.end < settings.start) {
+        CrossPlatformCerr << CrossPlatformText("Error: the parsed frame range is invalid. Use --help or /? option for help.\n");
+        CrossPlatformCerr << CrossPlatformText("Start: ") << settings.start << CrossPlatformText("; End: ") << settings.end << std::endl;
+        exit(-1);
+    }
+
+    settings.duration = 50;
+    if (!durationValue.empty()) {
+        int value = 0;
+        if (!parseInteger(durationValue, value) || value <= 0) {
+            CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the ") << (metFPSFlag ? CrossPlatformText("-fps") : CrossPlatformText("-duration"))
+                << CrossPlatformText(" option. Use --help or /? option for help.\n");
+            exit(-1);
+        }
+        settings.duration = metFPSFlag ? 1000 / value : value;
+    }
+
+    settings.threadCount = (int)std::thread::hardware_concurrency();
+    if (settings.threadCount <= 0) settings.threadCount = 1;
+    if (!threadsValue.empty() && (!parseInteger(threadsValue, settings.threadCount) || settings.threadCount <= 0)) {
+        CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -threads option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    settings.queueDepth = settings.threadCount * 2;
+    if (!queueValue.empty() && (!parseInteger(queueValue, settings.queueDepth) || settings.queueDepth <= 0)) {
+        CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -queue option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (paletteValue.empty() || CrossPlatformCaseInsensitiveTextCompare(paletteValue.c_str(), CrossPlatformText("fixed")) == 0) {
+        settings.paletteMode = PALETTE_FIXED;
+    } else if (CrossPlatformCaseInsensitiveTextCompare(paletteValue.c_str(), CrossPlatformText("global")) == 0) {
+        settings.paletteMode = PALETTE_GLOBAL;
+    } else if (CrossPlatformCaseInsensitiveTextCompare(paletteValue.c_str(), CrossPlatformText("local")) == 0) {
+        settings.paletteMode = PALETTE_LOCAL;
+    } else {
+        CrossPlatformCerr << CrossPlatformText("The -palette option must be fixed, global or local. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    settings.colors = GIF_QUANTIZE_MAX_COLORS;
+    if (!colorsValue.empty() && (!parseInteger(colorsValue, settings.colors) || settings.colors < 1 || settings.colors > GIF_QUANTIZE_MAX_COLORS)) {
+        CrossPlatformCerr << CrossPlatformText("Failed to parse the value for the -colors option, it must be 1 to ") << GIF_QUANTIZE_MAX_COLORS
+            << CrossPlatformText(". Use --help or /? option for help.\n");
+        exit(-1);
+    }
+
+    beginToolStatsPhase(TOOL_STATS_PLAN);
+    settings.durationsFile = NULL;
+    if (!durationsPath.empty() && !crossPlatformOpenFile(&settings.durationsFile, durationsPath, CrossPlatformText("rb"))) {
+        exit(-1);
+    }
+    FILE* output = nullptr;
+    if (!crossPlatformOpenFile(&output, unparsedArgs[2], CrossPlatformText("wb"))) {
+        if (settings.durationsFile) fclose(settings.durationsFile);
+        exit(-1);
+    }
+
+    beginToolStatsPhase(TOOL_STATS_EXECUTE);
+    AssemblePipeline pipeline(settings);
+    if (settings.paletteMode == PALETTE_GLOBAL && !buildGlobalPalette(settings, pipeline.palette, pipeline.paletteLookup)) {
+        fclose(output);
+        if (settings.durationsFile) fclose(settings.durationsFile);
+        CrossPlatformCerr << CrossPlatformText("Operation failed. The output GIF is incomplete.\n");
+        exit(-1);
+    }
+    setToolTraceThreadName("main and write");
+    std::vector<std::thread> threads;
+    threads.emplace_back(loadStage, &pipeline);
+    for (int i = 0; i < settings.threadCount; ++i) {
+        threads.emplace_back(mapStage, &pipeline);
+        threads.emplace_back(encodeStage, &pipeline);
+    }
+    int written = writeStage(&pipeline, output);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    bool writeFailed = ferror(output) != 0;
+    fclose(output);
+    if (settings.durationsFile) fclose(settings.durationsFile);
+    if (pipeline.failed || writeFailed) {
+        if (writeFailed) CrossPlatformPerror(unparsedArgs[2].c_str());
+        CrossPlatformCerr << CrossPlatformText("Operation failed. The output GIF is incomplete.\n");
+        exit(-1);
+    }
+    CrossPlatformCout << CrossPlatformText("Written ") << written << CrossPlatformText(" frames successfully.\n");
+    return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdio.h>
+#include <string>
+#include "CrossPlatformDefs.h"
+
+// This file is copy-pasted between the renumber_frames and remove_half_the_frames projects. Keep the copies identical.
+
+// Operations done between two progress records in the journal. Only the records get flushed to the disk, not each operation
+#define FRAME_JOURNAL_CHECKPOINT_OPS 1024
+
+// When the renames and deletes reach the disk, not just the operating system's cache, so that they survive a power loss
+enum FrameDurability {
+	FRAME_DURABILITY_NONE, // whenever the operating system gets to it. The journal is only good against the program getting killed
+	FRAME_DURABILITY_PER_OP, // before the next operation starts
+	FRAME_DURABILITY_BATCHED // the directory gets synced once per journal record, right before the record is written
+};
+
+/**
+* An append-only record of a job that renames and deletes frames, kept next to the frames while the job runs.
+* It holds the plan (the tool and its arguments, from which the operations follow in order) and then a line
+* with the number of operations done so far, added every FRAME_JOURNAL_CHECKPOINT_OPS operations.
+* If the job gets interrupted, the journal stays behind and --resume picks the job up from the last record.
+* The operations done after the last record get replayed: a rename whose destination exists and a delete whose
+* file doesn't are skipped, as done. This can only go wrong if a rename recreates a file deleted after the last record,
+* so such a rename writes a record first.
+* A record is only written once the operations it counts have reached the disk, as far as the durability setting goes.
+*/
+struct FrameJournal {
+	CrossPlatformString path;
+	FILE* file;
+	int done; // operations done, in plan order
+	int checkpointed; // operations done as of the last record
+	int replayUntil; // with --resume, the operations before this one may have been done already, after the last record
+	int deletedMin; // range of frame numbers deleted since the last record, deletedMax < deletedMin if none
+	int deletedMax;
+	FrameDurability durability;
+#ifndef FOR_LINUX
+	void* directory; // HANDLE of the frames' directory, INVALID_HANDLE_VALUE if it couldn't be opened
+#else
+	int directory; // file descriptor of the frames' directory, -1 if it couldn't be opened
+#endif
+};
+
+bool takeFrameJournalOptions(int& argc, CrossPlatformChar* argv[], bool& resume, FrameDurability& durability);
+
+int beginFrameJournal(FrameJournal& journal, const CrossPlatformString& sequencePath, const std::string& plan, bool resume, FrameDurability durability);
+
+bool isFrameJournalReplaying(const FrameJournal& journal);
+
+void prepareFrameJournalRename(FrameJournal& journal, int destinationNumber);
+
+void finishFrameJournalOperation(FrameJournal& journal, int deletedNumber = -1);
+
+void endFrameJournal(FrameJournal& journal, bool finished);
@@ -0,0 +1,318 @@
+#include "PNG_verify.h"
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#ifndef FOR_LINUX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#include "ToolStats.h"
+#include "ToolTrace.h"
+
+// This file is copy-pasted between the renumber_frames and remove_half_the_frames projects. Keep the copies identical.
+
+// Frames a worker takes at once. Their files are all opened and hinted before any of them is read,
+// so the disk or the network gets several requests at a time instead of one.
+#define PNG_VERIFY_BLOCK 16
+
+enum PNGVerifyStatus {
+	PNG_VERIFY_OK,
+	PNG_VERIFY_MISSING,
+	PNG_VERIFY_UNREADABLE,
+	PNG_VERIFY_NOT_PNG, // too short or wrong signature
+	PNG_VERIFY_BAD_IHDR, // IHDR missing, wrong length, invalid values or wrong CRC
+	PNG_VERIFY_MISMATCH // valid, but differs from the first valid frame
+};
+
+struct PNGVerifyResult {
+	unsigned char status;
+	unsigned char bitDepth;
+	unsigned char colorType;
+	unsigned char interlace;
+	unsigned int width;
+	unsigned int height;
+};
+
+static unsigned int readPNGVerifyUInt(const unsigned char* bytes) {
+	return (unsigned int)bytes[0] << 24 | (unsigned int)bytes[1] << 16 | (unsigned int)bytes[2] << 8 | bytes[3];
+}
+
+// CRC-32 as PNG uses it. Only ever run on 17 bytes per file, so a table isn't worth it.
+static unsigned int computePNGVerifyCRC(const unsigned char* bytes, size_t size) {
+	unsigned int crc = 0xFFFFFFFFu;
+	for (size_t i = 0; i < size; ++i) {
+		crc ^= bytes[i];
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+		}
+	}
+	return crc ^ 0xFFFFFFFFu;
+}
+
+static void checkPNGHeader(const unsigned char* header, size_t size, struct PNGVerifyResult& result) {
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (size < 8 || memcmp(header, signature, 8) != 0) {
+		result.status = PNG_VERIFY_NOT_PNG;
+		return;
+	}
+	if (size < PNG_VERIFY_HEADER_SIZE || readPNGVerifyUInt(header + 8) != 13 || memcmp(header + 12, "IHDR", 4) != 0
+		|| computePNGVerifyCRC(header + 12, 17) != readPNGVerifyUInt(header + 29)) {
+		result.status = PNG_VERIFY_BAD_IHDR;
+		return;
+	}
+	result.width = readPNGVerifyUInt(header + 16);
+	result.height = readPNGVerifyUInt(header + 20);
+	result.bitDepth = header[24];
+	result.colorType = header[25];
+	result.interlace = header[28];
+	const bool validDepth = result.bitDepth == 1 || result.bitDepth == 2 || result.bitDepth == 4 || result.bitDepth == 8 || result.bitDepth == 16;
+	const bool validColorType = result.colorType == 0 || result.colorType == 2 || result.colorType == 3 || result.colorType == 4 || result.colorType == 6;
+	if (!result.width || !result.height || !validDepth || !validColorType || header[26] != 0 || header[27] != 0 || result.interlace > 1) {
+		result.status = PNG_VERIFY_BAD_IHDR;
+		return;
+	}
+	result.status = PNG_VERIFY_OK;
+}
+
+static void makePNGVerifyPath(CrossPlatformString& path, const CrossPlatformString& pathBeforePercents, size_t numberOfPercentSigns,
+	const CrossPlatformString& pathAfterPercents, int number)
+{
+	CrossPlatformString digits = CrossPlatformNumberToString(number);
+	path = pathBeforePercents;
+	if (digits.size() < numberOfPercentSigns) path.append(numberOfPercentSigns - digits.size(), CrossPlatformText('0'));
+	path += digits;
+	path += pathAfterPercents;
+}
+
+struct PNGVerifyWork {
+	const CrossPlatformString* pathBeforePercents;
+	size_t numberOfPercentSigns;
+	const CrossPlatformString* pathAfterPercents;
+	int start;
+	int end;
+	std::atomic<size_t> nextBlock; // offset from start of the first frame of the next block nobody took yet
+	std::vector<struct PNGVerifyResult> results; // indexed by frame number - start
+};
+
+static void runPNGVerifyWorker(struct PNGVerifyWork* work) {
+	setToolTraceThreadName("verify worker");
+	CrossPlatformString path;
+	unsigned char header[PNG_VERIFY_HEADER_SIZE];
+	while (true) {
+		const size_t blockStart = work->nextBlock.fetch_add(PNG_VERIFY_BLOCK);
+		if (blockStart >= work->results.size()) {
+			return;
+		}
+		const size_t blockEnd = work->results.size() - blockStart > PNG_VERIFY_BLOCK ? blockStart + PNG_VERIFY_BLOCK : work->results.size();
+		ToolTraceSpan span("verify block", "file", (long long)work->start + (long long)blockStart);
+#ifndef FOR_LINUX
+		HANDLE handles[PNG_VERIFY_BLOCK];
+#else
+		int handles[PNG_VERIFY_BLOCK];
+#endif
+		for (size_t offset = blockStart; offset < blockEnd; ++offset) {
+			struct PNGVerifyResult& result = work->results[offset];
+			memset(&result, 0, sizeof(result));
+			makePNGVerifyPath(path, *work->pathBeforePercents, work->numberOfPercentSigns, *work->pathAfterPercents, work->start + (int)offset);
+#ifndef FOR_LINUX
+			// Windows has no hint for reading a small part of a file ahead of time, the reads below just go one by one
+			HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (handle == INVALID_HANDLE_VALUE) {
+				const DWORD error = GetLastError();
+				result.status = error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND ? PNG_VERIFY_MISSING : PNG_VERIFY_UNREADABLE;
+			}
+			handles[offset - blockStart] = handle;
+#else
+			int handle = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (handle < 0) {
+				result.status = errno == ENOENT ? PNG_VERIFY_MISSING : PNG_VERIFY_UNREADABLE;
+			}
+			else {
+				// start reading the header in the background while the rest of the block gets opened
+				posix_fadvise(handle, 0, PNG_VERIFY_HEADER_SIZE, POSIX_FADV_WILLNEED);
+			}
+			handles[offset - blockStart] = handle;
+#endif
+		}
+		for (size_t offset = blockStart; offset < blockEnd; ++offset) {
+			struct PNGVerifyResult& result = work->results[offset];
+#ifndef FOR_LINUX
+			HANDLE handle = handles[offset - blockStart];
+			if (handle == INVALID_HANDLE_VALUE) continue;
+			DWORD size = 0;
+			const bool read = ReadFile(handle, header, PNG_VERIFY_HEADER_SIZE, &size, NULL) != 0;
+			CloseHandle(handle);
+#else
+			int handle = handles[offset - blockStart];
+			if (handle < 0) continue;
+			const ssize_t size = pread(handle, header, PNG_VERIFY_HEADER_SIZE, 0);
+			const bool read = size >= 0;
+			close(handle);
+#endif
+			countToolStats(toolStats.files);
+			if (!read) {
+				result.status = PNG_VERIFY_UNREADABLE;
+				continue;
+			}
+			checkPNGHeader(header, (size_t)size, result);
+		}
+	}
+}
+
+static const CrossPlatformChar* describePNGVerifyColorType(int colorType) {
+	switch (colorType) {
+	case 0: return CrossPlatformText("grayscale");
+	case 2: return CrossPlatformText("RGB");
+	case 3: return CrossPlatformText("palette");
+	case 4: return CrossPlatformText("grayscale with alpha");
+	default: return CrossPlatformText("RGBA");
+	}
+}
+
+static void printPNGVerifyFormat(const struct PNGVerifyResult& result) {
+	CrossPlatformCout << result.width << CrossPlatformText("x") << result.height << CrossPlatformText(" ") << (int)result.bitDepth
+		<< CrossPlatformText("-bit ") << describePNGVerifyColorType(result.colorType);
+}
+
+static bool samePNGVerifyProblem(const struct PNGVerifyResult& a, const struct PNGVerifyResult& b) {
+	return a.status == b.status && (a.status != PNG_VERIFY_MISMATCH
+		|| (a.width == b.width && a.height == b.height && a.bitDepth == b.bitDepth && a.colorType == b.colorType));
+}
+
+/**
+* Function finds the -verify and -threads ## options among the arguments and removes them,
+* so that the rest of the argument parsing stays the same.
+* Returns false if -threads isn't followed by a positive number.
+* @param verify Set to true if -verify was there
+* @param threadCount Set to the -threads value if it was there
+*/
+bool takePNGVerifyOptions(int& argc, CrossPlatformChar* argv[], bool& verify, int& threadCount) {
+	bool ok = true;
+	for (int i = 1; i < argc; ++i) {
+		int taken = 0;
+		if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-verify")) == 0) {
+			verify = true;
+			taken = 1;
+		}
+		else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-threads")) == 0) {
+			taken = i + 1 < argc ? 2 : 1;
+			CrossPlatformChar* valueEnd = NULL;
+#ifndef FOR_LINUX
+			const long value = taken == 2 ? wcstol(argv[i + 1], &valueEnd, 10) : 0;
+#else
+			const long value = taken == 2 ? strtol(argv[i + 1], &valueEnd, 10) : 0;
+#endif
+			if (taken != 2 || *valueEnd != 0 || value <= 0 || value > 1024) {
+				ok = false;
+			}
+			else {
+				threadCount = (int)value;
+			}
+		}
+		if (!taken) {
+			continue;
+		}
+		for (int j = i; j + taken < argc; ++j) {
+			argv[j] = argv[j + taken];
+		}
+		argc -= taken;
+		argv[argc] = NULL;
+		--i;
+	}
+	return ok;
+}
+
+/**
+* Function checks that every file of a numbered frame sequence exists, is a PNG with a valid IHDR chunk, and has the same
+* width, height, bit depth and color type as the first valid one. Only the first 33 bytes of each file are read,
+* nothing is decoded. Files are checked on several threads.
+* Prints the problems, with consecutive frames that have the same problem printed as one range, and a summary.
+* Returns the number of frames with problems.
+* @param threadCount How many threads read files. Reading headers mostly waits for the disk or the network,
+*                    so this can be much higher than the number of CPU cores
+*/
+int verifyPNGSequence(const CrossPlatformString& pathBeforePercents, size_t numberOfPercentSigns, const CrossPlatformString& pathAfterPercents,
+	int start, int end, int threadCount)
+{
+	const auto startTime = std::chrono::steady_clock::now();
+	struct PNGVerifyWork work;
+	work.pathBeforePercents = &pathBeforePercents;
+	work.numberOfPercentSigns = numberOfPercentSigns;
+	work.pathAfterPercents = &pathAfterPercents;
+	work.start = start;
+	work.end = end;
+	work.nextBlock = 0;
+	work.results.resize((size_t)(end - start) + 1);
+	if (threadCount > (end - start) / PNG_VERIFY_BLOCK + 1) threadCount = (end - start) / PNG_VERIFY_BLOCK + 1;
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threadCount; ++i) {
+		threads.emplace_back(runPNGVerifyWorker, &work);
+	}
+	runPNGVerifyWorker(&work);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	int reference = -1; // first valid frame, the rest must match it
+	for (size_t i = 0; i < work.results.size(); ++i) {
+		struct PNGVerifyResult& result = work.results[i];
+		if (result.status != PNG_VERIFY_OK) continue;
+		if (reference == -1) {
+			reference = (int)i;
+		}
+		else {
+			const struct PNGVerifyResult& first = work.results[reference];
+			if (result.width != first.width || result.height != first.height || result.bitDepth != first.bitDepth || result.colorType != first.colorType) {
+				result.status = PNG_VERIFY_MISMATCH;
+			}
+		}
+	}
+
+	int problems = 0;
+	CrossPlatformString path;
+	for (size_t i = 0; i < work.results.size(); ) {
+		const struct PNGVerifyResult& result = work.results[i];
+		size_t runEnd = i + 1;
+		while (runEnd < work.results.size() && samePNGVerifyProblem(work.results[runEnd], result)) ++runEnd;
+		if (result.status != PNG_VERIFY_OK) {
+			problems += (int)(runEnd - i);
+			makePNGVerifyPath(path, pathBeforePercents, numberOfPercentSigns, pathAfterPercents, start + (int)i);
+			if (runEnd - i == 1) {
+				CrossPlatformCout << CrossPlatformText("Frame ") << start + (int)i << CrossPlatformText(" (") << path.c_str() << CrossPlatformText("): ");
+			}
+			else {
+				CrossPlatformCout << CrossPlatformText("Frames ") << start + (int)i << CrossPlatformText("-") << start + (int)runEnd - 1
+					<< CrossPlatformText(" (starting with ") << path.c_str() << CrossPlatformText("): ");
+			}
+			switch (result.status) {
+			case PNG_VERIFY_MISSING: CrossPlatformCout << CrossPlatformText("missing"); break;
+			case PNG_VERIFY_UNREADABLE: CrossPlatformCout << CrossPlatformText("can't be read"); break;
+			case PNG_VERIFY_NOT_PNG: CrossPlatformCout << CrossPlatformText("not a PNG file"); break;
+			case PNG_VERIFY_BAD_IHDR: CrossPlatformCout << CrossPlatformText("PNG header (IHDR) is damaged"); break;
+			default:
+				printPNGVerifyFormat(result);
+				CrossPlatformCout << CrossPlatformText(", while frame ") << start + reference << CrossPlatformText(" is ");
+				printPNGVerifyFormat(work.results[reference]);
+				break;
+			}
+			CrossPlatformCout << CrossPlatformText("\n");
+		}
+		i = runEnd;
+	}
+	const long long elapsedMs = (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+	CrossPlatformCout << CrossPlatformText("Checked ") << work.results.size() << CrossPlatformText(" frames in ") << elapsedMs << CrossPlatformText(" ms");
+	if (reference != -1) {
+		CrossPlatformCout << CrossPlatformText(", ");
+		printPNGVerifyFormat(work.results[reference]);
+	}
+	CrossPlatformCout << CrossPlatformText(": ") << problems << CrossPlatformText(" with problems.\n");
+	return problems;
+}
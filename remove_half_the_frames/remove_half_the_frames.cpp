@@ -7,8 +7,13 @@
 #else
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #endif
 #include "CrossPlatformDefs.h"
+#include "PNG_verify.h"
+#include "Frame_journal.h"
+#include "ToolStats.h"
+#include "ToolTrace.h"
 
 #ifndef FOR_LINUX
 #define CrossPlatformMainName wmain
@@ -101,8 +106,12 @@ CrossPlatformString repeatChar(CrossPlatformChar c, int n) {
 }
 
 bool crossPlatformMoveFile(const CrossPlatformString& source, const CrossPlatformString& dest) {
+    countToolStats(toolStats.renames);
+    countToolStats(toolStats.files);
+    ToolTraceSpan span("rename", "io", source.c_str());
 #ifndef FOR_LINUX
-    if (!MoveFileExW(source.c_str(), dest.c_str(), MOVEFILE_WRITE_THROUGH)) {
+    // no MOVEFILE_WRITE_THROUGH, the journal syncs the directory as often as -durability asks
+    if (!MoveFileExW(source.c_str(), dest.c_str(), 0)) {
         WinError winErr;
         CrossPlatformCerr << "Error moving file from " << source.c_str() << " to " << dest.c_str() << ": " << winErr.getMessage() << std::endl;
         return false;
@@ -111,7 +120,7 @@ bool crossPlatformMoveFile(const CrossPlatformString& source, const CrossPlatfor
     int errCode = rename(source.c_str(), dest.c_str());
 
     if (errCode) {
-        CrossPlatformCerr << "Error moving file from " << source.c_str() << " to " << dest.c_str() << ": " << strerror(errCode) << std::endl;
+        CrossPlatformCerr << "Error moving file from " << source.c_str() << " to " << dest.c_str() << ": " << strerror(errno) << std::endl;
         return false;
     }
 #endif
@@ -119,6 +128,9 @@ bool crossPlatformMoveFile(const CrossPlatformString& source, const CrossPlatfor
 }
 
 bool crossPlatformDeleteFile(const CrossPlatformString& path) {
+    countToolStats(toolStats.unlinks);
+    countToolStats(toolStats.files);
+    ToolTraceSpan span("unlink", "io", path.c_str());
 #ifndef FOR_LINUX
     if (!DeleteFile(path.c_str())) {
         WinError winErr;
@@ -129,7 +141,7 @@ bool crossPlatformDeleteFile(const CrossPlatformString& path) {
     int errCode = remove(path.c_str());
 
     if (errCode) {
-        CrossPlatformCerr << "Error deleting file " << path.c_str() << ": " << strerror(errCode) << std::endl;
+        CrossPlatformCerr << "Error deleting file " << path.c_str() << ": " << strerror(errno) << std::endl;
         return false;
     }
 #endif
@@ -150,11 +162,41 @@ CrossPlatformString& numberToStringAndPad(int numberToBeConverted, size_t totalC
 #define PARAMETERS_FORMAT_HELP CrossPlatformText("1 - input/output file path (files will be renamed) points to files with names like")\
     CrossPlatformText(" image1.png, image2.png, image3.png, where the 1, 2, 3, etc part is replaced with a % sign.\n")\
     CrossPlatformText("Use multiple % signs if you want the number to be 0-padded on the left.\n")\
-	CrossPlatformText("2 - frame range in format 0-20. This specifies the range of frames to affect.\n")
+	CrossPlatformText("2 - frame range in format 0-20. This specifies the range of frames to affect.\n")\
+	CrossPlatformText("Optional: -verify - don't delete or rename anything, only check that every frame of the range exists, is a PNG file and has the same")\
+	CrossPlatformText(" width, height, bit depth and color type as the others. Only the first 33 bytes of each file are read. Exits with -1 if there are problems.\n")\
+	CrossPlatformText("Optional: -threads ## - how many files -verify reads at the same time. 16 by default.\n")\
+	CrossPlatformText("Optional: --resume - finish a job that got interrupted, from the journal it left next to the frames. Give it the same arguments as the job.\n")\
+	CrossPlatformText("Optional: -durability none|per-op|batched - when the renames and deletes get synced to the disk, so that they survive a power loss.")\
+	CrossPlatformText(" none leaves it to the system, per-op syncs after each one, batched (the default) syncs the directory once per 1024.\n")\
+	CrossPlatformText("Optional: --stats - when the program exits, print a line of JSON to stderr with the time spent")\
+	CrossPlatformText(" and the number of file operations done.\n")\
+	CrossPlatformText("Optional: --trace \"path\" - write a timeline of every rename and delete into \"path\" in Chrome's trace format")\
+	CrossPlatformText(" (open it in chrome://tracing or ui.perfetto.dev).\n")
 
 
 int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar* envp[])
 {
+    if (!takeToolStatsOptions("remove_half_the_frames", argc, argv)) {
+        CrossPlatformCerr << CrossPlatformText("A file path for the trace must be provided after the --trace option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    bool metVerifyFlag = false;
+    int threadsValue = PNG_VERIFY_DEFAULT_THREADS;
+    if (!takePNGVerifyOptions(argc, argv, metVerifyFlag, threadsValue)) {
+        CrossPlatformCerr << CrossPlatformText("A thread count from 1 to 1024 must be provided after the -threads option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    bool metResumeFlag = false;
+    FrameDurability durability = FRAME_DURABILITY_BATCHED;
+    if (!takeFrameJournalOptions(argc, argv, metResumeFlag, durability)) {
+        CrossPlatformCerr << CrossPlatformText("The -durability option must be followed by none, per-op or batched. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (metResumeFlag && metVerifyFlag) {
+        CrossPlatformCerr << CrossPlatformText("The --resume and -verify options can't be used together. Use --help or /? option for help.\n");
+        exit(-1);
+    }
     if (argc == 2 && (
         CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("-help")) == 0
         || CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("--help")) == 0
@@ -222,31 +264,55 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         exit(-1);
     }
 
-    bool needsToBeDeleted = false;
+    if (metVerifyFlag) {
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        const int problems = verifyPNGSequence(pathBeforePercents, numberOfPercentSigns, pathAfterPercents, start, end, threadsValue);
+        exit(problems ? -1 : 0);
+    }
+
+    beginToolStatsPhase(TOOL_STATS_PLAN);
+    FrameJournal journal;
+    const std::string plan = "remove_half_the_frames " + std::to_string(start) + "-" + std::to_string(end);
+    if (beginFrameJournal(journal, path, plan, metResumeFlag, durability) != 0) {
+        exit(-1);
+    }
+
+    beginToolStatsPhase(TOOL_STATS_EXECUTE);
+    ToolTraceSpan batch("renames and unlinks", "io", (long long)(end - start + 1));
     CrossPlatformString sourcePath;
     CrossPlatformString destPath;
-    int dest = start;
-    for (int i = start; i <= end; ++i) {
+    for (int i = start + journal.done; i <= end; ++i) {
+        // every other frame from the first one is kept and moved down to the lowest free number
+        const bool needsToBeDeleted = (i - start) % 2 == 1;
+        const int dest = start + (i - start) / 2;
+        sourcePath = pathBeforePercents;
+        sourcePath += numberToStringAndPad(i, numberOfPercentSigns);
+        sourcePath += pathAfterPercents;
+        bool failed = false;
         if (!needsToBeDeleted) {
             if (i != dest) {
-                sourcePath = pathBeforePercents;
-                sourcePath += numberToStringAndPad(i, numberOfPercentSigns);
-                sourcePath += pathAfterPercents;
                 destPath = pathBeforePercents;
                 destPath += numberToStringAndPad(dest, numberOfPercentSigns);
                 destPath += pathAfterPercents;
-                crossPlatformMoveFile(sourcePath, destPath);
+                // a destination that exists got there before the interruption, since frames only move into freed spots
+                if (!isFrameJournalReplaying(journal) || !fileExists(destPath)) {
+                    prepareFrameJournalRename(journal, dest);
+                    failed = !crossPlatformMoveFile(sourcePath, destPath);
+                }
             }
-            ++dest;
-        } else {
-            sourcePath = pathBeforePercents;
-            sourcePath += numberToStringAndPad(i, numberOfPercentSigns);
-            sourcePath += pathAfterPercents;
-            crossPlatformDeleteFile(sourcePath);
+        } else if (!isFrameJournalReplaying(journal) || fileExists(sourcePath)) {
+            failed = !crossPlatformDeleteFile(sourcePath);
+        }
+        // a missing frame gets reported and skipped, anything else stops the job, since a frame moved later could land on this one
+        if (failed && fileExists(sourcePath)) {
+            endFrameJournal(journal, false);
+            CrossPlatformCerr << CrossPlatformText("Stopped at the first frame that couldn't be moved or deleted, the frames after it are untouched.")
+                << CrossPlatformText(" Fix the problem and run the same command with --resume to finish the job.\n");
+            exit(-1);
         }
-        needsToBeDeleted = !needsToBeDeleted;
+        finishFrameJournalOperation(journal, needsToBeDeleted ? i : -1);
     }
-
+    endFrameJournal(journal, true);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include "Frame_journal.h"
+#include <string.h>
+#include <iostream>
+#ifndef FOR_LINUX
+#include <Windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "ToolStats.h"
+#include "ToolTrace.h"
+
+// This file is copy-pasted between the renumber_frames and remove_half_the_frames projects. Keep the copies identical.
+
+#define FRAME_JOURNAL_HEADER "GIFTools frame journal 1"
+#define FRAME_JOURNAL_LINE_LENGTH 256
+
+/**
+* Function finds the --resume and -durability none|per-op|batched options among the arguments and removes them,
+* so that the rest of the argument parsing stays the same.
+* Returns false if -durability isn't followed by one of its values.
+* @param resume Set to true if --resume was there
+* @param durability Set to the -durability value if it was there
+*/
+bool takeFrameJournalOptions(int& argc, CrossPlatformChar* argv[], bool& resume, FrameDurability& durability) {
+	bool ok = true;
+	for (int i = 1; i < argc; ++i) {
+		int taken = 0;
+		if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("--resume")) == 0) {
+			resume = true;
+			taken = 1;
+		}
+		else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-durability")) == 0) {
+			taken = i + 1 < argc ? 2 : 1;
+			if (taken != 2) {
+				ok = false;
+			}
+			else if (CrossPlatformCaseInsensitiveTextCompare(argv[i + 1], CrossPlatformText("none")) == 0) {
+				durability = FRAME_DURABILITY_NONE;
+			}
+			else if (CrossPlatformCaseInsensitiveTextCompare(argv[i + 1], CrossPlatformText("per-op")) == 0) {
+				durability = FRAME_DURABILITY_PER_OP;
+			}
+			else if (CrossPlatformCaseInsensitiveTextCompare(argv[i + 1], CrossPlatformText("batched")) == 0) {
+				durability = FRAME_DURABILITY_BATCHED;
+			}
+			else {
+				ok = false;
+			}
+		}
+		if (!taken) {
+			continue;
+		}
+		for (int j = i; j + taken < argc; ++j) {
+			argv[j] = argv[j + taken];
+		}
+		argc -= taken;
+		argv[argc] = NULL;
+		--i;
+	}
+	return ok;
+}
+
+static bool openFrameJournalFile(FILE** file, const CrossPlatformString& path, const CrossPlatformChar* mode) {
+#ifndef FOR_LINUX
+	if (_wfopen_s(file, path.c_str(), mode) || !*file) {
+		if (*file) {
+			fclose(*file);
+		}
+		*file = NULL;
+		return false;
+	}
+	return true;
+#else
+	*file = fopen(path.c_str(), mode);
+	return *file != NULL;
+#endif
+}
+
+/**
+* Function opens the directory the frames are in, so that the renames and deletes in it can be synced to the disk.
+* Returns false on error, after printing it.
+*/
+static bool openFrameJournalDirectory(FrameJournal& journal, const CrossPlatformString& sequencePath) {
+	size_t slash = sequencePath.find_last_of(
+#ifndef FOR_LINUX
+		CrossPlatformText("\\/")
+#else
+		CrossPlatformText("/")
+#endif
+	);
+	CrossPlatformString directory;
+	if (slash == CrossPlatformString::npos) {
+		directory = CrossPlatformText(".");
+	} else {
+		directory = sequencePath.substr(0, slash == 0 ? 1 : slash);
+		// "C:" alone would mean the current directory of drive C, not its root
+		if (directory.back() == CrossPlatformText(':')) directory += sequencePath[slash];
+	}
+#ifndef FOR_LINUX
+	// only a handle with write access can be flushed
+	journal.directory = CreateFileW(directory.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+	if (journal.directory == INVALID_HANDLE_VALUE) {
+#else
+	journal.directory = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if (journal.directory == -1) {
+#endif
+		CrossPlatformPerror(directory.c_str());
+		CrossPlatformCerr << CrossPlatformText("Couldn't open the directory of the frames to sync it to the disk. Use -durability none to go without.\n");
+		return false;
+	}
+	return true;
+}
+
+// Makes the renames and deletes done in the frames' directory so far reach the disk, unless the durability is none.
+static void syncFrameJournalDirectory(FrameJournal& journal) {
+	if (journal.durability == FRAME_DURABILITY_NONE) {
+		return;
+	}
+	ToolTraceSpan span("directory sync", "io", (long long)journal.done);
+	countToolStats(toolStats.syncs);
+#ifndef FOR_LINUX
+	FlushFileBuffers((HANDLE)journal.directory);
+#else
+	fsync(journal.directory);
+#endif
+}
+
+static void closeFrameJournalDirectory(FrameJournal& journal) {
+#ifndef FOR_LINUX
+	if (journal.directory != INVALID_HANDLE_VALUE) {
+		CloseHandle((HANDLE)journal.directory);
+		journal.directory = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (journal.directory != -1) {
+		close(journal.directory);
+		journal.directory = -1;
+	}
+#endif
+}
+
+// Flushes the journal from the C library's buffer and then, unless the durability is none, from the operating system's cache to the disk.
+static void syncFrameJournal(FrameJournal& journal) {
+	fflush(journal.file);
+	if (journal.durability == FRAME_DURABILITY_NONE) {
+		return;
+	}
+	countToolStats(toolStats.syncs);
+#ifndef FOR_LINUX
+	FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(journal.file)));
+#else
+	fsync(fileno(journal.file));
+#endif
+}
+
+static void writeFrameJournalRecord(FrameJournal& journal) {
+	ToolTraceSpan span("journal record", "io", (long long)journal.done);
+	// with per-op the directory got synced after each operation already
+	if (journal.durability == FRAME_DURABILITY_BATCHED) {
+		syncFrameJournalDirectory(journal);
+	}
+	fprintf(journal.file, "done %d\n", journal.done);
+	syncFrameJournal(journal);
+	journal.checkpointed = journal.done;
+	journal.deletedMin = 0;
+	journal.deletedMax = -1;
+}
+
+/**
+* Function starts a job's journal, at the sequence path (the one with the % signs) with ".journal" added.
+* Without resume, refuses to start if a journal is already there, since the frames are then halfway through another job,
+* and otherwise writes the plan and flushes it to the disk before anything gets renamed.
+* With resume, reads the journal of the interrupted job, which must have the same plan, and continues it from its last record.
+* Returns 0 on success, -1 on error, after printing it.
+* @param plan One line describing the job, from which the operations and their order follow. Compared on resume
+* @param durability Applies to the job's operations and to the journal itself
+*/
+int beginFrameJournal(FrameJournal& journal, const CrossPlatformString& sequencePath, const std::string& plan, bool resume, FrameDurability durability) {
+	journal.path = sequencePath + CrossPlatformText(".journal");
+	journal.file = NULL;
+	journal.done = 0;
+	journal.checkpointed = 0;
+	journal.replayUntil = 0;
+	journal.deletedMin = 0;
+	journal.deletedMax = -1;
+	journal.durability = durability;
+#ifndef FOR_LINUX
+	journal.directory = INVALID_HANDLE_VALUE;
+#else
+	journal.directory = -1;
+#endif
+	if (durability != FRAME_DURABILITY_NONE && !openFrameJournalDirectory(journal, sequencePath)) {
+		return -1;
+	}
+	FILE* existing = NULL;
+	const bool exists = openFrameJournalFile(&existing, journal.path, CrossPlatformText("rb"));
+	if (!resume) {
+		if (exists) {
+			fclose(existing);
+			closeFrameJournalDirectory(journal);
+			CrossPlatformCerr << CrossPlatformText("The journal ") << journal.path.c_str()
+				<< CrossPlatformText(" of an interrupted job is there, so the frames are halfway through being moved.")
+				<< CrossPlatformText(" Run the same command as that job with --resume to finish it, or delete the journal if the frames got put back by hand.\n");
+			return -1;
+		}
+		if (!openFrameJournalFile(&journal.file, journal.path, CrossPlatformText("wb"))) {
+			CrossPlatformPerror(journal.path.c_str());
+			closeFrameJournalDirectory(journal);
+			return -1;
+		}
+		fprintf(journal.file, "%s\n%s\n", FRAME_JOURNAL_HEADER, plan.c_str());
+		syncFrameJournal(journal);
+		// the journal is a new file in the same directory, which must be on the disk too before anything gets moved
+		syncFrameJournalDirectory(journal);
+		return 0;
+	}
+
+	if (!exists) {
+		CrossPlatformCerr << CrossPlatformText("There's no journal at ") << journal.path.c_str()
+			<< CrossPlatformText(" to resume from. The job either finished or never started.\n");
+		closeFrameJournalDirectory(journal);
+		return -1;
+	}
+	char line[FRAME_JOURNAL_LINE_LENGTH];
+	int lineNumber = 0;
+	bool lastLineComplete = true;
+	bool planMatches = false;
+	while (fgets(line, FRAME_JOURNAL_LINE_LENGTH, existing)) {
+		size_t length = strlen(line);
+		lastLineComplete = length > 0 && line[length - 1] == '\n';
+		if (!lastLineComplete) {
+			// a record cut short by the interruption, or a line too long to be one of ours
+			continue;
+		}
+		line[--length] = '\0';
+		if (length > 0 && line[length - 1] == '\r') line[--length] = '\0';
+		++lineNumber;
+		if (lineNumber == 1 && strcmp(line, FRAME_JOURNAL_HEADER) != 0) {
+			break;
+		}
+		if (lineNumber == 2) {
+			planMatches = plan == line;
+			if (!planMatches) {
+				fclose(existing);
+				closeFrameJournalDirectory(journal);
+				CrossPlatformCerr << CrossPlatformText("The journal ") << journal.path.c_str()
+					<< CrossPlatformText(" is of a different job: ") << line << CrossPlatformText(". Run --resume with the same arguments as that job.\n");
+				return -1;
+			}
+		}
+		int done = 0;
+		if (lineNumber > 2 && sscanf(line, "done %d", &done) == 1 && done > journal.done) {
+			journal.done = done;
+		}
+	}
+	fclose(existing);
+	if (lineNumber < 2 || !planMatches) {
+		CrossPlatformCerr << CrossPlatformText("The journal ") << journal.path.c_str() << CrossPlatformText(" is not a GIFTools frame journal or is damaged.\n");
+		closeFrameJournalDirectory(journal);
+		return -1;
+	}
+	if (!openFrameJournalFile(&journal.file, journal.path, CrossPlatformText("ab"))) {
+		CrossPlatformPerror(journal.path.c_str());
+		closeFrameJournalDirectory(journal);
+		return -1;
+	}
+	if (!lastLineComplete) {
+		fputc('\n', journal.file);
+	}
+	journal.checkpointed = journal.done;
+	journal.replayUntil = journal.done + FRAME_JOURNAL_CHECKPOINT_OPS;
+	CrossPlatformCout << CrossPlatformText("Resuming after operation ") << journal.done << CrossPlatformText(".\n");
+	return 0;
+}
+
+/**
+* Returns true while the current operation might have been done before the interruption, after the last record.
+* The caller then checks whether it was done: a rename whose destination exists, or a delete whose file doesn't.
+*/
+bool isFrameJournalReplaying(const FrameJournal& journal) {
+	return journal.done < journal.replayUntil;
+}
+
+// Call before renaming a frame into destinationNumber. If that frame number got deleted after the last record,
+// writes a record first, otherwise a replay couldn't tell the deleted frame from the renamed one.
+void prepareFrameJournalRename(FrameJournal& journal, int destinationNumber) {
+	if (destinationNumber >= journal.deletedMin && destinationNumber <= journal.deletedMax) {
+		writeFrameJournalRecord(journal);
+	}
+}
+
+/**
+* Call after each operation in plan order, including the ones skipped or failed. With per-op durability, syncs the directory.
+* Writes a record every FRAME_JOURNAL_CHECKPOINT_OPS operations.
+* @param deletedNumber The frame number the operation deleted, -1 if it was a rename
+*/
+void finishFrameJournalOperation(FrameJournal& journal, int deletedNumber) {
+	if (journal.durability == FRAME_DURABILITY_PER_OP) {
+		syncFrameJournalDirectory(journal);
+	}
+	if (deletedNumber >= 0) {
+		if (journal.deletedMax < journal.deletedMin) {
+			journal.deletedMin = journal.deletedMax = deletedNumber;
+		} else if (deletedNumber < journal.deletedMin) {
+			journal.deletedMin = deletedNumber;
+		} else if (deletedNumber > journal.deletedMax) {
+			journal.deletedMax = deletedNumber;
+		}
+	}
+	++journal.done;
+	if (journal.done - journal.checkpointed >= FRAME_JOURNAL_CHECKPOINT_OPS) {
+		writeFrameJournalRecord(journal);
+	}
+}
+
+/**
+* Call once the job is over.
+* @param finished True if every operation got done, then the journal gets deleted, since there's nothing left to resume.
+*                 False if the job stopped at a failed operation, then the journal gets a last record and stays for --resume
+*/
+void endFrameJournal(FrameJournal& journal, bool finished) {
+	if (!finished) {
+		writeFrameJournalRecord(journal);
+	} else if (journal.durability == FRAME_DURABILITY_BATCHED) {
+		// the last operations must be on the disk before the journal is gone, otherwise a power loss could leave them undone with no journal
+		syncFrameJournalDirectory(journal);
+	}
+	fclose(journal.file);
+	journal.file = NULL;
+	if (!finished) {
+		closeFrameJournalDirectory(journal);
+		return;
+	}
+#ifndef FOR_LINUX
+	if (_wremove(journal.path.c_str()) != 0) {
+#else
+	if (remove(journal.path.c_str()) != 0) {
+#endif
+		CrossPlatformPerror(journal.path.c_str());
+	}
+	syncFrameJournalDirectory(journal);
+	closeFrameJournalDirectory(journal);
+}
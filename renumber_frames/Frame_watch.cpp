@@ -0,0 +1,394 @@
+#include "Frame_watch.h"
+#include <limits.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#ifndef FOR_LINUX
+#include <Windows.h>
+#include "WinError.h"
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+#include "ToolTrace.h"
+
+struct FrameWatchState {
+	const FrameWatchOptions* options;
+	CrossPlatformString directory; // the part of the path before the file name, including the trailing separator. Empty for the current directory
+	CrossPlatformString namePrefix; // the part of the file name before the number
+	long long destinationEnd; // last number a frame can be moved to
+	std::unordered_set<int> occupied; // with compact, numbers from nextFree to destinationEnd that have a file
+	long long nextFree; // with compact, every number from destination to nextFree - 1 has a file, so those aren't kept in occupied
+	long long moved;
+	long long failed;
+	CrossPlatformString sourcePath;
+	CrossPlatformString destPath;
+};
+
+#ifndef FOR_LINUX
+static volatile LONG frameWatchStopRequested = 0;
+
+static BOOL WINAPI stopFrameWatch(DWORD /*controlType*/) {
+	InterlockedExchange(&frameWatchStopRequested, 1);
+	return TRUE;
+}
+#else
+static volatile sig_atomic_t frameWatchStopRequested = 0;
+
+static void stopFrameWatch(int /*signalNumber*/) {
+	frameWatchStopRequested = 1;
+}
+#endif
+
+static void makeFrameWatchPath(CrossPlatformString& path, const FrameWatchOptions& options, long long number) {
+	CrossPlatformString digits = CrossPlatformNumberToString(number);
+	path = options.pathBeforePercents;
+	if (digits.size() < options.numberOfPercentSigns) path.append(options.numberOfPercentSigns - digits.size(), CrossPlatformText('0'));
+	path += digits;
+	path += options.pathAfterPercents;
+}
+
+/**
+* Function checks if a file name matches the path pattern and gets the number out of it.
+* The number must be padded exactly like renumber_frames would pad it, so that the name can be built back from the number.
+* @param name File name without the directory
+* @param nameLength Length of the name in characters
+*/
+static bool parseFrameWatchName(const struct FrameWatchState& state, const CrossPlatformChar* name, size_t nameLength, int& number) {
+	const CrossPlatformString& prefix = state.namePrefix;
+	const CrossPlatformString& suffix = state.options->pathAfterPercents;
+	if (nameLength <= prefix.size() + suffix.size()) return false;
+	if (prefix.compare(0, prefix.size(), name, prefix.size()) != 0) return false;
+	if (suffix.compare(0, suffix.size(), name + nameLength - suffix.size(), suffix.size()) != 0) return false;
+	const CrossPlatformChar* digits = name + prefix.size();
+	const size_t digitCount = nameLength - prefix.size() - suffix.size();
+	if (digitCount < state.options->numberOfPercentSigns || (digitCount > state.options->numberOfPercentSigns && digits[0] == CrossPlatformText('0'))) {
+		return false;
+	}
+	long long value = 0;
+	for (size_t i = 0; i < digitCount; ++i) {
+		if (digits[i] < CrossPlatformText('0') || digits[i] > CrossPlatformText('9')) return false;
+		value = value * 10 + (digits[i] - CrossPlatformText('0'));
+		if (value > INT_MAX) return false;
+	}
+	number = (int)value;
+	return true;
+}
+
+/**
+* Function checks if a file can be moved right now.
+* On Windows, a file that's still open by the program writing it can't be opened exclusively, and gets skipped until the next change notification.
+*/
+static bool frameWatchFileReady(const CrossPlatformString& path) {
+#ifndef FOR_LINUX
+	HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	CloseHandle(handle);
+	return true;
+#else
+	return access(path.c_str(), F_OK) == 0;
+#endif
+}
+
+static bool frameWatchFileExists(const CrossPlatformString& path) {
+#ifndef FOR_LINUX
+	return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+#else
+	return access(path.c_str(), F_OK) == 0;
+#endif
+}
+
+/**
+* Function notes that a number of the destination range has a file.
+* Only compact needs to know, and only for the numbers it hasn't filled up to yet, so that the set stays as small as the gaps ahead.
+* Without compact, each destination gets checked right before its rename instead.
+*/
+static void markFrameWatchOccupied(struct FrameWatchState& state, int number) {
+	if (state.options->compact && number >= state.nextFree) {
+		state.occupied.insert(number);
+	}
+}
+
+/**
+* Function handles a file name that appeared in the directory.
+* A frame from the watched range gets moved, a file in the destination range gets marked as occupied, anything else is ignored.
+*/
+static void placeFrame(struct FrameWatchState& state, int number) {
+	const FrameWatchOptions& options = *state.options;
+	if (number >= options.destination && number <= state.destinationEnd) {
+		markFrameWatchOccupied(state, number);
+		return;
+	}
+	if (number < options.start || number > options.end) {
+		return;
+	}
+	makeFrameWatchPath(state.sourcePath, options, number);
+	if (!frameWatchFileReady(state.sourcePath)) {
+		return; // already moved, or still being written
+	}
+	long long destNumber;
+	if (options.compact) {
+		while (state.nextFree <= state.destinationEnd && state.occupied.erase((int)state.nextFree)) {
+			++state.nextFree;
+		}
+		if (state.nextFree > state.destinationEnd) {
+			CrossPlatformCerr << CrossPlatformText("Cannot move ") << state.sourcePath.c_str()
+				<< CrossPlatformText(" because every number of the destination range is taken.\n");
+			++state.failed;
+			return;
+		}
+		destNumber = state.nextFree;
+	}
+	else {
+		destNumber = (long long)number - options.start + options.destination;
+	}
+	makeFrameWatchPath(state.destPath, options, destNumber);
+	if (frameWatchFileExists(state.destPath)) {
+		// with compact, appeared after the last notification was read. Its own notification marks it as occupied again, which does no harm
+		markFrameWatchOccupied(state, (int)destNumber);
+		CrossPlatformCerr << CrossPlatformText("Cannot move ") << state.sourcePath.c_str() << CrossPlatformText(" because file ")
+			<< state.destPath.c_str() << CrossPlatformText(" exists and would be overwritten.\n");
+		++state.failed;
+		return;
+	}
+	if (!options.moveFile(state.sourcePath, state.destPath)) {
+		++state.failed;
+		return;
+	}
+	if (options.compact) {
+		++state.nextFree; // the rename's own notification comes after this, and is ignored for being below nextFree
+	}
+	++state.moved;
+}
+
+/**
+* Function lists the directory once and handles every matching file in it, frames from the watched range in the order of their numbers.
+* Done at the start, and again if the system dropped change notifications.
+* Returns false if the directory can't be listed.
+*/
+static bool scanFrameWatchDirectory(struct FrameWatchState& state) {
+	ToolTraceSpan span("scan directory", "io", state.directory.c_str());
+	std::vector<int> arrivals;
+	int number;
+#ifndef FOR_LINUX
+	WIN32_FIND_DATAW findData;
+	HANDLE find = FindFirstFileW((state.directory + CrossPlatformText("*")).c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE) {
+		WinError winErr;
+		CrossPlatformCerr << CrossPlatformText("Error listing directory ") << state.directory.c_str() << CrossPlatformText(": ") << winErr.getMessage() << std::endl;
+		return false;
+	}
+	do {
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+		if (!parseFrameWatchName(state, findData.cFileName, wcslen(findData.cFileName), number)) continue;
+		if (number >= state.options->destination && number <= state.destinationEnd) {
+			markFrameWatchOccupied(state, number);
+		}
+		else if (number >= state.options->start && number <= state.options->end) {
+			arrivals.push_back(number);
+		}
+	} while (FindNextFileW(find, &findData));
+	FindClose(find);
+#else
+	DIR* dir = opendir(state.directory.empty() ? "." : state.directory.c_str());
+	if (!dir) {
+		CrossPlatformCerr << CrossPlatformText("Error listing directory ") << (state.directory.empty() ? "." : state.directory.c_str())
+			<< CrossPlatformText(": ") << strerror(errno) << std::endl;
+		return false;
+	}
+	while (struct dirent* entry = readdir(dir)) {
+		if (entry->d_type == DT_DIR) continue;
+		if (!parseFrameWatchName(state, entry->d_name, strlen(entry->d_name), number)) continue;
+		if (number >= state.options->destination && number <= state.destinationEnd) {
+			markFrameWatchOccupied(state, number);
+		}
+		else if (number >= state.options->start && number <= state.options->end) {
+			arrivals.push_back(number);
+		}
+	}
+	closedir(dir);
+#endif
+	std::sort(arrivals.begin(), arrivals.end());
+	for (int arrival : arrivals) {
+		placeFrame(state, arrival);
+	}
+	return true;
+}
+
+/**
+* Function moves frames from the start-end range into the destination range as they appear in the directory, until Ctrl+C.
+* The directory is listed once at the start. After that, only the names the system reports as new are looked at,
+* and with options.compact, which destination numbers past the filled ones are taken is kept in memory,
+* so each new frame costs a check and a rename no matter how many files there are.
+* Frames keep their offset from start, or with options.compact, go to the lowest free destination number in the order they appear.
+* The watched range and the destination range must not overlap.
+* Returns 0 if stopped by Ctrl+C, -1 if watching failed.
+*/
+int watchFrames(const FrameWatchOptions& options) {
+	struct FrameWatchState state;
+	state.options = &options;
+	state.destinationEnd = (long long)options.destination + options.end - options.start;
+	if (state.destinationEnd > INT_MAX) state.destinationEnd = INT_MAX;
+	state.nextFree = options.destination;
+	state.moved = 0;
+	state.failed = 0;
+	size_t separator = options.pathBeforePercents.find_last_of(CrossPlatformText("/"));
+#ifndef FOR_LINUX
+	separator = options.pathBeforePercents.find_last_of(CrossPlatformText("/\\:"));
+#endif
+	if (separator == CrossPlatformString::npos) {
+		state.namePrefix = options.pathBeforePercents;
+	}
+	else {
+		state.directory = options.pathBeforePercents.substr(0, separator + 1);
+		state.namePrefix = options.pathBeforePercents.substr(separator + 1);
+	}
+
+#ifndef FOR_LINUX
+	HANDLE directory = CreateFileW(state.directory.empty() ? L"." : state.directory.c_str(), FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (directory == INVALID_HANDLE_VALUE) {
+		WinError winErr;
+		CrossPlatformCerr << CrossPlatformText("Error opening directory ") << state.directory.c_str() << CrossPlatformText(": ") << winErr.getMessage() << std::endl;
+		return -1;
+	}
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	std::vector<DWORD> buffer(16384); // DWORD for the alignment FILE_NOTIFY_INFORMATION needs
+	const DWORD notifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE;
+	// start watching before the scan, so that nothing that appears during it is missed
+	if (!ReadDirectoryChangesW(directory, buffer.data(), (DWORD)(buffer.size() * sizeof(DWORD)), FALSE, notifyFilter, NULL, &overlapped, NULL)) {
+		WinError winErr;
+		CrossPlatformCerr << CrossPlatformText("Error watching directory ") << state.directory.c_str() << CrossPlatformText(": ") << winErr.getMessage() << std::endl;
+		CloseHandle(overlapped.hEvent);
+		CloseHandle(directory);
+		return -1;
+	}
+	SetConsoleCtrlHandler(stopFrameWatch, TRUE);
+#else
+	const int inotify = inotify_init1(IN_CLOEXEC);
+	if (inotify < 0 || inotify_add_watch(inotify, state.directory.empty() ? "." : state.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		CrossPlatformCerr << CrossPlatformText("Error watching directory ") << (state.directory.empty() ? "." : state.directory.c_str())
+			<< CrossPlatformText(": ") << strerror(errno) << std::endl;
+		if (inotify >= 0) close(inotify);
+		return -1;
+	}
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stopFrameWatch;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	std::vector<char> buffer(65536);
+#endif
+
+	int result = 0;
+	if (!scanFrameWatchDirectory(state)) {
+		result = -1;
+	}
+	else {
+		CrossPlatformCout << CrossPlatformText("Watching for frames ") << options.start << CrossPlatformText("-") << options.end
+			<< CrossPlatformText(", moved ") << state.moved << CrossPlatformText(" that were already there. Press Ctrl+C to stop.\n");
+	}
+	int number;
+	while (result == 0 && !frameWatchStopRequested) {
+#ifndef FOR_LINUX
+		// wait with a timeout so that Ctrl+C gets noticed
+		if (WaitForSingleObject(overlapped.hEvent, 500) == WAIT_TIMEOUT) continue;
+		DWORD size = 0;
+		if (!GetOverlappedResult(directory, &overlapped, &size, FALSE)) {
+			WinError winErr;
+			CrossPlatformCerr << CrossPlatformText("Error watching directory ") << state.directory.c_str() << CrossPlatformText(": ") << winErr.getMessage() << std::endl;
+			result = -1;
+			break;
+		}
+		// copy out the names before asking for more notifications into the same buffer
+		std::vector<CrossPlatformString> names;
+		if (size == 0) {
+			names.emplace_back(); // the buffer overflowed, and the notifications are lost
+		}
+		for (DWORD offset = 0; size != 0; ) {
+			const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)((const char*)buffer.data() + offset);
+			if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+				names.emplace_back(info->FileName, info->FileNameLength / sizeof(WCHAR));
+			}
+			if (!info->NextEntryOffset) break;
+			offset += info->NextEntryOffset;
+		}
+		ResetEvent(overlapped.hEvent);
+		if (!ReadDirectoryChangesW(directory, buffer.data(), (DWORD)(buffer.size() * sizeof(DWORD)), FALSE, notifyFilter, NULL, &overlapped, NULL)) {
+			WinError winErr;
+			CrossPlatformCerr << CrossPlatformText("Error watching directory ") << state.directory.c_str() << CrossPlatformText(": ") << winErr.getMessage() << std::endl;
+			result = -1;
+		}
+		for (const CrossPlatformString& name : names) {
+			if (name.empty()) {
+				if (!scanFrameWatchDirectory(state)) result = -1;
+			}
+			else if (parseFrameWatchName(state, name.c_str(), name.size(), number)) {
+				placeFrame(state, number);
+			}
+		}
+#else
+		// poll with a timeout so that a Ctrl+C that comes just before waiting still gets noticed
+		struct pollfd pollFd = { inotify, POLLIN, 0 };
+		const int ready = poll(&pollFd, 1, 500);
+		if (ready <= 0) {
+			if (ready < 0 && errno != EINTR) {
+				CrossPlatformCerr << CrossPlatformText("Error watching directory: ") << strerror(errno) << std::endl;
+				result = -1;
+			}
+			continue;
+		}
+		const ssize_t size = read(inotify, buffer.data(), buffer.size());
+		if (size <= 0) {
+			if (size < 0 && errno != EINTR && errno != EAGAIN) {
+				CrossPlatformCerr << CrossPlatformText("Error watching directory: ") << strerror(errno) << std::endl;
+				result = -1;
+			}
+			continue;
+		}
+		for (ssize_t offset = 0; offset < size; ) {
+			const struct inotify_event* event = (const struct inotify_event*)(buffer.data() + offset);
+			offset += sizeof(struct inotify_event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				if (!scanFrameWatchDirectory(state)) result = -1;
+			}
+			else if (event->mask & IN_IGNORED) {
+				CrossPlatformCerr << CrossPlatformText("The watched directory was deleted or unmounted.\n");
+				result = -1;
+			}
+			else if (event->len && !(event->mask & IN_ISDIR) && parseFrameWatchName(state, event->name, strlen(event->name), number)) {
+				placeFrame(state, number);
+			}
+		}
+#endif
+	}
+
+#ifndef FOR_LINUX
+	SetConsoleCtrlHandler(stopFrameWatch, FALSE);
+	DWORD unused = 0;
+	if (CancelIo(directory)) {
+		GetOverlappedResult(directory, &overlapped, &unused, TRUE); // the buffer must stay alive until the cancelled read is done
+	}
+	CloseHandle(overlapped.hEvent);
+	CloseHandle(directory);
+#else
+	action.sa_handler = SIG_DFL;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	close(inotify);
+#endif
+	CrossPlatformCout << CrossPlatformText("Stopped watching. Moved ") << state.moved << CrossPlatformText(" frames");
+	if (state.failed) {
+		CrossPlatformCout << CrossPlatformText(", failed to move ") << state.failed;
+	}
+	CrossPlatformCout << CrossPlatformText(".\n");
+	return result;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include "CrossPlatformDefs.h"
+
+struct FrameWatchOptions {
+	CrossPlatformString pathBeforePercents;
+	size_t numberOfPercentSigns;
+	CrossPlatformString pathAfterPercents;
+	int start; // frames with numbers from start to end get moved when they appear
+	int end;
+	int destination;
+	bool compact; // move each frame to the lowest free number starting from destination, instead of keeping the offset
+	bool (*moveFile)(const CrossPlatformString& source, const CrossPlatformString& dest);
+};
+
+int watchFrames(const FrameWatchOptions& options);
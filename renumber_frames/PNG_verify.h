@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include "CrossPlatformDefs.h"
+
+// This file is copy-pasted between the renumber_frames and remove_half_the_frames projects. Keep the copies identical.
+
+// PNG signature (8 bytes) and the IHDR chunk (length, type, 13 bytes of data, CRC), which the PNG spec requires to come first.
+#define PNG_VERIFY_HEADER_SIZE 33
+
+// Reading headers mostly waits for the disk, so there are more threads than cores by default
+#define PNG_VERIFY_DEFAULT_THREADS 16
+
+bool takePNGVerifyOptions(int& argc, CrossPlatformChar* argv[], bool& verify, int& threadCount);
+
+int verifyPNGSequence(const CrossPlatformString& pathBeforePercents, size_t numberOfPercentSigns, const CrossPlatformString& pathAfterPercents,
+	int start, int end, int threadCount);
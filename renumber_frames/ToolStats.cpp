@@ -0,0 +1,245 @@
+#include "ToolStats.h"
+#include "ToolTrace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <new>
+#ifndef FOR_LINUX
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+// This file is copy-pasted between all the projects. Keep the copies identical.
+
+struct ToolStats toolStats;
+
+// The replacement operator new counts toward the allocations in --stats. The nothrow and array forms
+// are replaced too, as the standard library may implement them without going through this one.
+void* operator new(size_t size) {
+	countToolStats(toolStats.allocations);
+	countToolStats(toolStats.allocatedBytes, (long long)size);
+	void* pointer = malloc(size ? size : 1);
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	countToolStats(toolStats.allocations);
+	countToolStats(toolStats.allocatedBytes, (long long)size);
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept {
+	free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+	free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+	free(pointer);
+}
+
+static double toolStatsWallSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double toolStatsCpuSeconds() {
+#ifndef FOR_LINUX
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+		return 0.;
+	}
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernelTime.dwLowDateTime;
+	kernel.HighPart = kernelTime.dwHighDateTime;
+	user.LowPart = userTime.dwLowDateTime;
+	user.HighPart = userTime.dwHighDateTime;
+	return (double)(kernel.QuadPart + user.QuadPart) / 10000000.; // in 100 ns units
+#else
+	struct timespec time;
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+		return 0.;
+	}
+	return (double)time.tv_sec + (double)time.tv_nsec / 1000000000.;
+#endif
+}
+
+struct ToolStatsIO {
+	long long reads;
+	long long writes;
+	long long bytesRead;
+	long long bytesWritten;
+};
+
+// Returns false if the operating system didn't tell.
+static bool getToolStatsIO(struct ToolStatsIO& io) {
+#ifndef FOR_LINUX
+	IO_COUNTERS counters;
+	if (!GetProcessIoCounters(GetCurrentProcess(), &counters)) {
+		return false;
+	}
+	io.reads = (long long)counters.ReadOperationCount;
+	io.writes = (long long)counters.WriteOperationCount;
+	io.bytesRead = (long long)counters.ReadTransferCount;
+	io.bytesWritten = (long long)counters.WriteTransferCount;
+	return true;
+#else
+	// rchar and wchar count bytes passed to read and write calls, whether they came from the disk or the page cache
+	FILE* file = fopen("/proc/self/io", "rb");
+	if (!file) {
+		return false;
+	}
+	memset(&io, 0, sizeof(io));
+	int found = 0;
+	char line[128];
+	long long value;
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "rchar: %lld", &value) == 1) { io.bytesRead = value; ++found; }
+		else if (sscanf(line, "wchar: %lld", &value) == 1) { io.bytesWritten = value; ++found; }
+		else if (sscanf(line, "syscr: %lld", &value) == 1) { io.reads = value; ++found; }
+		else if (sscanf(line, "syscw: %lld", &value) == 1) { io.writes = value; ++found; }
+	}
+	fclose(file);
+	return found == 4;
+#endif
+}
+
+static void finishToolStats() {
+	if (toolStats.phase >= 0) {
+		beginToolStatsPhase((enum ToolStatsPhase)toolStats.phase);
+	}
+	printToolStats();
+	writeToolTrace(toolStats.toolName);
+}
+
+/**
+* Function finds the --stats and --trace "path" options among the arguments and removes them, so that the rest
+* of the argument parsing doesn't need to know about them. If either is there, starts timing the parse phase
+* and makes the report and the trace get written on exit, including exits through exit().
+* Returns false if --trace is not followed by a path.
+* @param toolName Name of the program, goes into the report
+* @param argc Gets decreased by the number of arguments removed
+* @param argv Gets the options removed
+*/
+bool takeToolStatsOptions(const char* toolName, int& argc, CrossPlatformChar* argv[]) {
+	toolStats.toolName = toolName;
+	toolStats.phase = -1;
+	bool traceWithoutPath = false;
+	for (int i = 1; i < argc; ++i) {
+		int taken = 0;
+		if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("--stats")) == 0) {
+			toolStats.enabled = true;
+			taken = 1;
+		}
+		else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("--trace")) == 0) {
+			if (i + 1 >= argc) {
+				traceWithoutPath = true;
+				taken = 1;
+			}
+			else {
+				startToolTrace(argv[i + 1]);
+				taken = 2;
+			}
+		}
+		if (!taken) {
+			continue;
+		}
+		for (int j = i; j + taken < argc; ++j) {
+			argv[j] = argv[j + taken];
+		}
+		argc -= taken;
+		argv[argc] = NULL;
+		--i;
+	}
+	if (toolStats.enabled || toolTrace.enabled) {
+		beginToolStatsPhase(TOOL_STATS_PARSE);
+		atexit(finishToolStats);
+	}
+	return !traceWithoutPath;
+}
+
+static const char* const toolStatsPhaseNames[TOOL_STATS_PHASE_COUNT] = { "parse", "plan", "execute" };
+
+/**
+* Function ends the current phase, adding the time spent in it and putting it into the trace, and starts the given one.
+* Phases can be entered more than once, their times add up.
+*/
+void beginToolStatsPhase(enum ToolStatsPhase phase) {
+	if (!toolStats.enabled && !toolTrace.enabled) {
+		return;
+	}
+	const double wall = toolStatsWallSeconds();
+	const double cpu = toolStatsCpuSeconds();
+	const long long allocations = toolStats.allocations.load();
+	if (toolStats.phase >= 0) {
+		toolStats.phaseWallSeconds[toolStats.phase] += wall - toolStats.phaseStartWall;
+		toolStats.phaseCpuSeconds[toolStats.phase] += cpu - toolStats.phaseStartCpu;
+		toolStats.phaseAllocations[toolStats.phase] += allocations - toolStats.phaseStartAllocations;
+		addToolTraceEvent(toolStatsPhaseNames[toolStats.phase], "phase", toolStats.phaseStartTrace, -1, NULL);
+	}
+	toolStats.phase = phase;
+	toolStats.phaseStartWall = wall;
+	toolStats.phaseStartCpu = cpu;
+	toolStats.phaseStartAllocations = allocations;
+	toolStats.phaseStartTrace = toolTrace.enabled ? toolTraceNow() : 0;
+}
+
+/**
+* Function prints the report as one line of JSON on stderr, if --stats was given. Times are in milliseconds.
+* I/O counters that the operating system didn't provide are printed as -1.
+*/
+void printToolStats() {
+	if (!toolStats.enabled) {
+		return;
+	}
+	struct ToolStatsIO io;
+	if (!getToolStatsIO(io)) {
+		io.reads = io.writes = io.bytesRead = io.bytesWritten = -1;
+	}
+	double wallTotal = 0.;
+	double cpuTotal = 0.;
+	for (int i = 0; i < TOOL_STATS_PHASE_COUNT; ++i) {
+		wallTotal += toolStats.phaseWallSeconds[i];
+		cpuTotal += toolStats.phaseCpuSeconds[i];
+	}
+	const long long frames = toolStats.frames.load();
+	const long long files = toolStats.files.load();
+
+	std::ios_base::fmtflags flags = CrossPlatformCerr.flags();
+	std::streamsize precision = CrossPlatformCerr.precision();
+	CrossPlatformCerr << std::fixed << std::setprecision(3)
+		<< "{\"tool\":\"" << toolStats.toolName << "\",\"phases\":{";
+	for (int i = 0; i < TOOL_STATS_PHASE_COUNT; ++i) {
+		CrossPlatformCerr << (i ? "," : "") << "\"" << toolStatsPhaseNames[i] << "\":{\"wall_ms\":" << toolStats.phaseWallSeconds[i] * 1000.
+			<< ",\"cpu_ms\":" << toolStats.phaseCpuSeconds[i] * 1000. << ",\"allocations\":" << toolStats.phaseAllocations[i] << "}";
+	}
+	CrossPlatformCerr << "},\"wall_ms\":" << wallTotal * 1000. << ",\"cpu_ms\":" << cpuTotal * 1000.
+		<< ",\"bytes_read\":" << io.bytesRead << ",\"bytes_written\":" << io.bytesWritten
+		<< ",\"reads\":" << io.reads << ",\"writes\":" << io.writes << ",\"seeks\":" << toolStats.seeks.load()
+		<< ",\"renames\":" << toolStats.renames.load() << ",\"unlinks\":" << toolStats.unlinks.load() << ",\"syncs\":" << toolStats.syncs.load()
+		<< ",\"frames\":" << frames << ",\"files\":" << files
+		<< ",\"allocations\":" << toolStats.allocations.load() << ",\"allocated_bytes\":" << toolStats.allocatedBytes.load()
+		<< ",\"frames_per_second\":" << (wallTotal > 0. ? frames / wallTotal : 0.)
+		<< ",\"files_per_second\":" << (wallTotal > 0. ? files / wallTotal : 0.) << "}" << std::endl;
+	CrossPlatformCerr.flags(flags);
+	CrossPlatformCerr.precision(precision);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "CrossPlatformDefs.h"
+
+// This file is copy-pasted between all the projects. Keep the copies identical.
+
+#define TOOL_TRACE_BUFFER_EVENTS 16384
+#define TOOL_TRACE_DETAIL_LENGTH 80
+
+struct ToolTraceEvent {
+	const char* name; // string literals only, they get read at exit
+	const char* category;
+	long long start; // microseconds since the trace started
+	long long duration;
+	long long number; // a frame number or a count, -1 if none
+	char detail[TOOL_TRACE_DETAIL_LENGTH]; // such as a file path, cut short if too long. Empty if none
+};
+
+/**
+* Events of one thread. Only that thread writes into it, so adding an event takes no locks and no atomic read-modify-writes.
+* When full, new events overwrite the oldest ones.
+*/
+struct ToolTraceBuffer {
+	struct ToolTraceEvent events[TOOL_TRACE_BUFFER_EVENTS];
+	std::atomic<unsigned long long> written; // events ever added. The next one goes into events[written % TOOL_TRACE_BUFFER_EVENTS]
+	int threadIndex;
+	const char* threadName; // NULL if not set
+	struct ToolTraceBuffer* next;
+};
+
+/**
+* State of the --trace option. Events go into per-thread buffers that get allocated on a thread's first event
+* and written out as Trace Event Format JSON (viewable in chrome://tracing or Perfetto) when the program exits.
+*/
+struct ToolTrace {
+	bool enabled;
+	CrossPlatformString path;
+	std::chrono::steady_clock::time_point start;
+	std::atomic<struct ToolTraceBuffer*> buffers; // all buffers ever allocated, newest first
+	std::atomic<int> threadCount;
+};
+
+extern struct ToolTrace toolTrace;
+
+void startToolTrace(const CrossPlatformString& path);
+
+long long toolTraceNow();
+
+void addToolTraceEvent(const char* name, const char* category, long long start, long long number, const CrossPlatformChar* detail);
+
+void setToolTraceThreadName(const char* name);
+
+bool writeToolTrace(const char* toolName);
+
+/**
+* Adds a complete event covering the lifetime of the object, if tracing is on.
+* detail must stay valid until then.
+*/
+struct ToolTraceSpan {
+	const char* name;
+	const char* category;
+	long long start; // -1 if tracing is off
+	long long number;
+	const CrossPlatformChar* detail;
+
+	ToolTraceSpan(const char* name, const char* category, const CrossPlatformChar* detail = NULL)
+		: name(name), category(category), start(toolTrace.enabled ? toolTraceNow() : -1), number(-1), detail(detail) {}
+
+	ToolTraceSpan(const char* name, const char* category, long long number)
+		: name(name), category(category), start(toolTrace.enabled ? toolTraceNow() : -1), number(number), detail(NULL) {}
+
+	~ToolTraceSpan() {
+		if (start >= 0) {
+			addToolTraceEvent(name, category, start, number, detail);
+		}
+	}
+};
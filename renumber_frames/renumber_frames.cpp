@@ -8,8 +8,14 @@
 #include <fstream>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #endif
 #include "CrossPlatformDefs.h"
+#include "Frame_watch.h"
+#include "Frame_journal.h"
+#include "PNG_verify.h"
+#include "ToolStats.h"
+#include "ToolTrace.h"
 #include <vector>
 
 #ifndef FOR_LINUX
@@ -142,9 +148,15 @@ CrossPlatformString repeatChar(CrossPlatformChar c, int n) {
     return CrossPlatformString(n, c);
 }
 
+// -watch writes each rename through to the disk. A job with a journal doesn't, the journal syncs the directory as often as -durability asks
+bool moveFileWriteThrough = true;
+
 bool crossPlatformMoveFile(const CrossPlatformString& source, const CrossPlatformString& dest) {
+    countToolStats(toolStats.renames);
+    countToolStats(toolStats.files);
+    ToolTraceSpan span("rename", "io", source.c_str());
     #ifndef FOR_LINUX
-    if (!MoveFileExW(source.c_str(), dest.c_str(), MOVEFILE_WRITE_THROUGH)) {
+    if (!MoveFileExW(source.c_str(), dest.c_str(), moveFileWriteThrough ? MOVEFILE_WRITE_THROUGH : 0)) {
         WinError winErr;
         CrossPlatformCerr << "Error moving file from " << source.c_str() << " to " << dest.c_str() << ": " << winErr.getMessage() << std::endl;
         return false;
@@ -153,7 +165,7 @@ bool crossPlatformMoveFile(const CrossPlatformString& source, const CrossPlatfor
     int errCode = rename(source.c_str(), dest.c_str());
 
     if (errCode) {
-        CrossPlatformCerr << "Error moving file from " << source.c_str() << " to " << dest.c_str() << ": " << strerror(errCode) << std::endl;
+        CrossPlatformCerr << "Error moving file from " << source.c_str() << " to " << dest.c_str() << ": " << strerror(errno) << std::endl;
         return false;
     }
     #endif
@@ -175,11 +187,68 @@ CrossPlatformString& numberToStringAndPad(int numberToBeConverted, size_t totalC
     CrossPlatformText(" image1.png, image2.png, image3.png, where the 1, 2, 3, etc part is replaced with a % sign.\n")\
     CrossPlatformText("Use multiple % signs if you want the number to be 0-padded on the left.\n")\
 	CrossPlatformText("2 - frame range in format 0-20. This specifies the range of frames to move.\n")\
-	CrossPlatformText("3 - destination frame number to move the frames to.\n")
+	CrossPlatformText("3 - destination frame number to move the frames to.\n")\
+	CrossPlatformText("Optional: -watch - keep running and move each frame of the range as soon as it appears in the directory, until Ctrl+C.")\
+	CrossPlatformText(" Frames that are already there get moved first. The destination frames can't overlap the frame range.\n")\
+	CrossPlatformText("Optional: -compact - with -watch, move each frame to the lowest free number starting from the destination,")\
+	CrossPlatformText(" in the order the frames appear, instead of keeping the distance from the start of the range.\n")\
+	CrossPlatformText("Optional: -verify - don't move anything (the destination frame can be left out), only check that every frame of the range exists, is a PNG file and has the same")\
+	CrossPlatformText(" width, height, bit depth and color type as the others. Only the first 33 bytes of each file are read. Exits with -1 if there are problems.\n")\
+	CrossPlatformText("Optional: -threads ## - how many files -verify reads at the same time. 16 by default.\n")\
+	CrossPlatformText("Optional: --resume - finish a job that got interrupted, from the journal it left next to the frames. Give it the same arguments as the job.\n")\
+	CrossPlatformText("Optional: -durability none|per-op|batched - when the renames and deletes get synced to the disk, so that they survive a power loss.")\
+	CrossPlatformText(" none leaves it to the system, per-op syncs after each one, batched (the default) syncs the directory once per 1024.\n")\
+	CrossPlatformText("Optional: --stats - when the program exits, print a line of JSON to stderr with the time spent")\
+	CrossPlatformText(" and the number of file operations done.\n")\
+	CrossPlatformText("Optional: --trace \"path\" - write a timeline of every rename into \"path\" in Chrome's trace format (open it in chrome://tracing or ui.perfetto.dev).\n")
 
 
 int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar* envp[])
 {
+    if (!takeToolStatsOptions("renumber_frames", argc, argv)) {
+        CrossPlatformCerr << CrossPlatformText("A file path for the trace must be provided after the --trace option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    bool metVerifyFlag = false;
+    int threadsValue = PNG_VERIFY_DEFAULT_THREADS;
+    if (!takePNGVerifyOptions(argc, argv, metVerifyFlag, threadsValue)) {
+        CrossPlatformCerr << CrossPlatformText("A thread count from 1 to 1024 must be provided after the -threads option. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    bool metResumeFlag = false;
+    FrameDurability durability = FRAME_DURABILITY_BATCHED;
+    if (!takeFrameJournalOptions(argc, argv, metResumeFlag, durability)) {
+        CrossPlatformCerr << CrossPlatformText("The -durability option must be followed by none, per-op or batched. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    bool metWatchFlag = false;
+    bool metCompactFlag = false;
+    for (int i = 1; i < argc; ) {
+        if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-watch")) == 0) {
+            metWatchFlag = true;
+        } else if (CrossPlatformCaseInsensitiveTextCompare(argv[i], CrossPlatformText("-compact")) == 0) {
+            metCompactFlag = true;
+        } else {
+            ++i;
+            continue;
+        }
+        for (int j = i; j + 1 < argc; ++j) {
+            argv[j] = argv[j + 1];
+        }
+        --argc;
+    }
+    if (metCompactFlag && !metWatchFlag) {
+        CrossPlatformCerr << CrossPlatformText("The -compact option can only be used together with -watch. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (metResumeFlag && (metWatchFlag || metVerifyFlag)) {
+        CrossPlatformCerr << CrossPlatformText("The --resume option can't be used with -watch or -verify. Use --help or /? option for help.\n");
+        exit(-1);
+    }
+    if (metWatchFlag && metVerifyFlag) {
+        CrossPlatformCerr << CrossPlatformText("The -watch and -verify options can't be used together. Use --help or /? option for help.\n");
+        exit(-1);
+    }
     if (argc == 2 && (
         CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("-help")) == 0
         || CrossPlatformCaseInsensitiveTextCompare(argv[1], CrossPlatformText("--help")) == 0
@@ -189,7 +258,7 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         exit(0);
     }
 
-    if (argc != 4) {
+    if (argc != 4 && !(metVerifyFlag && argc == 3)) {
         CrossPlatformCerr << CrossPlatformText("Wrong number of argument. Use --help or /? option for help.\n");
         exit(-1);
     }
@@ -244,6 +313,12 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         exit(-1);
     }
 
+    if (metVerifyFlag) {
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        const int problems = verifyPNGSequence(pathBeforePercents, numberOfPercentSigns, pathAfterPercents, start, end, threadsValue);
+        exit(problems ? -1 : 0);
+    }
+
     int dest = 0;
     if (!parseInteger(CrossPlatformString{ argv[3] }, dest)) {
         CrossPlatformCerr << CrossPlatformText("Error: failed to parse the destination frame argument. Use --help or /? option for help.\n");
@@ -254,12 +329,35 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
         exit(-1);
     }
 
+    if (metWatchFlag) {
+        if ((long long)dest + end - start >= start && dest <= end) {
+            CrossPlatformCerr << CrossPlatformText("Error: with -watch, the destination frames can't overlap the frame range,")
+                << CrossPlatformText(" otherwise moved frames would look like new ones. Use --help or /? option for help.\n");
+            exit(-1);
+        }
+        FrameWatchOptions options;
+        options.pathBeforePercents = pathBeforePercents;
+        options.numberOfPercentSigns = numberOfPercentSigns;
+        options.pathAfterPercents = pathAfterPercents;
+        options.start = start;
+        options.end = end;
+        options.destination = dest;
+        options.compact = metCompactFlag;
+        options.moveFile = crossPlatformMoveFile;
+        beginToolStatsPhase(TOOL_STATS_EXECUTE);
+        exit(watchFrames(options));
+    }
+
     if (dest == start) {
         CrossPlatformCout << CrossPlatformText("There's nothing to move, destination is equal to start.\n");
         exit(0);
     }
 
-    if (dest < start) {
+    beginToolStatsPhase(TOOL_STATS_PLAN);
+    // frames moving down get moved from the first one, frames moving up from the last one, so that none lands on one not moved yet
+    const bool movingDown = dest < start;
+    // on resume the frames are halfway through being moved, and the ones in the way are the job's own
+    if (movingDown && !metResumeFlag) {
         int finalIndex = dest + end - start;
         if (finalIndex >= start) finalIndex = start - 1;
         CrossPlatformString destPath;
@@ -273,18 +371,7 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
                 exit(-1);
             }
         }
-        CrossPlatformString sourcePath;
-        for (int i = start; i <= end; ++i) {
-            sourcePath = pathBeforePercents;
-            sourcePath += numberToStringAndPad(i, numberOfPercentSigns);
-            sourcePath += pathAfterPercents;
-            destPath = pathBeforePercents;
-            destPath += numberToStringAndPad(dest, numberOfPercentSigns);
-            destPath += pathAfterPercents;
-            crossPlatformMoveFile(sourcePath, destPath);
-            ++dest;
-        }
-    } else {
+    } else if (!metResumeFlag) {
         int firstIndex = dest;
         if (firstIndex <= end) firstIndex = end + 1;
         const int lastIndex = dest + end - start;
@@ -296,20 +383,42 @@ int CrossPlatformMainName(int argc, CrossPlatformChar* argv[], CrossPlatformChar
                 exit(-1);
             }
         }
-        CrossPlatformString sourcePath;
-        CrossPlatformString destPath;
-        dest = dest + end - start;
-        for (int i = end; i >= start; --i) {
-            sourcePath = pathBeforePercents;
-            sourcePath += numberToStringAndPad(i, numberOfPercentSigns);
-            sourcePath += pathAfterPercents;
-            destPath = pathBeforePercents;
-            destPath += numberToStringAndPad(dest, numberOfPercentSigns);
-            destPath += pathAfterPercents;
-            crossPlatformMoveFile(sourcePath, destPath);
-            --dest;
+    }
+    FrameJournal journal;
+    const std::string plan = "renumber_frames " + std::to_string(start) + "-" + std::to_string(end) + " " + std::to_string(dest);
+    if (beginFrameJournal(journal, path, plan, metResumeFlag, durability) != 0) {
+        exit(-1);
+    }
+
+    beginToolStatsPhase(TOOL_STATS_EXECUTE);
+    moveFileWriteThrough = false;
+    ToolTraceSpan batch("renames", "io", (long long)(end - start + 1));
+    CrossPlatformString sourcePath;
+    CrossPlatformString destPath;
+    for (int operation = journal.done; operation <= end - start; ++operation) {
+        const int source = movingDown ? start + operation : end - operation;
+        const int destination = source - start + dest;
+        sourcePath = pathBeforePercents;
+        sourcePath += numberToStringAndPad(source, numberOfPercentSigns);
+        sourcePath += pathAfterPercents;
+        destPath = pathBeforePercents;
+        destPath += numberToStringAndPad(destination, numberOfPercentSigns);
+        destPath += pathAfterPercents;
+        // a destination that exists got there before the interruption, since no frame is moved into an occupied spot
+        if (!isFrameJournalReplaying(journal) || !fileExists(destPath)) {
+            prepareFrameJournalRename(journal, destination);
+            // a missing frame gets reported and skipped, anything else stops the job, since the frames moved after it
+            // could land on this one
+            if (!crossPlatformMoveFile(sourcePath, destPath) && fileExists(sourcePath)) {
+                endFrameJournal(journal, false);
+                CrossPlatformCerr << CrossPlatformText("Stopped at the first frame that couldn't be moved, the frames after it are untouched.")
+                    << CrossPlatformText(" Fix the problem and run the same command with --resume to finish the job.\n");
+                exit(-1);
+            }
         }
+        finishFrameJournalOperation(journal);
     }
+    endFrameJournal(journal, true);
 
     CrossPlatformCout << CrossPlatformText("Moved successfully.\n");
     return 0;